@@ -6,6 +6,46 @@ const example_list = [_][]const u8{
     "streaming-parser",
 };
 
+/// Examples that only exist in Zig.
+const zig_example_list = [_][]const u8{
+    "capsule-server",
+    "capsule-load",
+    "gem2html-pipelined",
+};
+
+/// Examples that also have a C++ version using include/gemtext.hpp.
+const cpp_example_list = [_][]const u8{
+    "gem2html",
+};
+
+const cpp_flags = [_][]const u8{
+    "-std=c++20",
+    "-Wall",
+    "-Wextra",
+};
+
+const tool_list = [_][]const u8{
+    "gemfuzz",
+    "gemtextd",
+    "gemlinkcheck",
+    "gembatch",
+    "gemfeed",
+    "gemcompressbench",
+    "gemstats",
+    "gemgrep",
+};
+
+/// Tools with tests of their own, run by `zig build test`.
+const tested_tool_list = [_][]const u8{
+    "gembatch",
+};
+
+/// Tools written in C++ against include/gemtext.hpp.
+const cpp_tool_list = [_][]const u8{
+    "gempmrbench",
+    "gemstreambench",
+};
+
 pub fn build(b: *std.Build) void {
     const gemtext = b.addModule("gemtext", .{
         .root_source_file = .{ .path = "src/gemtext.zig" },
@@ -24,6 +64,18 @@ pub fn build(b: *std.Build) void {
     lib.linkLibC();
     b.installArtifact(lib);
 
+    // On x86-64, the C library contains the scanning kernels once per instruction set tier
+    // and picks the best one at runtime, see src/cpu_dispatch.zig.
+    const kernel_objects = addKernelObjects(b, target, optimize);
+
+    const lib_options = b.addOptions();
+    lib_options.addOption(bool, "kernel_tiers", kernel_objects.len > 0);
+
+    lib.root_module.addOptions("build_options", lib_options);
+    for (kernel_objects) |object| {
+        lib.addObject(object);
+    }
+
     const main_tests = b.addTest(.{
         .root_source_file = .{ .path = "src/tests.zig" },
         .target = target,
@@ -38,10 +90,38 @@ pub fn build(b: *std.Build) void {
     //lib_tests.linkLibrary(lib);
     lib_tests.linkLibC();
     lib_tests.addIncludePath(.{ .path = "include" });
+    lib_tests.root_module.addOptions("build_options", lib_options);
+    for (kernel_objects) |object| {
+        lib_tests.addObject(object);
+    }
+
+    const cpp_tests = b.addExecutable(.{
+        .name = "cpp-tests",
+        .target = target,
+        .optimize = optimize,
+    });
+    cpp_tests.addCSourceFile(.{
+        .file = .{ .path = "src/tests.cpp" },
+        .flags = &cpp_flags,
+    });
+    cpp_tests.linkLibrary(lib);
+    cpp_tests.addIncludePath(.{ .path = "include" });
+    cpp_tests.linkLibCpp();
 
     const test_step = b.step("test", "Run library tests");
     test_step.dependOn(&b.addRunArtifact(main_tests).step);
     test_step.dependOn(&b.addRunArtifact(lib_tests).step);
+    test_step.dependOn(&b.addRunArtifact(cpp_tests).step);
+
+    inline for (tested_tool_list) |tool_name| {
+        const tool_tests = b.addTest(.{
+            .root_source_file = .{ .path = "tools/" ++ tool_name ++ ".zig" },
+            .target = target,
+            .optimize = optimize,
+        });
+        tool_tests.root_module.addImport("gemtext", gemtext);
+        test_step.dependOn(&b.addRunArtifact(tool_tests).step);
+    }
 
     const examples = b.step("examples", "Builds all examples");
 
@@ -76,4 +156,171 @@ pub fn build(b: *std.Build) void {
             examples.dependOn(&b.addInstallArtifact(example, .{}).step);
         }
     }
+
+    inline for (zig_example_list) |example_name| {
+        const example = b.addExecutable(.{
+            .name = example_name,
+            .root_source_file = .{ .path = "examples/" ++ example_name ++ ".zig" },
+            .target = target,
+            .optimize = optimize,
+        });
+
+        example.root_module.addImport("gemtext", gemtext);
+        examples.dependOn(&b.addInstallArtifact(example, .{}).step);
+    }
+
+    inline for (cpp_example_list) |example_name| {
+        const example = b.addExecutable(.{
+            .name = example_name ++ "-cpp",
+            .target = target,
+        });
+        example.addCSourceFile(.{
+            .file = .{ .path = "examples/" ++ example_name ++ ".cpp" },
+            .flags = &cpp_flags,
+        });
+
+        example.linkLibrary(lib);
+        example.addIncludePath(.{ .path = "include" });
+        example.linkLibCpp();
+
+        examples.dependOn(&b.addInstallArtifact(example, .{}).step);
+    }
+
+    const tools = b.step("tools", "Builds all tools");
+
+    inline for (tool_list) |tool_name| {
+        const tool = b.addExecutable(.{
+            .name = tool_name,
+            .root_source_file = .{ .path = "tools/" ++ tool_name ++ ".zig" },
+            .target = target,
+            .optimize = optimize,
+        });
+
+        tool.root_module.addImport("gemtext", gemtext);
+        tools.dependOn(&b.addInstallArtifact(tool, .{}).step);
+    }
+
+    inline for (cpp_tool_list) |tool_name| {
+        const tool = b.addExecutable(.{
+            .name = tool_name,
+            .target = target,
+            .optimize = optimize,
+        });
+        tool.addCSourceFile(.{
+            .file = .{ .path = "tools/" ++ tool_name ++ ".cpp" },
+            .flags = &cpp_flags,
+        });
+
+        tool.linkLibrary(lib);
+        tool.addIncludePath(.{ .path = "include" });
+        tool.linkLibCpp();
+
+        tools.dependOn(&b.addInstallArtifact(tool, .{}).step);
+    }
+
+    {
+        // Client library for gemtextd, see include/gemtextd.h.
+        const client = b.addStaticLibrary(.{
+            .name = "gemtextd-client",
+            .target = target,
+            .optimize = optimize,
+        });
+        client.addCSourceFile(.{
+            .file = .{ .path = "src/gemtextd_client.c" },
+            .flags = &[_][]const u8{
+                "-std=c11",
+                "-Weverything",
+            },
+        });
+        client.addIncludePath(.{ .path = "include" });
+        client.linkLibC();
+        b.installArtifact(client);
+
+        const load = b.addExecutable(.{
+            .name = "gemtextd-load",
+            .target = target,
+            .optimize = optimize,
+        });
+        load.addCSourceFile(.{
+            .file = .{ .path = "tools/gemtextd-load.c" },
+            .flags = &[_][]const u8{
+                "-std=c11",
+                "-Weverything",
+            },
+        });
+        load.linkLibrary(client);
+        load.addIncludePath(.{ .path = "include" });
+        load.linkLibC();
+
+        tools.dependOn(&b.addInstallArtifact(load, .{}).step);
+    }
+
+    {
+        // The regression benchmarks are always built optimized, as their floors are meaningless otherwise.
+        const bench_gemtext = b.createModule(.{
+            .root_source_file = .{ .path = "src/gemtext.zig" },
+            .target = target,
+            .optimize = .ReleaseFast,
+        });
+
+        const bench_tool = b.addExecutable(.{
+            .name = "gemfuzz",
+            .root_source_file = .{ .path = "tools/gemfuzz.zig" },
+            .target = target,
+            .optimize = .ReleaseFast,
+        });
+        bench_tool.root_module.addImport("gemtext", bench_gemtext);
+
+        const run_bench = b.addRunArtifact(bench_tool);
+        run_bench.addArg("--check");
+        run_bench.addArg(b.pathFromRoot("src/test-data/worst-case"));
+
+        const bench_step = b.step("bench", "Run the worst-case regression benchmarks");
+        bench_step.dependOn(&run_bench.step);
+    }
+}
+
+const KernelTier = struct {
+    name: []const u8,
+    model: *const std.Target.Cpu.Model,
+    vector_len: usize,
+};
+
+const kernel_tiers = [_]KernelTier{
+    .{ .name = "sse2", .model = &std.Target.x86.cpu.x86_64, .vector_len = 16 },
+    .{ .name = "avx2", .model = &std.Target.x86.cpu.x86_64_v3, .vector_len = 32 },
+    .{ .name = "avx512", .model = &std.Target.x86.cpu.x86_64_v4, .vector_len = 64 },
+};
+
+/// Compiles the scanning kernels once per x86-64 tier. Returns no objects for other architectures.
+fn addKernelObjects(
+    b: *std.Build,
+    target: std.Build.ResolvedTarget,
+    optimize: std.builtin.OptimizeMode,
+) []const *std.Build.Step.Compile {
+    if (target.result.cpu.arch != .x86_64)
+        return &.{};
+
+    const objects = b.allocator.alloc(*std.Build.Step.Compile, kernel_tiers.len) catch @panic("OOM");
+    for (kernel_tiers, objects) |tier, *object| {
+        const tier_target = b.resolveTargetQuery(.{
+            .cpu_arch = .x86_64,
+            .cpu_model = .{ .explicit = tier.model },
+            .os_tag = target.result.os.tag,
+            .abi = target.result.abi,
+        });
+
+        const options = b.addOptions();
+        options.addOption([]const u8, "tier", tier.name);
+        options.addOption(usize, "vector_len", tier.vector_len);
+
+        object.* = b.addObject(.{
+            .name = b.fmt("gemtext-kernels-{s}", .{tier.name}),
+            .root_source_file = .{ .path = "src/kernels_export.zig" },
+            .target = tier_target,
+            .optimize = optimize,
+        });
+        object.*.root_module.addOptions("kernel_options", options);
+    }
+    return objects;
 }
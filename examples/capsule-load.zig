@@ -0,0 +1,160 @@
+//! This example puts load on `capsule-server`. Every connection sends keep-alive
+//! requests for the same page as fast as the server answers them:
+//!
+//!     capsule-load [--port PORT] [--connections N] [--requests N] [--identity] PATH
+//!
+//! Pages are requested gzipped unless `--identity` is given.
+
+const std = @import("std");
+
+const Worker = struct {
+    address: std.net.Address,
+    request: []const u8,
+    latencies: []u64,
+    bytes: u64 = 0,
+    failed: bool = false,
+
+    fn run(self: *Worker) void {
+        self.runRequests() catch |err| {
+            std.log.err("connection failed: {s}", .{@errorName(err)});
+            self.failed = true;
+        };
+    }
+
+    fn runRequests(self: *Worker) !void {
+        const stream = try std.net.tcpConnectToAddress(self.address);
+        defer stream.close();
+
+        var buffered = std.io.bufferedReader(stream.reader());
+        const reader = buffered.reader();
+
+        var line_buffer: [1024]u8 = undefined;
+        for (self.latencies) |*latency| {
+            var timer = try std.time.Timer.start();
+
+            try stream.writeAll(self.request);
+
+            const status_line = try reader.readUntilDelimiter(&line_buffer, '\n');
+            if (!std.mem.startsWith(u8, status_line, "HTTP/1.1 200"))
+                return error.UnexpectedStatus;
+
+            var content_length: ?u64 = null;
+            while (true) {
+                const line = std.mem.trimRight(u8, try reader.readUntilDelimiter(&line_buffer, '\n'), "\r");
+                if (line.len == 0)
+                    break;
+                const colon = std.mem.indexOfScalar(u8, line, ':') orelse continue;
+                if (std.ascii.eqlIgnoreCase(line[0..colon], "content-length"))
+                    content_length = try std.fmt.parseInt(u64, std.mem.trim(u8, line[colon + 1 ..], " "), 10);
+            }
+
+            const length = content_length orelse return error.MissingContentLength;
+            try reader.skipBytes(length, .{});
+
+            self.bytes += length;
+            latency.* = timer.read();
+        }
+    }
+};
+
+/// Parses the value of `option`, which must be at least 1, as the results are taken from the latencies.
+fn parseCount(option: []const u8, value: []const u8) !usize {
+    const count = try std.fmt.parseInt(usize, value, 10);
+    if (count == 0) {
+        std.log.err("{s} must be at least 1", .{option});
+        return error.InvalidArgument;
+    }
+    return count;
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var port: u16 = 8080;
+    var connections: usize = 8;
+    var requests: usize = 10000;
+    var gzip = true;
+    var path: []const u8 = "/";
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--identity")) {
+            gzip = false;
+        } else if (std.mem.eql(u8, arg, "--port") and i + 1 < args.len) {
+            i += 1;
+            port = try std.fmt.parseInt(u16, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--connections") and i + 1 < args.len) {
+            i += 1;
+            connections = try parseCount(arg, args[i]);
+        } else if (std.mem.eql(u8, arg, "--requests") and i + 1 < args.len) {
+            i += 1;
+            requests = try parseCount(arg, args[i]);
+        } else {
+            path = arg;
+        }
+    }
+
+    const request = try std.fmt.allocPrint(allocator, "GET {s} HTTP/1.1\r\nHost: localhost\r\n{s}\r\n", .{
+        path,
+        if (gzip) "Accept-Encoding: gzip\r\n" else "",
+    });
+    defer allocator.free(request);
+
+    const latencies = try allocator.alloc(u64, connections * requests);
+    defer allocator.free(latencies);
+
+    const workers = try allocator.alloc(Worker, connections);
+    defer allocator.free(workers);
+
+    const threads = try allocator.alloc(std.Thread, connections);
+    defer allocator.free(threads);
+
+    const address = try std.net.Address.parseIp("127.0.0.1", port);
+
+    var timer = try std.time.Timer.start();
+    for (workers, threads, 0..) |*worker, *thread, index| {
+        worker.* = Worker{
+            .address = address,
+            .request = request,
+            .latencies = latencies[index * requests ..][0..requests],
+        };
+        thread.* = try std.Thread.spawn(.{}, Worker.run, .{worker});
+    }
+
+    var bytes: u64 = 0;
+    var failed: usize = 0;
+    for (workers, threads) |worker, thread| {
+        thread.join();
+        bytes += worker.bytes;
+        if (worker.failed)
+            failed += 1;
+    }
+    const elapsed = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_s;
+
+    if (failed > 0) {
+        std.log.err("{} of {} connections failed", .{ failed, connections });
+        return error.LoadTestFailed;
+    }
+
+    std.mem.sort(u64, latencies, {}, std.sort.asc(u64));
+
+    const total = latencies.len;
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("{} requests over {} connections in {d:.3} s\n", .{ total, connections, elapsed });
+    try stdout.print("throughput: {d:.0} req/s, {d:.1} MiB/s out\n", .{
+        @as(f64, @floatFromInt(total)) / elapsed,
+        @as(f64, @floatFromInt(bytes)) / elapsed / (1024 * 1024),
+    });
+    try stdout.print("latency: p50 {d:.1} us, p99 {d:.1} us, max {d:.1} us\n", .{
+        @as(f64, @floatFromInt(latencies[total / 2])) / std.time.ns_per_us,
+        @as(f64, @floatFromInt(latencies[total * 99 / 100])) / std.time.ns_per_us,
+        @as(f64, @floatFromInt(latencies[total - 1])) / std.time.ns_per_us,
+    });
+}
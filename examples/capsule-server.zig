@@ -0,0 +1,417 @@
+//! This example serves a directory of gemini text files as HTML over HTTP on localhost.
+//! It is the deployment shape the library is tuned for: every page is rendered and
+//! gzipped once at startup, so a request is answered with a single `writev` of a
+//! preformatted header and a precomputed body from an epoll loop.
+//!
+//!     capsule-server [--port PORT] ROOT
+//!
+//! `ROOT/a/b.gmi` is served as `/a/b.html`, `index.gmi` files also as their directory.
+//! Sending SIGHUP renders the directory again and swaps in the new pages.
+//! Use `capsule-load` to put load on it.
+//!
+//! This example only runs on Linux.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+const posix = std.posix;
+const linux = std.os.linux;
+
+const max_file_size = 16 * 1024 * 1024;
+
+/// A rendered page in both encodings.
+const Page = struct {
+    html: []const u8,
+    gzip: []const u8,
+    /// Strong validators, one per representation.
+    etag: []const u8,
+    etag_gzip: []const u8,
+};
+
+/// An immutable snapshot of all rendered pages.
+/// Connections with a pending response hold a reference, so a reload
+/// can't free a body that is still being written.
+const Site = struct {
+    allocator: std.mem.Allocator,
+    arena: std.heap.ArenaAllocator,
+    pages: std.StringHashMapUnmanaged(Page),
+    refs: usize,
+
+    fn build(allocator: std.mem.Allocator, root: []const u8) !*Site {
+        const site = try allocator.create(Site);
+        errdefer allocator.destroy(site);
+
+        site.* = Site{
+            .allocator = allocator,
+            .arena = std.heap.ArenaAllocator.init(allocator),
+            .pages = .{},
+            .refs = 1,
+        };
+        errdefer site.arena.deinit();
+
+        const arena = site.arena.allocator();
+
+        var dir = try std.fs.cwd().openDir(root, .{ .iterate = true });
+        defer dir.close();
+
+        var walker = try dir.walk(allocator);
+        defer walker.deinit();
+
+        var html = std.ArrayList(u8).init(allocator);
+        defer html.deinit();
+
+        while (try walker.next()) |entry| {
+            if (entry.kind != .file or !std.mem.endsWith(u8, entry.basename, ".gmi"))
+                continue;
+
+            const text = try entry.dir.readFileAlloc(allocator, entry.basename, max_file_size);
+            defer allocator.free(text);
+
+            var document = try gemtext.Document.parseString(allocator, text);
+            defer document.deinit();
+
+            html.clearRetainingCapacity();
+            try html.appendSlice("<!doctype html>\n<meta charset=\"utf-8\">\n");
+            try gemtext.renderer.html(document.fragments.items, html.writer());
+
+            var gzipped = std.ArrayList(u8).init(arena);
+            var source = std.io.fixedBufferStream(html.items);
+            try std.compress.gzip.compress(source.reader(), gzipped.writer(), .{});
+
+            const hash = std.hash.Wyhash.hash(0, html.items);
+            const page = Page{
+                .html = try arena.dupe(u8, html.items),
+                .gzip = gzipped.items,
+                .etag = try std.fmt.allocPrint(arena, "\"{x:0>16}\"", .{hash}),
+                .etag_gzip = try std.fmt.allocPrint(arena, "\"{x:0>16}-gz\"", .{hash}),
+            };
+
+            const stem = entry.path[0 .. entry.path.len - ".gmi".len];
+            try site.pages.put(arena, try std.fmt.allocPrint(arena, "/{s}.html", .{stem}), page);
+
+            if (std.mem.eql(u8, entry.basename, "index.gmi")) {
+                const directory = stem[0 .. stem.len - "index".len];
+                try site.pages.put(arena, try std.fmt.allocPrint(arena, "/{s}", .{directory}), page);
+            }
+        }
+
+        return site;
+    }
+
+    fn acquire(self: *Site) void {
+        self.refs += 1;
+    }
+
+    fn release(self: *Site) void {
+        self.refs -= 1;
+        if (self.refs == 0) {
+            self.arena.deinit();
+            self.allocator.destroy(self);
+        }
+    }
+};
+
+const Connection = struct {
+    fd: posix.fd_t,
+
+    request: [8192]u8 = undefined,
+    request_len: usize = 0,
+
+    header: [512]u8 = undefined,
+    header_len: usize = 0,
+    body: []const u8 = "",
+    /// Bytes of the pending response already written, header included.
+    written: usize = 0,
+    /// Keeps `body` alive while the response is pending.
+    site: ?*Site = null,
+    close_after_response: bool = false,
+
+    fn pending(self: Connection) bool {
+        return self.written < self.header_len + self.body.len;
+    }
+
+    /// Writes as much of the pending response as the socket takes.
+    /// Returns `false` if the socket would block.
+    fn flush(self: *Connection) !bool {
+        while (self.pending()) {
+            var iovecs: [2]posix.iovec_const = undefined;
+            var count: usize = 0;
+            if (self.written < self.header_len) {
+                iovecs[count] = .{
+                    .iov_base = self.header[self.written..].ptr,
+                    .iov_len = self.header_len - self.written,
+                };
+                count += 1;
+            }
+            const body_offset = self.written -| self.header_len;
+            if (body_offset < self.body.len) {
+                iovecs[count] = .{
+                    .iov_base = self.body[body_offset..].ptr,
+                    .iov_len = self.body.len - body_offset,
+                };
+                count += 1;
+            }
+
+            self.written += posix.writev(self.fd, iovecs[0..count]) catch |err| switch (err) {
+                error.WouldBlock => return false,
+                else => return err,
+            };
+        }
+
+        if (self.site) |site|
+            site.release();
+        self.site = null;
+        return true;
+    }
+};
+
+const Server = struct {
+    allocator: std.mem.Allocator,
+    root: []const u8,
+    site: *Site,
+    epoll: posix.fd_t,
+
+    /// Drives `connection` until its socket would block.
+    /// Returns an error if the connection has to be closed.
+    fn drive(self: *Server, connection: *Connection) !void {
+        while (true) {
+            if (connection.pending() and !try connection.flush())
+                return;
+            if (connection.close_after_response)
+                return error.ConnectionClosed;
+
+            const request = connection.request[0..connection.request_len];
+            if (std.mem.indexOf(u8, request, "\r\n\r\n")) |end| {
+                self.respond(connection, request[0..end]);
+
+                const consumed = end + 4;
+                std.mem.copyForwards(u8, &connection.request, request[consumed..]);
+                connection.request_len -= consumed;
+                continue;
+            }
+
+            if (connection.request_len == connection.request.len) {
+                self.respondStatus(connection, "431 Request Header Fields Too Large");
+                connection.close_after_response = true;
+                continue;
+            }
+
+            const len = posix.read(connection.fd, connection.request[connection.request_len..]) catch |err| switch (err) {
+                error.WouldBlock => return,
+                else => return err,
+            };
+            if (len == 0)
+                return error.ConnectionClosed;
+            connection.request_len += len;
+        }
+    }
+
+    /// Prepares the response to the request with the header `head`.
+    fn respond(self: *Server, connection: *Connection, head: []const u8) void {
+        var lines = std.mem.splitSequence(u8, head, "\r\n");
+
+        var request_line = std.mem.tokenizeScalar(u8, lines.first(), ' ');
+        const method = request_line.next() orelse "";
+        const target = request_line.next() orelse "";
+        const version = request_line.next() orelse "";
+
+        var accepts_gzip = false;
+        var if_none_match: ?[]const u8 = null;
+        connection.close_after_response = !std.mem.eql(u8, version, "HTTP/1.1");
+
+        while (lines.next()) |line| {
+            const colon = std.mem.indexOfScalar(u8, line, ':') orelse continue;
+            const name = line[0..colon];
+            const value = std.mem.trim(u8, line[colon + 1 ..], " \t");
+
+            if (std.ascii.eqlIgnoreCase(name, "accept-encoding")) {
+                accepts_gzip = std.mem.indexOf(u8, value, "gzip") != null;
+            } else if (std.ascii.eqlIgnoreCase(name, "if-none-match")) {
+                if_none_match = value;
+            } else if (std.ascii.eqlIgnoreCase(name, "connection")) {
+                if (std.ascii.eqlIgnoreCase(value, "close"))
+                    connection.close_after_response = true;
+                if (std.ascii.eqlIgnoreCase(value, "keep-alive"))
+                    connection.close_after_response = false;
+            }
+        }
+
+        const is_head = std.mem.eql(u8, method, "HEAD");
+        if (!is_head and !std.mem.eql(u8, method, "GET"))
+            return self.respondStatus(connection, "405 Method Not Allowed");
+
+        const path = target[0 .. std.mem.indexOfScalar(u8, target, '?') orelse target.len];
+        const page = self.site.pages.get(path) orelse
+            return self.respondStatus(connection, "404 Not Found");
+
+        const body = if (accepts_gzip) page.gzip else page.html;
+        const etag = if (accepts_gzip) page.etag_gzip else page.etag;
+
+        if (if_none_match != null and std.mem.eql(u8, if_none_match.?, etag)) {
+            connection.header_len = (std.fmt.bufPrint(&connection.header, "HTTP/1.1 304 Not Modified\r\n" ++
+                "ETag: {s}\r\n" ++
+                "Vary: Accept-Encoding\r\n" ++
+                "\r\n", .{etag}) catch unreachable).len;
+            connection.body = "";
+            connection.written = 0;
+            return;
+        }
+
+        connection.header_len = (std.fmt.bufPrint(&connection.header, "HTTP/1.1 200 OK\r\n" ++
+            "Content-Type: text/html; charset=utf-8\r\n" ++
+            "Content-Length: {d}\r\n" ++
+            "{s}" ++
+            "ETag: {s}\r\n" ++
+            "Vary: Accept-Encoding\r\n" ++
+            "\r\n", .{
+            body.len,
+            if (accepts_gzip) "Content-Encoding: gzip\r\n" else "",
+            etag,
+        }) catch unreachable).len;
+        connection.body = if (is_head) "" else body;
+        connection.written = 0;
+
+        self.site.acquire();
+        connection.site = self.site;
+    }
+
+    fn respondStatus(self: *Server, connection: *Connection, comptime status: []const u8) void {
+        _ = self;
+        const message = status ++ "\n";
+        connection.header_len = (std.fmt.bufPrint(&connection.header, "HTTP/1.1 " ++ status ++ "\r\n" ++
+            "Content-Type: text/plain\r\n" ++
+            "Content-Length: {d}\r\n" ++
+            "\r\n", .{message.len}) catch unreachable).len;
+        connection.body = message;
+        connection.written = 0;
+    }
+
+    fn reload(self: *Server) void {
+        const site = Site.build(self.allocator, self.root) catch |err| {
+            std.log.err("failed to render {s}: {s}", .{ self.root, @errorName(err) });
+            return;
+        };
+        self.site.release();
+        self.site = site;
+        std.log.info("rendered {} pages", .{site.pages.count()});
+    }
+};
+
+/// Tags the epoll events that don't belong to a connection.
+const listener_tag = 0;
+const signal_tag = 1;
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var port: u16 = 8080;
+    var root: ?[]const u8 = null;
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        if (std.mem.eql(u8, args[i], "--port") and i + 1 < args.len) {
+            i += 1;
+            port = try std.fmt.parseInt(u16, args[i], 10);
+        } else {
+            root = args[i];
+        }
+    }
+
+    var server = Server{
+        .allocator = allocator,
+        .root = root orelse return error.MissingRoot,
+        .site = undefined,
+        .epoll = try posix.epoll_create1(linux.EPOLL.CLOEXEC),
+    };
+    defer posix.close(server.epoll);
+
+    server.site = try Site.build(allocator, server.root);
+    defer server.site.release();
+
+    const address = try std.net.Address.parseIp("127.0.0.1", port);
+    const listener = try posix.socket(posix.AF.INET, posix.SOCK.STREAM | posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC, 0);
+    defer posix.close(listener);
+
+    try posix.setsockopt(listener, posix.SOL.SOCKET, posix.SO.REUSEADDR, &std.mem.toBytes(@as(c_int, 1)));
+    try posix.bind(listener, &address.any, address.getOsSockLen());
+    try posix.listen(listener, 1024);
+
+    // A client closing its connection early must not kill the server.
+    try posix.sigaction(posix.SIG.PIPE, &posix.Sigaction{
+        .handler = .{ .handler = posix.SIG.IGN },
+        .mask = posix.empty_sigset,
+        .flags = 0,
+    }, null);
+
+    // SIGHUP is delivered through a signalfd, so reloads happen between requests.
+    var signals = posix.empty_sigset;
+    linux.sigaddset(&signals, posix.SIG.HUP);
+    posix.sigprocmask(posix.SIG.BLOCK, &signals, null);
+    const signal_fd = try posix.signalfd(-1, &signals, linux.SFD.NONBLOCK | linux.SFD.CLOEXEC);
+    defer posix.close(signal_fd);
+
+    var listener_event = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .ptr = listener_tag } };
+    try posix.epoll_ctl(server.epoll, linux.EPOLL.CTL_ADD, listener, &listener_event);
+    var signal_event = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .ptr = signal_tag } };
+    try posix.epoll_ctl(server.epoll, linux.EPOLL.CTL_ADD, signal_fd, &signal_event);
+
+    std.log.info("serving {} pages of {s} on http://{}", .{ server.site.pages.count(), server.root, address });
+
+    var events: [256]linux.epoll_event = undefined;
+    while (true) {
+        const count = posix.epoll_wait(server.epoll, &events, -1);
+        for (events[0..count]) |event| {
+            switch (event.data.ptr) {
+                listener_tag => while (true) {
+                    const fd = posix.accept(listener, null, null, posix.SOCK.NONBLOCK | posix.SOCK.CLOEXEC) catch |err| switch (err) {
+                        error.WouldBlock => break,
+                        else => {
+                            std.log.warn("accept failed: {s}", .{@errorName(err)});
+                            break;
+                        },
+                    };
+
+                    const connection = allocator.create(Connection) catch {
+                        posix.close(fd);
+                        continue;
+                    };
+                    connection.* = Connection{ .fd = fd };
+
+                    // Edge triggered: `drive` always runs until the socket would block.
+                    var connection_event = linux.epoll_event{
+                        .events = linux.EPOLL.IN | linux.EPOLL.OUT | linux.EPOLL.RDHUP | linux.EPOLL.ET,
+                        .data = .{ .ptr = @intFromPtr(connection) },
+                    };
+                    posix.epoll_ctl(server.epoll, linux.EPOLL.CTL_ADD, fd, &connection_event) catch {
+                        posix.close(fd);
+                        allocator.destroy(connection);
+                    };
+                },
+
+                signal_tag => {
+                    var info: linux.signalfd_siginfo = undefined;
+                    while (true) {
+                        _ = posix.read(signal_fd, std.mem.asBytes(&info)) catch break;
+                    }
+                    server.reload();
+                },
+
+                else => {
+                    const connection: *Connection = @ptrFromInt(event.data.ptr);
+                    server.drive(connection) catch {
+                        if (connection.site) |site|
+                            site.release();
+                        posix.close(connection.fd);
+                        allocator.destroy(connection);
+                    };
+                },
+            }
+        }
+    }
+}
@@ -0,0 +1,210 @@
+//! This example implements a pipelined converter for gemini text to HTML, meant
+//! for large inputs. Reading, parsing and rendering run on three threads that are
+//! connected by single-producer/single-consumer rings, so a stage waiting for I/O
+//! doesn't stall the others and the throughput approaches that of the slowest stage:
+//!
+//!     reader --(filled buffers)--> parser --(fragment batches)--> renderer
+//!       ^-------(free buffers)-------'  ^-------(free batches)-------'
+//!
+//! Input buffers and fragment batches are allocated once and recycled through the
+//! rings running in the opposite direction.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+const buffer_size = 64 * 1024;
+const buffer_count = 4;
+const batch_count = 4;
+
+/// A lock-free ring for exactly one producer and one consumer thread. A thread
+/// that finds the ring full or empty spins briefly, then sleeps on a futex.
+fn Ring(comptime T: type, comptime capacity: u32) type {
+    std.debug.assert(std.math.isPowerOfTwo(capacity));
+    return struct {
+        const Self = @This();
+        const spin_limit = 100;
+
+        items: [capacity]T = undefined,
+        /// The number of popped items, only written by the consumer.
+        head: std.atomic.Value(u32) align(std.atomic.cache_line) = std.atomic.Value(u32).init(0),
+        /// The number of pushed items, only written by the producer.
+        tail: std.atomic.Value(u32) align(std.atomic.cache_line) = std.atomic.Value(u32).init(0),
+
+        fn push(self: *Self, item: T) void {
+            const tail = self.tail.load(.monotonic);
+            var spins: usize = 0;
+            while (true) : (spins += 1) {
+                const head = self.head.load(.acquire);
+                if (tail -% head < capacity)
+                    break;
+                if (spins < spin_limit)
+                    std.atomic.spinLoopHint()
+                else
+                    std.Thread.Futex.wait(&self.head, head);
+            }
+            self.items[tail % capacity] = item;
+            self.tail.store(tail +% 1, .release);
+            std.Thread.Futex.wake(&self.tail, 1);
+        }
+
+        fn pop(self: *Self) T {
+            const head = self.head.load(.monotonic);
+            var spins: usize = 0;
+            while (self.tail.load(.acquire) == head) : (spins += 1) {
+                if (spins < spin_limit)
+                    std.atomic.spinLoopHint()
+                else
+                    std.Thread.Futex.wait(&self.tail, head);
+            }
+            const item = self.items[head % capacity];
+            self.head.store(head +% 1, .release);
+            std.Thread.Futex.wake(&self.head, 1);
+            return item;
+        }
+    };
+}
+
+/// A chunk of input. An empty buffer marks the end of the input.
+const Buffer = struct {
+    bytes: *[buffer_size]u8,
+    len: usize = 0,
+};
+
+/// The fragments parsed from one buffer, allocated in the arena of the batch.
+const Batch = struct {
+    arena: std.heap.ArenaAllocator,
+    fragments: std.ArrayListUnmanaged(gemtext.Fragment) = .{},
+    last: bool = false,
+};
+
+/// A stage that fails keeps passing buffers and batches on until the end of
+/// the input, so the other stages never block on it.
+const Pipeline = struct {
+    filled_buffers: Ring(Buffer, buffer_count) = .{},
+    free_buffers: Ring(Buffer, buffer_count) = .{},
+    filled_batches: Ring(*Batch, batch_count) = .{},
+    free_batches: Ring(*Batch, batch_count) = .{},
+
+    read_error: ?anyerror = null,
+    parse_error: ?anyerror = null,
+    write_error: ?anyerror = null,
+};
+
+fn readStage(pipeline: *Pipeline, input: std.fs.File) void {
+    while (true) {
+        var buffer = pipeline.free_buffers.pop();
+        buffer.len = input.read(buffer.bytes) catch |err| blk: {
+            pipeline.read_error = err;
+            break :blk 0;
+        };
+        pipeline.filled_buffers.push(buffer);
+        if (buffer.len == 0)
+            break;
+    }
+}
+
+fn parseStage(pipeline: *Pipeline, allocator: std.mem.Allocator) void {
+    var parser = gemtext.Parser.init(allocator);
+    defer parser.deinit();
+
+    var failed = false;
+    while (true) {
+        const buffer = pipeline.filled_buffers.pop();
+        const batch = pipeline.free_batches.pop();
+        if (!failed) {
+            parseBuffer(&parser, batch, buffer.bytes[0..buffer.len]) catch |err| {
+                pipeline.parse_error = err;
+                failed = true;
+            };
+        }
+        batch.last = (buffer.len == 0);
+        pipeline.free_buffers.push(buffer);
+        pipeline.filled_batches.push(batch);
+        if (batch.last)
+            break;
+    }
+}
+
+fn parseBuffer(parser: *gemtext.Parser, batch: *Batch, bytes: []const u8) !void {
+    const allocator = batch.arena.allocator();
+    if (bytes.len == 0) {
+        if (try parser.finalize(allocator)) |fragment|
+            try batch.fragments.append(allocator, fragment);
+        return;
+    }
+
+    var offset: usize = 0;
+    while (offset < bytes.len) {
+        const result = try parser.feed(allocator, bytes[offset..]);
+        if (result.fragment) |fragment|
+            try batch.fragments.append(allocator, fragment);
+        offset += result.consumed;
+    }
+}
+
+fn renderStage(pipeline: *Pipeline, output: std.fs.File) void {
+    var buffered = std.io.BufferedWriter(buffer_size, std.fs.File.Writer){ .unbuffered_writer = output.writer() };
+
+    var failed = false;
+    while (true) {
+        const batch = pipeline.filled_batches.pop();
+        const last = batch.last;
+        if (!failed) {
+            renderBatch(batch, &buffered) catch |err| {
+                pipeline.write_error = err;
+                failed = true;
+            };
+        }
+        batch.fragments = .{};
+        _ = batch.arena.reset(.retain_capacity);
+        pipeline.free_batches.push(batch);
+        if (last)
+            break;
+    }
+}
+
+fn renderBatch(batch: *Batch, buffered: anytype) !void {
+    try gemtext.renderer.html(batch.fragments.items, buffered.writer());
+    try buffered.flush();
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    var pipeline = Pipeline{};
+
+    const buffers = try allocator.alloc([buffer_size]u8, buffer_count);
+    defer allocator.free(buffers);
+    for (buffers) |*bytes| {
+        pipeline.free_buffers.push(Buffer{ .bytes = bytes });
+    }
+
+    var batches: [batch_count]Batch = undefined;
+    for (&batches) |*batch| {
+        batch.* = Batch{ .arena = std.heap.ArenaAllocator.init(allocator) };
+        pipeline.free_batches.push(batch);
+    }
+    defer {
+        for (&batches) |*batch| {
+            batch.arena.deinit();
+        }
+    }
+
+    const reader = try std.Thread.spawn(.{}, readStage, .{ &pipeline, std.io.getStdIn() });
+    const parser = try std.Thread.spawn(.{}, parseStage, .{ &pipeline, allocator });
+
+    renderStage(&pipeline, std.io.getStdOut());
+
+    reader.join();
+    parser.join();
+
+    if (pipeline.read_error) |err|
+        return err;
+    if (pipeline.parse_error) |err|
+        return err;
+    if (pipeline.write_error) |err|
+        return err;
+}
@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <exception>
+#include <string_view>
+#include "gemtext.hpp"
+
+static void renderToStream(std::string_view bytes)
+{
+  std::fwrite(bytes.data(), 1, bytes.size(), stdout);
+}
+
+static void renderFragment(gemtext::Fragment const &fragment)
+{
+  gemtext::render(GEMTEXT_RENDER_HTML, {&fragment.raw(), 1}, renderToStream);
+}
+
+int main()
+{
+  try
+  {
+    gemtext::Parser parser;
+
+    char buffer[16384];
+    while (true)
+    {
+      std::size_t length = std::fread(buffer, 1, sizeof buffer, stdin);
+      if (length == 0)
+        break;
+
+      std::string_view input(buffer, length);
+      while (!input.empty())
+      {
+        auto result = parser.feed(input);
+        if (result.fragment)
+          renderFragment(*result.fragment);
+        input.remove_prefix(result.consumed);
+      }
+    }
+
+    if (auto fragment = parser.finalize())
+      renderFragment(*fragment);
+  }
+  catch (std::exception const &err)
+  {
+    std::fprintf(stderr, "%s\n", err.what());
+    return 1;
+  }
+  return 0;
+}
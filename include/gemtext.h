@@ -2,9 +2,15 @@
 #define GEMTEXT_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdalign.h>
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 enum gemtext_error
 {
   /// The operation was successful.
@@ -20,6 +26,32 @@ enum gemtext_error
 
   /// The operation failed as a given index was out of bounds.
   GEMTEXT_ERR_OUT_OF_BOUNDS = -2,
+
+  /// The operation failed as the given parser snapshot is corrupt or
+  /// was written by an incompatible version.
+  /// Only returned by `gemtextParserRestore`.
+  GEMTEXT_ERR_INVALID_SNAPSHOT = -3,
+
+  /// The operation failed as the requested feature is not supported by
+  /// this build of the library or by the CPU.
+  GEMTEXT_ERR_UNSUPPORTED = -4,
+
+  /// The parser found a line longer than `max_line_length`.
+  GEMTEXT_ERR_LINE_TOO_LONG = -5,
+
+  /// The parser found a block with more than `max_block_lines` lines or
+  /// `max_block_bytes` bytes.
+  GEMTEXT_ERR_BLOCK_TOO_LARGE = -6,
+
+  /// The document has more than `max_fragments` fragments.
+  GEMTEXT_ERR_TOO_MANY_FRAGMENTS = -7,
+
+  /// The document is longer than `max_total_bytes`.
+  GEMTEXT_ERR_DOCUMENT_TOO_LARGE = -8,
+
+  /// The operation failed as the system could not start a thread.
+  /// Only returned by `gemtextRenderPoolCreate`.
+  GEMTEXT_ERR_SYSTEM_RESOURCES = -9,
 };
 
 enum gemtext_fragment_type
@@ -48,6 +80,46 @@ enum gemtext_renderer
   GEMTEXT_RENDER_RTF = 3,
 };
 
+enum gemtext_compression
+{
+  /// A gzip stream (RFC 1952), for `.gz` files and `Content-Encoding: gzip`.
+  GEMTEXT_COMPRESSION_GZIP = 0,
+
+  /// A zlib stream (RFC 1950), for `Content-Encoding: deflate`.
+  GEMTEXT_COMPRESSION_ZLIB = 1,
+
+  /// A raw deflate stream (RFC 1951).
+  GEMTEXT_COMPRESSION_DEFLATE = 2,
+};
+
+enum gemtext_link_scheme
+{
+  /// A link without a scheme, relative to the document.
+  GEMTEXT_LINK_RELATIVE = 0,
+  GEMTEXT_LINK_GEMINI = 1,
+  GEMTEXT_LINK_HTTPS = 2,
+  GEMTEXT_LINK_HTTP = 3,
+  GEMTEXT_LINK_GOPHER = 4,
+  GEMTEXT_LINK_MAILTO = 5,
+  /// Any other scheme.
+  GEMTEXT_LINK_OTHER = 6,
+};
+
+enum gemtext_cpu_tier
+{
+  /// Kernels compiled for the target CPU of the library build.
+  GEMTEXT_CPU_TIER_GENERIC = 0,
+
+  /// x86-64 kernels using SSE2.
+  GEMTEXT_CPU_TIER_SSE2 = 1,
+
+  /// x86-64 kernels using AVX2 (x86-64-v3).
+  GEMTEXT_CPU_TIER_AVX2 = 2,
+
+  /// x86-64 kernels using AVX-512 (x86-64-v4).
+  GEMTEXT_CPU_TIER_AVX512 = 3,
+};
+
 enum gemtext_heading_level
 {
   GEMTEXT_HEADING_H1 = 1,
@@ -93,21 +165,116 @@ struct gemtext_fragment
   };
 };
 
+/// Custom memory allocation callbacks.
+/// `alloc` returns `size` bytes aligned to `alignment` or NULL if out of memory,
+/// `free` releases memory returned by `alloc` and is called with the same `size`
+/// and `alignment`. `context` is passed verbatim to both.
+/// The library never asks for zero bytes and never resizes allocations in place.
+struct gemtext_allocator
+{
+  void *context;
+  void *(*alloc)(void *context, size_t size, size_t alignment);
+  void (*free)(void *context, void *memory, size_t size, size_t alignment);
+};
+
 struct gemtext_document
 {
   size_t fragment_count;
   struct gemtext_fragment const *fragments;
+  /// The allocator of the document, or NULL for the default allocator.
+  struct gemtext_allocator const *allocator;
 };
 
 struct gemtext_parser
 {
   // KEEP THIS IN SYNC WITH THE ASSERT IN src/gemtext.zig:Parser!
-  alignas(16) char opaque[128];
+  alignas(16) char opaque[256];
+};
+
+/// Resource limits for a parser. A value of 0 means unbounded.
+/// Exceeding a limit makes `gemtextParserFeed` or `gemtextParserFinalize`
+/// fail with the corresponding `GEMTEXT_ERR_*` code instead of running out of memory.
+struct gemtext_parser_limits
+{
+  /// The maximum number of bytes in a single line, excluding the line feed.
+  size_t max_line_length;
+  /// The maximum number of lines in a list, quote or preformatted block.
+  size_t max_block_lines;
+  /// The maximum number of text bytes in a single block.
+  size_t max_block_bytes;
+  /// The maximum number of fragments in a document.
+  size_t max_fragments;
+  /// The maximum number of bytes in a document.
+  size_t max_total_bytes;
+};
+
+/// A thread-safe cache of rendered documents with a fixed byte budget.
+/// Created with `gemtextRenderCacheCreate`, destroyed with `gemtextRenderCacheDestroy`.
+struct gemtext_render_cache;
+
+struct gemtext_render_cache_stats
+{
+  /// Number of lookups that found a rendered page.
+  uint64_t hits;
+  /// Number of lookups that had to render the page.
+  uint64_t misses;
+  /// Number of lookups that waited for a concurrent render of the same page.
+  uint64_t coalesced;
+  /// Number of pages dropped to stay within the byte budget.
+  uint64_t evictions;
+  /// Number of pages currently in the cache.
+  size_t pages;
+  /// Number of rendered bytes currently in the cache.
+  size_t bytes;
+};
+
+/// Statistics of a document, see `gemtextStatisticsCollect`.
+struct gemtext_statistics
+{
+  /// The number of fragments the parser produces, indexed by `enum gemtext_fragment_type`.
+  size_t fragments[7];
+  /// The number of links, indexed by the `enum gemtext_link_scheme` of their target.
+  size_t links[7];
+  /// The number of lines, including a last line without a line feed.
+  size_t lines;
+  /// The size of the document.
+  size_t bytes;
+  /// The number of words in headings, paragraphs, lists, quotes and link titles.
+  size_t words;
+  /// The number of bytes in the longest line, excluding the line ending.
+  size_t longest_line;
+  /// The number of lines inside preformatted blocks, excluding the fences.
+  size_t preformatted_lines;
+  /// The number of bytes of the lines inside preformatted blocks.
+  size_t preformatted_bytes;
+};
+
+/// A pool of worker threads that renders documents submitted with `gemtextRenderAsync`.
+/// Created with `gemtextRenderPoolCreate`, destroyed with `gemtextRenderPoolDestroy`.
+struct gemtext_render_pool;
+
+struct gemtext_render_pool_options
+{
+  /// The number of worker threads, or 0 for one per CPU.
+  size_t thread_count;
+  /// If non-zero, worker `i` is pinned to CPU `i` modulo the CPU count.
+  /// Only supported on Linux, ignored elsewhere.
+  int pin_threads;
+  /// Documents with more fragments than this are split into ranges that are
+  /// rendered by several workers at once. 0 disables splitting.
+  size_t split_fragments;
 };
 
 /// Initializes the `document`.
 enum gemtext_error gemtextDocumentCreate(struct gemtext_document *document);
 
+/// Initializes the `document` to allocate all memory with `allocator`,
+/// which must stay valid until the document is destroyed.
+/// If `allocator` is NULL, the default allocator is used.
+enum gemtext_error gemtextDocumentCreateWithAllocator(
+    struct gemtext_document *document,
+    struct gemtext_allocator const *allocator);
+
 /// Inserts a `fragment` at `index` in `document`.
 enum gemtext_error gemtextDocumentInsert(struct gemtext_document *document, size_t index, struct gemtext_fragment const *fragment);
 
@@ -123,9 +290,21 @@ void gemtextDocumentDestroy(struct gemtext_document *document);
 /// Initializes `parser`.
 enum gemtext_error gemtextParserCreate(struct gemtext_parser *parser);
 
+/// Initializes `parser` to allocate its buffers and all returned fragments
+/// with `allocator`, which must stay valid until the parser is destroyed.
+/// If `allocator` is NULL, the default allocator is used.
+enum gemtext_error gemtextParserCreateWithAllocator(
+    struct gemtext_parser *parser,
+    struct gemtext_allocator const *allocator);
+
 /// Destroys `parser` and all contained resources.
 void gemtextParserDestroy(struct gemtext_parser *parser);
 
+/// Sets the resource `limits` of `parser`.
+void gemtextParserSetLimits(
+    struct gemtext_parser *parser,
+    struct gemtext_parser_limits const *limits);
+
 /// Feeds a sequence of `bytes` into the parser and returns
 /// the number of `consumed_bytes` to the caller. This sequence is `total_bytes` long.
 /// If a `fragment` was parsed, returns `GEMTEXT_SUCCESS_FRAGMENT`
@@ -155,10 +334,29 @@ void gemtextParserDestroyFragment(
     struct gemtext_parser *parser,
     struct gemtext_fragment *fragment);
 
+/// Serializes the complete state of `parser` and passes it to `write`
+/// in one or more chunks, together with the `context` parameter.
+/// The snapshot can be loaded with `gemtextParserRestore` later, possibly in
+/// another process, to continue parsing without re-feeding earlier input.
+enum gemtext_error gemtextParserSnapshot(
+    struct gemtext_parser *parser,
+    void *context,
+    void (*write)(void *context, char const *bytes, size_t length));
+
+/// Replaces the state of `parser` with a snapshot of `length` bytes
+/// previously written by `gemtextParserSnapshot`.
+/// `parser` must have been created with `gemtextParserCreate`.
+/// On failure, the parser is reset to its initial state.
+enum gemtext_error gemtextParserRestore(
+    struct gemtext_parser *parser,
+    char const *bytes,
+    size_t length);
+
 /// Renders a sequence of `fragments` with the selected `renderer`.
 /// Every time text is emitted, `render` is called with
 /// both the `context` parameter passed verbatim into the callback
 /// as well as a sequence of `bytes` with the given `length`.
+/// The output is buffered, so `render` is called with chunks of up to 4 KiB.
 enum gemtext_error gemtextRender(
     enum gemtext_renderer renderer,
     struct gemtext_fragment const *fragments,
@@ -166,6 +364,67 @@ enum gemtext_error gemtextRender(
     void *context,
     void (*render)(void *context, char const *bytes, size_t length));
 
+/// Renders a sequence of `fragments` with the selected `renderer` like `gemtextRender`,
+/// but compresses the output with `compression` in the same pass, so the rendered
+/// document is never held in memory as a whole.
+/// `level` ranges from 1 (fastest) to 9 (smallest), where levels below 4 are the
+/// same as 4; 0 selects the default level 6.
+/// Returns `GEMTEXT_ERR_UNSUPPORTED` for an unknown `compression` or `level`.
+enum gemtext_error gemtextRenderCompressed(
+    enum gemtext_renderer renderer,
+    enum gemtext_compression compression,
+    int level,
+    struct gemtext_fragment const *fragments,
+    size_t fragment_count,
+    void *context,
+    void (*render)(void *context, char const *bytes, size_t length));
+
+/// Creates a pool of worker threads for `gemtextRenderAsync` and stores it in `pool`.
+/// If `options` is NULL, one worker per CPU is started and documents are not split.
+enum gemtext_error gemtextRenderPoolCreate(
+    struct gemtext_render_pool **pool,
+    struct gemtext_render_pool_options const *options);
+
+/// Waits for all submitted renders to complete, then destroys `pool`.
+/// Must not be called from a callback of a render on `pool`.
+void gemtextRenderPoolDestroy(struct gemtext_render_pool *pool);
+
+/// Renders a sequence of `fragments` with the selected `renderer` on a worker of `pool`
+/// and returns immediately.
+/// The output is passed to `render` together with `context` like in `gemtextRender`,
+/// then `on_done` is called once with `context` and the result of the render.
+/// Both callbacks are called from a worker thread, and `on_done` is always the
+/// last call for this render. `fragments` must stay valid until `on_done` is called.
+/// If this function returns an error, no callback is called.
+/// This function may be called from several threads at once.
+enum gemtext_error gemtextRenderAsync(
+    struct gemtext_render_pool *pool,
+    enum gemtext_renderer renderer,
+    struct gemtext_fragment const *fragments,
+    size_t fragment_count,
+    void *context,
+    void (*render)(void *context, char const *bytes, size_t length),
+    void (*on_done)(void *context, enum gemtext_error result));
+
+/// Collects the `statistics` of the document `text` with `length` bytes in a
+/// single pass, without parsing it into fragments or allocating.
+void gemtextStatisticsCollect(
+    struct gemtext_statistics *statistics,
+    char const *text,
+    size_t length);
+
+/// Returns the instruction set tier of the scanning kernels used by the library.
+/// The best tier supported by the CPU is selected on first use, unless the
+/// environment variable `GEMTEXT_CPU_TIER` is set to `generic`, `sse2`, `avx2`
+/// or `avx512`.
+enum gemtext_cpu_tier gemtextGetCpuTier(void);
+
+/// Forces the scanning kernels to `tier`, for example to benchmark each tier.
+/// Returns `GEMTEXT_ERR_UNSUPPORTED` if the tier is not available in this build
+/// or on this CPU.
+/// Must not be called while other threads parse or render.
+enum gemtext_error gemtextSetCpuTier(enum gemtext_cpu_tier tier);
+
 /// Parses a string into a `gemtext_document` and will return that `document`
 /// on success.
 enum gemtext_error gemtextDocumentParseString(
@@ -179,4 +438,72 @@ enum gemtext_error gemtextDocumentParseFile(
     struct gemtext_document *document,
     FILE *file);
 
+/// Same as `gemtextDocumentParseString`, but parses with and creates the
+/// `document` with `allocator`, see `gemtextDocumentCreateWithAllocator`.
+enum gemtext_error gemtextDocumentParseStringWithAllocator(
+    struct gemtext_document *document,
+    struct gemtext_allocator const *allocator,
+    char const *text,
+    size_t length);
+
+/// Same as `gemtextDocumentParseFile`, but parses with and creates the
+/// `document` with `allocator`, see `gemtextDocumentCreateWithAllocator`.
+enum gemtext_error gemtextDocumentParseFileWithAllocator(
+    struct gemtext_document *document,
+    struct gemtext_allocator const *allocator,
+    FILE *file);
+
+/// Creates a new render cache that holds at most `byte_budget` rendered bytes
+/// and stores it in `cache`.
+enum gemtext_error gemtextRenderCacheCreate(
+    struct gemtext_render_cache **cache,
+    size_t byte_budget);
+
+/// Destroys `cache` and all cached pages.
+void gemtextRenderCacheDestroy(struct gemtext_render_cache *cache);
+
+/// Renders the document identified by `source` and `version` with `renderer`,
+/// using the cached page if there is one.
+/// `version` identifies the revision of `source`, for example a hash of its
+/// modification time and size, or of its content.
+/// On a miss, `load` is called with `load_context` to parse the document into
+/// `document`, which is destroyed by the cache afterwards. If `load` returns an
+/// error, the error is returned verbatim. Concurrent misses on the same page call
+/// `load` only once.
+/// The rendered page is then passed to `render` together with `context`.
+/// This function may be called from several threads at once.
+enum gemtext_error gemtextRenderCacheRender(
+    struct gemtext_render_cache *cache,
+    enum gemtext_renderer renderer,
+    char const *source,
+    uint64_t version,
+    void *load_context,
+    enum gemtext_error (*load)(void *load_context, struct gemtext_document *document),
+    void *context,
+    void (*render)(void *context, char const *bytes, size_t length));
+
+/// Drops all cached pages of `source` from `cache`.
+void gemtextRenderCacheInvalidate(
+    struct gemtext_render_cache *cache,
+    char const *source);
+
+/// Stores the current hit, miss and size metrics of `cache` in `stats`.
+void gemtextRenderCacheGetStats(
+    struct gemtext_render_cache *cache,
+    struct gemtext_render_cache_stats *stats);
+
+/// Writes the library metrics in the Prometheus text exposition format to `render`,
+/// which may be called several times with `context`.
+/// The metrics cover bytes and fragments parsed by all parsers, parse times of
+/// `gemtextDocumentParseString` and `gemtextDocumentParseFile`, bytes and times of
+/// all renders, render cache lookups, and allocations through the default allocator.
+/// This function may be called from several threads at once.
+enum gemtext_error gemtextMetricsWrite(
+    void *context,
+    void (*render)(void *context, char const *bytes, size_t length));
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // GEMTEXT_H
@@ -0,0 +1,1072 @@
+#ifndef GEMTEXT_HPP
+#define GEMTEXT_HPP
+
+//! C++20 bindings for the gemtext C API.
+//!
+//! All types are thin wrappers around the C structures. Accessors return
+//! `std::string_view` and `std::span` into the memory owned by the C library,
+//! so no text is copied beyond what the C API does itself.
+//! Errors are reported by throwing `gemtext::error`.
+
+#include "gemtext.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <ranges>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace gemtext
+{
+  /// Thrown when a function of the C API fails.
+  class error : public std::exception
+  {
+  public:
+    explicit error(gemtext_error code) noexcept : code_(code) {}
+
+    /// The error code returned by the C API.
+    gemtext_error code() const noexcept { return code_; }
+
+    char const *what() const noexcept override
+    {
+      switch (code_)
+      {
+      case GEMTEXT_ERR_OUT_OF_MEMORY:
+        return "gemtext: out of memory";
+      case GEMTEXT_ERR_OUT_OF_BOUNDS:
+        return "gemtext: index out of bounds";
+      case GEMTEXT_ERR_INVALID_SNAPSHOT:
+        return "gemtext: invalid parser snapshot";
+      case GEMTEXT_ERR_UNSUPPORTED:
+        return "gemtext: unsupported";
+      case GEMTEXT_ERR_LINE_TOO_LONG:
+        return "gemtext: line too long";
+      case GEMTEXT_ERR_BLOCK_TOO_LARGE:
+        return "gemtext: block too large";
+      case GEMTEXT_ERR_TOO_MANY_FRAGMENTS:
+        return "gemtext: too many fragments";
+      case GEMTEXT_ERR_DOCUMENT_TOO_LARGE:
+        return "gemtext: document too large";
+      case GEMTEXT_ERR_SYSTEM_RESOURCES:
+        return "gemtext: insufficient system resources";
+      default:
+        return "gemtext: unknown error";
+      }
+    }
+
+  private:
+    gemtext_error code_;
+  };
+
+  namespace detail
+  {
+    inline gemtext_error check(gemtext_error err)
+    {
+      if (err < 0)
+        throw error(err);
+      return err;
+    }
+
+    inline std::optional<std::string_view> optional_text(char const *text) noexcept
+    {
+      if (text == nullptr)
+        return std::nullopt;
+      return std::string_view(text);
+    }
+
+    /// Adapts a callable taking a `std::string_view` to the render callback of the C API.
+    template <class Sink>
+    void sink_callback(void *context, char const *bytes, std::size_t length)
+    {
+      (*static_cast<Sink *>(context))(std::string_view(bytes, length));
+    }
+
+    template <class Sink>
+    void *sink_context(Sink &sink) noexcept
+    {
+      return const_cast<void *>(static_cast<void const *>(std::addressof(sink)));
+    }
+
+    inline void *resource_alloc(void *context, std::size_t size, std::size_t alignment) noexcept
+    {
+      try
+      {
+        return static_cast<std::pmr::memory_resource *>(context)->allocate(size, alignment);
+      }
+      catch (...)
+      {
+        return nullptr;
+      }
+    }
+
+    inline void resource_free(void *context, void *memory, std::size_t size, std::size_t alignment) noexcept
+    {
+      static_cast<std::pmr::memory_resource *>(context)->deallocate(memory, size, alignment);
+    }
+
+    /// Returns allocator callbacks that forward to `resource`.
+    inline gemtext_allocator resource_allocator(std::pmr::memory_resource *resource) noexcept
+    {
+      return gemtext_allocator{resource, &resource_alloc, &resource_free};
+    }
+
+    /// Allocates a `T` from `resource`, or with `new` if `resource` is null.
+    template <class T, class... Args>
+    T *create(std::pmr::memory_resource *resource, Args &&...args)
+    {
+      if (resource == nullptr)
+        return new T(std::forward<Args>(args)...);
+      void *memory = resource->allocate(sizeof(T), alignof(T));
+      try
+      {
+        return ::new (memory) T(std::forward<Args>(args)...);
+      }
+      catch (...)
+      {
+        resource->deallocate(memory, sizeof(T), alignof(T));
+        throw;
+      }
+    }
+
+    template <class T>
+    void destroy(std::pmr::memory_resource *resource, T *object) noexcept
+    {
+      if (resource == nullptr)
+      {
+        delete object;
+        return;
+      }
+      object->~T();
+      resource->deallocate(object, sizeof(T), alignof(T));
+    }
+  } // namespace detail
+
+  /// A non-owning view of the lines of a preformatted block, a quote or a list.
+  class text_lines
+  {
+  public:
+    class iterator
+    {
+    public:
+      using value_type = std::string_view;
+      using difference_type = std::ptrdiff_t;
+
+      iterator() = default;
+      explicit iterator(char const *const *pos) noexcept : pos_(pos) {}
+
+      std::string_view operator*() const { return *pos_; }
+
+      iterator &operator++() noexcept
+      {
+        ++pos_;
+        return *this;
+      }
+
+      iterator operator++(int) noexcept
+      {
+        iterator copy = *this;
+        ++pos_;
+        return copy;
+      }
+
+      bool operator==(iterator const &) const = default;
+
+    private:
+      char const *const *pos_ = nullptr;
+    };
+
+    text_lines() = default;
+    explicit text_lines(gemtext_lines const &raw) noexcept : raw_(raw.lines, raw.count) {}
+
+    iterator begin() const noexcept { return iterator(raw_.data()); }
+    iterator end() const noexcept { return iterator(raw_.data() + raw_.size()); }
+
+    std::size_t size() const noexcept { return raw_.size(); }
+    bool empty() const noexcept { return raw_.empty(); }
+
+    std::string_view operator[](std::size_t index) const { return raw_[index]; }
+
+    /// The underlying NUL-terminated lines.
+    std::span<char const *const> raw() const noexcept { return raw_; }
+
+  private:
+    std::span<char const *const> raw_;
+  };
+
+  struct empty
+  {
+  };
+
+  struct paragraph
+  {
+    std::string_view text;
+  };
+
+  struct preformatted
+  {
+    std::optional<std::string_view> alt_text;
+    text_lines lines;
+  };
+
+  struct quote
+  {
+    text_lines lines;
+  };
+
+  struct link
+  {
+    std::string_view href;
+    std::optional<std::string_view> title;
+  };
+
+  struct list
+  {
+    text_lines lines;
+  };
+
+  struct heading
+  {
+    gemtext_heading_level level;
+    std::string_view text;
+  };
+
+  /// A typed, non-owning view of a fragment. The alternatives are in the
+  /// order of `gemtext_fragment_type`.
+  using fragment_view = std::variant<empty, paragraph, preformatted, quote, link, list, heading>;
+
+  /// Helper to build a visitor from a set of lambdas.
+  template <class... Ts>
+  struct overloaded : Ts...
+  {
+    using Ts::operator()...;
+  };
+  template <class... Ts>
+  overloaded(Ts...) -> overloaded<Ts...>;
+
+  /// Returns a typed view of `fragment`, pointing into the memory of `fragment`.
+  inline fragment_view view(gemtext_fragment const &fragment)
+  {
+    switch (fragment.type)
+    {
+    case GEMTEXT_FRAGMENT_PARAGRAPH:
+      return paragraph{fragment.paragraph};
+    case GEMTEXT_FRAGMENT_PREFORMATTED:
+      return preformatted{
+          detail::optional_text(fragment.preformatted.alt_text),
+          text_lines(fragment.preformatted.lines),
+      };
+    case GEMTEXT_FRAGMENT_QUOTE:
+      return quote{text_lines(fragment.quote)};
+    case GEMTEXT_FRAGMENT_LINK:
+      return link{fragment.link.href, detail::optional_text(fragment.link.title)};
+    case GEMTEXT_FRAGMENT_LIST:
+      return list{text_lines(fragment.list)};
+    case GEMTEXT_FRAGMENT_HEADING:
+      return heading{fragment.heading.level, fragment.heading.text};
+    case GEMTEXT_FRAGMENT_EMPTY:
+    default:
+      return empty{};
+    }
+  }
+
+  /// Calls `visitor` with the typed view of `fragment`.
+  template <class Visitor>
+  decltype(auto) visit(gemtext_fragment const &fragment, Visitor &&visitor)
+  {
+    return std::visit(std::forward<Visitor>(visitor), view(fragment));
+  }
+
+  /// Renders `fragments` with `renderer` and passes the output in chunks to `sink`,
+  /// which is called with a `std::string_view`. `sink` must not throw.
+  template <class Sink>
+    requires std::invocable<Sink &, std::string_view>
+  void render(gemtext_renderer renderer, std::span<gemtext_fragment const> fragments, Sink &&sink)
+  {
+    using SinkType = std::remove_reference_t<Sink>;
+    if constexpr (std::is_function_v<SinkType>)
+    {
+      // Functions can't be passed as `void *`, but pointers to them can.
+      SinkType *function = &sink;
+      render(renderer, fragments, function);
+    }
+    else
+    {
+      detail::check(gemtextRender(
+          renderer,
+          fragments.data(),
+          fragments.size(),
+          detail::sink_context(sink),
+          &detail::sink_callback<SinkType>));
+    }
+  }
+
+  namespace detail
+  {
+    struct streambuf_sink
+    {
+      std::streambuf *buffer;
+      bool failed = false;
+
+      void operator()(std::string_view bytes) noexcept
+      {
+        if (failed)
+          return;
+        auto const length = static_cast<std::streamsize>(bytes.size());
+        try
+        {
+          failed = (buffer->sputn(bytes.data(), length) != length);
+        }
+        catch (...)
+        {
+          failed = true;
+        }
+      }
+    };
+  } // namespace detail
+
+  /// Renders `fragments` with `renderer` directly into the put area of `buffer`.
+  /// Returns `false` if `buffer` didn't accept all of the output.
+  inline bool render(gemtext_renderer renderer, std::span<gemtext_fragment const> fragments, std::streambuf &buffer)
+  {
+    detail::streambuf_sink sink{&buffer};
+    render(renderer, fragments, sink);
+    return !sink.failed;
+  }
+
+  /// Renders `fragments` with `renderer` into `stream`. Sets `badbit` if not all
+  /// of the output could be written.
+  inline std::ostream &render(gemtext_renderer renderer, std::span<gemtext_fragment const> fragments, std::ostream &stream)
+  {
+    std::ostream::sentry sentry(stream);
+    if (sentry && !render(renderer, fragments, *stream.rdbuf()))
+      stream.setstate(std::ios_base::badbit);
+    return stream;
+  }
+
+  /// A fragment returned by a `Parser`. Frees its memory on destruction.
+  /// Must not outlive the parser that returned it.
+  class Fragment
+  {
+  public:
+    Fragment(Fragment const &) = delete;
+    Fragment &operator=(Fragment const &) = delete;
+
+    Fragment(Fragment &&other) noexcept
+        : parser_(std::exchange(other.parser_, nullptr)), raw_(other.raw_)
+    {
+    }
+
+    Fragment &operator=(Fragment &&other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        parser_ = std::exchange(other.parser_, nullptr);
+        raw_ = other.raw_;
+      }
+      return *this;
+    }
+
+    ~Fragment() { reset(); }
+
+    gemtext_fragment_type type() const noexcept { return raw_.type; }
+
+    /// Returns a typed view of the fragment, valid as long as the fragment lives.
+    fragment_view view() const { return gemtext::view(raw_); }
+
+    template <class Visitor>
+    decltype(auto) visit(Visitor &&visitor) const
+    {
+      return gemtext::visit(raw_, std::forward<Visitor>(visitor));
+    }
+
+    gemtext_fragment const &raw() const noexcept { return raw_; }
+
+  private:
+    friend class Parser;
+
+    Fragment(gemtext_parser *parser, gemtext_fragment const &raw) noexcept
+        : parser_(parser), raw_(raw)
+    {
+    }
+
+    void reset() noexcept
+    {
+      if (parser_ != nullptr)
+        gemtextParserDestroyFragment(parser_, &raw_);
+      parser_ = nullptr;
+    }
+
+    gemtext_parser *parser_;
+    gemtext_fragment raw_;
+  };
+
+  /// A streaming parser.
+  class Parser
+  {
+  public:
+    struct feed_result
+    {
+      /// The number of bytes consumed from the input.
+      std::size_t consumed;
+      /// The parsed fragment, if any.
+      std::optional<Fragment> fragment;
+    };
+
+    /// Creates a parser. If `resource` is given, the parser, its buffers and all
+    /// returned fragments are allocated from it, and it must outlive the parser.
+    explicit Parser(std::pmr::memory_resource *resource = nullptr)
+    {
+      storage *parser = detail::create<storage>(resource);
+      parser->resource = resource;
+      if (resource != nullptr)
+        parser->allocator = detail::resource_allocator(resource);
+
+      auto const err = gemtextParserCreateWithAllocator(&parser->parser, resource ? &parser->allocator : nullptr);
+      if (err < 0)
+      {
+        detail::destroy(resource, parser);
+        throw error(err);
+      }
+      parser_.reset(parser);
+    }
+
+    Parser(Parser const &) = delete;
+    Parser &operator=(Parser const &) = delete;
+    Parser(Parser &&) noexcept = default;
+    Parser &operator=(Parser &&) noexcept = default;
+    ~Parser() = default;
+
+    /// Feeds `bytes` into the parser. If a fragment is returned and not all bytes
+    /// were consumed, the rest of the bytes must be fed again.
+    feed_result feed(std::string_view bytes)
+    {
+      gemtext_fragment fragment;
+      std::size_t consumed = 0;
+      auto const result = detail::check(gemtextParserFeed(
+          raw(),
+          &fragment,
+          &consumed,
+          bytes.size(),
+          bytes.data()));
+      if (result == GEMTEXT_SUCCESS_FRAGMENT)
+        return {consumed, Fragment(raw(), fragment)};
+      return {consumed, std::nullopt};
+    }
+
+    /// Flushes the internal buffers at the end of the input.
+    std::optional<Fragment> finalize()
+    {
+      gemtext_fragment fragment;
+      auto const result = detail::check(gemtextParserFinalize(raw(), &fragment));
+      if (result == GEMTEXT_SUCCESS_FRAGMENT)
+        return Fragment(raw(), fragment);
+      return std::nullopt;
+    }
+
+    void set_limits(gemtext_parser_limits const &limits) noexcept
+    {
+      gemtextParserSetLimits(raw(), &limits);
+    }
+
+    gemtext_parser *raw() noexcept { return &parser_->parser; }
+
+  private:
+    struct storage
+    {
+      gemtext_parser parser;
+      gemtext_allocator allocator;
+      std::pmr::memory_resource *resource;
+    };
+
+    struct deleter
+    {
+      void operator()(storage *parser) const noexcept
+      {
+        gemtextParserDestroy(&parser->parser);
+        detail::destroy(parser->resource, parser);
+      }
+    };
+
+    // The parser lives on the heap, so fragments and the C parser keep stable pointers when the parser is moved.
+    std::unique_ptr<storage, deleter> parser_;
+  };
+
+  /// A lazy input range of the fragments parsed from a range of characters.
+  /// Drives a `Parser` over the input in chunks and never builds a document.
+  /// Only the current fragment is alive; it is destroyed when the iterator is incremented,
+  /// so move it out of the range to keep it.
+  /// Create it with `gemtext::parse`.
+  template <std::ranges::view V>
+    requires std::ranges::input_range<V> &&
+             std::convertible_to<std::ranges::range_reference_t<V>, char>
+  class parse_view : public std::ranges::view_interface<parse_view<V>>
+  {
+  public:
+    /// Number of characters copied from non-contiguous input before they are fed to the parser.
+    static constexpr std::size_t chunk_size = 4096;
+
+    class iterator
+    {
+    public:
+      using iterator_concept = std::input_iterator_tag;
+      using value_type = Fragment;
+      using difference_type = std::ptrdiff_t;
+
+      iterator() = default;
+
+      Fragment &operator*() const { return *view_->state_->current; }
+      Fragment *operator->() const { return &*view_->state_->current; }
+
+      iterator &operator++()
+      {
+        view_->advance();
+        return *this;
+      }
+
+      void operator++(int) { ++*this; }
+
+      friend bool operator==(iterator const &it, std::default_sentinel_t) noexcept
+      {
+        return it.at_end();
+      }
+
+    private:
+      friend class parse_view;
+
+      explicit iterator(parse_view *view) noexcept : view_(view) {}
+
+      bool at_end() const noexcept { return !view_->state_->current.has_value(); }
+
+      parse_view *view_ = nullptr;
+    };
+
+    parse_view()
+      requires std::default_initializable<V>
+    = default;
+    /// If `resource` is given, the parser state and all fragments are allocated from it.
+    explicit parse_view(V base, std::pmr::memory_resource *resource = nullptr)
+        : base_(std::move(base)), state_(detail::create<state>(resource, resource))
+    {
+    }
+
+    /// Parses up to the first fragment. Must only be called once.
+    iterator begin()
+    {
+      state_->input.emplace(std::ranges::begin(base_));
+      advance();
+      return iterator(this);
+    }
+
+    std::default_sentinel_t end() const noexcept { return std::default_sentinel; }
+
+    /// Applies resource `limits` to the parser. Must be called before `begin`.
+    void set_limits(gemtext_parser_limits const &limits) noexcept { state_->parser.set_limits(limits); }
+
+    V base() const &
+      requires std::copy_constructible<V>
+    {
+      return base_;
+    }
+    V base() && { return std::move(base_); }
+
+  private:
+    // Kept on the heap so that `pending` may point into `buffer` while the view is moved.
+    struct state
+    {
+      explicit state(std::pmr::memory_resource *resource) : parser(resource), resource(resource) {}
+
+      Parser parser;
+      std::pmr::memory_resource *resource;
+      std::optional<std::ranges::iterator_t<V>> input;
+      std::optional<Fragment> current;
+      std::string_view pending;
+      bool exhausted = false;
+      bool finalized = false;
+      char buffer[chunk_size];
+    };
+
+    void advance()
+    {
+      state &s = *state_;
+      s.current.reset();
+      while (true)
+      {
+        if (s.pending.empty())
+        {
+          if (!s.exhausted)
+          {
+            fill();
+            continue;
+          }
+          if (!s.finalized)
+          {
+            s.finalized = true;
+            s.current = s.parser.finalize();
+          }
+          return;
+        }
+
+        auto result = s.parser.feed(s.pending);
+        s.pending.remove_prefix(result.consumed);
+        if (result.fragment)
+        {
+          s.current = std::move(result.fragment);
+          return;
+        }
+      }
+    }
+
+    void fill()
+    {
+      state &s = *state_;
+      if constexpr (std::ranges::contiguous_range<V> && std::ranges::sized_range<V> &&
+                    std::same_as<std::ranges::range_value_t<V>, char>)
+      {
+        // Contiguous input is fed in place.
+        s.pending = std::string_view(std::ranges::data(base_), std::ranges::size(base_));
+        s.exhausted = true;
+      }
+      else
+      {
+        std::size_t length = 0;
+        auto const end = std::ranges::end(base_);
+        auto &input = *s.input;
+        while (length < chunk_size && input != end)
+        {
+          s.buffer[length++] = static_cast<char>(*input);
+          ++input;
+        }
+        s.pending = std::string_view(s.buffer, length);
+        s.exhausted = (input == end);
+      }
+    }
+
+    struct deleter
+    {
+      void operator()(state *s) const noexcept { detail::destroy(s->resource, s); }
+    };
+
+    V base_;
+    std::unique_ptr<state, deleter> state_;
+  };
+
+  template <class R>
+  parse_view(R &&) -> parse_view<std::views::all_t<R>>;
+
+  template <class R>
+  parse_view(R &&, std::pmr::memory_resource *) -> parse_view<std::views::all_t<R>>;
+
+  /// Returns a lazy range of the fragments parsed from `input`, which is any input range of characters.
+  /// Note that `std::views::istream<char>` skips whitespace unless the stream has `std::noskipws` set.
+  /// If `resource` is given, the parser and all fragments are allocated from it.
+  template <std::ranges::viewable_range R>
+  auto parse(R &&input, std::pmr::memory_resource *resource = nullptr)
+  {
+    return parse_view(std::views::all(std::forward<R>(input)), resource);
+  }
+
+  /// A parsed document that owns all of its fragments.
+  class Document
+  {
+  public:
+    using iterator = gemtext_fragment const *;
+
+    /// Creates an empty document. If `resource` is given, all fragments are
+    /// allocated from it, and it must outlive the document.
+    explicit Document(std::pmr::memory_resource *resource = nullptr)
+        : Document(adopt, resource)
+    {
+      detail::check(gemtextDocumentCreateWithAllocator(&raw_, allocator_));
+      owned_ = true;
+    }
+
+    /// Parses `text` into a document, allocating from `resource` if given.
+    static Document parse(std::string_view text, std::pmr::memory_resource *resource = nullptr)
+    {
+      Document document(adopt, resource);
+      detail::check(gemtextDocumentParseStringWithAllocator(
+          &document.raw_,
+          document.allocator_,
+          text.data(),
+          text.size()));
+      document.owned_ = true;
+      return document;
+    }
+
+    /// Parses the remaining content of `file` into a document, allocating from `resource` if given.
+    static Document parse(std::FILE *file, std::pmr::memory_resource *resource = nullptr)
+    {
+      Document document(adopt, resource);
+      detail::check(gemtextDocumentParseFileWithAllocator(&document.raw_, document.allocator_, file));
+      document.owned_ = true;
+      return document;
+    }
+
+    Document(Document const &) = delete;
+    Document &operator=(Document const &) = delete;
+
+    Document(Document &&other) noexcept
+        : raw_(other.raw_),
+          allocator_(std::exchange(other.allocator_, nullptr)),
+          owned_(std::exchange(other.owned_, false))
+    {
+    }
+
+    Document &operator=(Document &&other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        raw_ = other.raw_;
+        allocator_ = std::exchange(other.allocator_, nullptr);
+        owned_ = std::exchange(other.owned_, false);
+      }
+      return *this;
+    }
+
+    ~Document() { reset(); }
+
+    /// The fragments of the document. Invalidated by `append`, `insert` and `remove`.
+    std::span<gemtext_fragment const> fragments() const noexcept
+    {
+      if (!owned_)
+        return {};
+      return {raw_.fragments, raw_.fragment_count};
+    }
+
+    iterator begin() const noexcept { return fragments().data(); }
+    iterator end() const noexcept { return fragments().data() + fragments().size(); }
+
+    std::size_t size() const noexcept { return fragments().size(); }
+    bool empty() const noexcept { return fragments().empty(); }
+
+    /// Returns a typed view of the fragment at `index`.
+    fragment_view operator[](std::size_t index) const { return gemtext::view(fragments()[index]); }
+
+    /// Appends a copy of `fragment`.
+    void append(gemtext_fragment const &fragment)
+    {
+      detail::check(gemtextDocumentAppend(&raw_, &fragment));
+    }
+
+    /// Inserts a copy of `fragment` at `index`.
+    void insert(std::size_t index, gemtext_fragment const &fragment)
+    {
+      detail::check(gemtextDocumentInsert(&raw_, index, &fragment));
+    }
+
+    void remove(std::size_t index)
+    {
+      if (index >= size())
+        throw error(GEMTEXT_ERR_OUT_OF_BOUNDS);
+      gemtextDocumentRemove(&raw_, index);
+    }
+
+    /// Renders the document with `renderer` to a callable, a `std::streambuf` or
+    /// a `std::ostream`, see `gemtext::render`.
+    template <class Sink>
+    decltype(auto) render(gemtext_renderer renderer, Sink &&sink) const
+    {
+      return gemtext::render(renderer, fragments(), std::forward<Sink>(sink));
+    }
+
+    gemtext_document const &raw() const noexcept { return raw_; }
+
+  private:
+    struct adopt_t
+    {
+    };
+    static constexpr adopt_t adopt{};
+
+    Document(adopt_t, std::pmr::memory_resource *resource)
+        : raw_{}, allocator_(nullptr), owned_(false)
+    {
+      // The C document keeps a pointer to its allocator, so it needs a stable address.
+      if (resource != nullptr)
+        allocator_ = detail::create<gemtext_allocator>(resource, detail::resource_allocator(resource));
+    }
+
+    void reset() noexcept
+    {
+      if (owned_)
+        gemtextDocumentDestroy(&raw_);
+      owned_ = false;
+      if (allocator_ != nullptr)
+      {
+        auto *resource = static_cast<std::pmr::memory_resource *>(allocator_->context);
+        detail::destroy(resource, allocator_);
+      }
+      allocator_ = nullptr;
+    }
+
+    gemtext_document raw_;
+    gemtext_allocator *allocator_;
+    bool owned_;
+  };
+
+  template <class T = void>
+  class task;
+
+  namespace detail
+  {
+    /// Resumes the awaiting coroutine when a task finishes.
+    struct final_awaiter
+    {
+      bool await_ready() const noexcept { return false; }
+
+      template <class Promise>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept
+      {
+        if (auto continuation = handle.promise().continuation)
+          return continuation;
+        return std::noop_coroutine();
+      }
+
+      void await_resume() const noexcept {}
+    };
+
+    struct promise_base
+    {
+      std::coroutine_handle<> continuation;
+      std::exception_ptr exception;
+
+      std::suspend_always initial_suspend() const noexcept { return {}; }
+      final_awaiter final_suspend() const noexcept { return {}; }
+      void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+      void rethrow() const
+      {
+        if (exception)
+          std::rethrow_exception(exception);
+      }
+    };
+
+    template <class T>
+    struct promise : promise_base
+    {
+      std::optional<T> value;
+
+      task<T> get_return_object() noexcept;
+
+      template <class U>
+      void return_value(U &&result)
+      {
+        value.emplace(std::forward<U>(result));
+      }
+
+      T result()
+      {
+        rethrow();
+        return std::move(*value);
+      }
+    };
+
+    template <>
+    struct promise<void> : promise_base
+    {
+      task<void> get_return_object() noexcept;
+
+      void return_void() const noexcept {}
+
+      void result() const { rethrow(); }
+    };
+  } // namespace detail
+
+  /// A lazily started coroutine that resumes its awaiter when it finishes.
+  /// `co_await` it from another coroutine, or `start` it from the event loop
+  /// and read the result with `get` once it is `done`.
+  template <class T>
+  class [[nodiscard]] task
+  {
+  public:
+    using promise_type = detail::promise<T>;
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    task(task const &) = delete;
+    task &operator=(task const &) = delete;
+
+    task(task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    task &operator=(task &&other) noexcept
+    {
+      if (this != &other)
+      {
+        if (handle_)
+          handle_.destroy();
+        handle_ = std::exchange(other.handle_, nullptr);
+      }
+      return *this;
+    }
+
+    ~task()
+    {
+      if (handle_)
+        handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+      handle_.promise().continuation = awaiting;
+      return handle_;
+    }
+
+    T await_resume() { return handle_.promise().result(); }
+
+    /// Runs the task until it suspends for the first time.
+    void start() { handle_.resume(); }
+
+    bool done() const noexcept { return handle_.done(); }
+
+    /// Returns the result of a finished task, or rethrows its exception.
+    T get() { return handle_.promise().result(); }
+
+  private:
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+  namespace detail
+  {
+    template <class T>
+    task<T> promise<T>::get_return_object() noexcept
+    {
+      return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+    }
+
+    inline task<void> promise<void>::get_return_object() noexcept
+    {
+      return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+    }
+
+    template <class Sink>
+    concept async_sink = requires(Sink &sink, std::string_view bytes) { sink.write(bytes); };
+
+    template <class Sink>
+    task<void> render_fragments(gemtext_renderer renderer, std::span<gemtext_fragment const> fragments, Sink &sink)
+    {
+      std::string chunk;
+      for (auto const &fragment : fragments)
+      {
+        chunk.clear();
+
+        // The renderer calls the sink from C, so an exception must not leave it.
+        std::exception_ptr exception;
+        gemtext::render(renderer, {&fragment, 1}, [&](std::string_view bytes) noexcept
+                        {
+                          if (exception)
+                            return;
+                          try
+                          {
+                            chunk.append(bytes);
+                          }
+                          catch (...)
+                          {
+                            exception = std::current_exception();
+                          } });
+        if (exception)
+          std::rethrow_exception(exception);
+
+        co_await sink.write(std::string_view(chunk));
+      }
+    }
+  } // namespace detail
+
+  /// A streaming parser for coroutines.
+  ///
+  /// Reads its input with `co_await source.read(std::span<char>)`, which must produce
+  /// the number of bytes read, or 0 at the end of the input. The source suspends the
+  /// parser while no input is available.
+  class AsyncParser
+  {
+  public:
+    /// Size of the buffer passed to `source.read`.
+    static constexpr std::size_t chunk_size = 4096;
+
+    /// If `resource` is given, the parser, its buffer and all fragments are allocated from it.
+    explicit AsyncParser(std::pmr::memory_resource *resource = nullptr)
+        : parser_(resource),
+          buffer_(chunk_size, resource != nullptr ? resource : std::pmr::get_default_resource())
+    {
+    }
+
+    void set_limits(gemtext_parser_limits const &limits) noexcept { parser_.set_limits(limits); }
+
+    /// Returns the next fragment, or nothing at the end of the input.
+    /// The parser and `source` must outlive the returned task.
+    template <class Source>
+    task<std::optional<Fragment>> next_fragment(Source &source)
+    {
+      while (true)
+      {
+        if (pending_.empty())
+        {
+          if (finalized_)
+            co_return std::nullopt;
+
+          std::size_t const length = co_await source.read(std::span<char>(buffer_));
+          if (length == 0)
+          {
+            finalized_ = true;
+            co_return parser_.finalize();
+          }
+          pending_ = std::string_view(buffer_.data(), length);
+          continue;
+        }
+
+        auto result = parser_.feed(pending_);
+        pending_.remove_prefix(result.consumed);
+        if (result.fragment)
+          co_return std::move(result.fragment);
+      }
+    }
+
+  private:
+    Parser parser_;
+    std::pmr::vector<char> buffer_;
+    std::string_view pending_;
+    bool finalized_ = false;
+  };
+
+  /// Renders `document` with `renderer` and writes the output with
+  /// `co_await sink.write(std::string_view)`, one fragment at a time.
+  /// The sink suspends the render while it can't take more output.
+  /// `document` and `sink` must outlive the returned task.
+  template <class Sink>
+    requires detail::async_sink<Sink>
+  task<void> render(Document const &document, gemtext_renderer renderer, Sink &sink)
+  {
+    return detail::render_fragments(renderer, document.fragments(), sink);
+  }
+
+  /// Renders a single `fragment` with `renderer` to `sink`, see above.
+  template <class Sink>
+    requires detail::async_sink<Sink>
+  task<void> render(Fragment const &fragment, gemtext_renderer renderer, Sink &sink)
+  {
+    return detail::render_fragments(renderer, {&fragment.raw(), 1}, sink);
+  }
+
+  /// Renders `document` with `renderer` into `stream`, see above.
+  inline std::ostream &render(Document const &document, gemtext_renderer renderer, std::ostream &stream)
+  {
+    return render(renderer, document.fragments(), stream);
+  }
+} // namespace gemtext
+
+#endif // GEMTEXT_HPP
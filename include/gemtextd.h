@@ -0,0 +1,105 @@
+#ifndef GEMTEXTD_H
+#define GEMTEXTD_H
+
+//! Client library for `gemtextd`, the local gemini text conversion daemon.
+//!
+//! The daemon listens on a Unix domain socket. A connection carries any number
+//! of requests, each answered before the next one is read. Workers are assigned
+//! per request, not per connection, so any number of clients may keep their
+//! connections open. A malformed request is answered and the connection closed,
+//! as is a connection that stalls in the middle of a request or response.
+//!
+//! Request:  u8 version, u8 source, u8 renderer, u8 flags, u32 payload length, payload
+//! Response: u8 version, i8 status, u16 reserved, u32 body length, body
+//!
+//! All integers are little endian. The payload is either the gemini text itself
+//! or a path relative to the root directory of the daemon. The body is the rendered
+//! document on success, or an error message otherwise.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gemtext.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define GEMTEXTD_PROTOCOL_VERSION 1
+
+/// The default path of the daemon socket.
+#define GEMTEXTD_DEFAULT_SOCKET "/tmp/gemtextd.sock"
+
+enum gemtextd_source
+{
+  /// The payload is the gemini text to convert.
+  GEMTEXTD_SOURCE_BYTES = 0,
+
+  /// The payload is the path of a file below the root directory of the daemon.
+  /// Rendered files are cached by the daemon until they change.
+  GEMTEXTD_SOURCE_PATH = 1,
+
+  /// The payload and renderer are ignored. The body contains the metrics of the
+  /// daemon in the Prometheus text exposition format.
+  GEMTEXTD_SOURCE_METRICS = 2,
+};
+
+enum gemtextd_flags
+{
+  /// Renders the file even if a cached page exists. Only for `GEMTEXTD_SOURCE_PATH`.
+  GEMTEXTD_FLAG_NO_CACHE = 1 << 0,
+};
+
+/// Response status codes beyond the `gemtext_error` codes, which are
+/// passed through verbatim if the conversion itself fails.
+enum gemtextd_error
+{
+  /// The request was malformed or used an unsupported protocol version.
+  GEMTEXTD_ERR_PROTOCOL = -64,
+
+  /// The requested file does not exist or is outside the root directory.
+  GEMTEXTD_ERR_NOT_FOUND = -65,
+
+  /// The request is larger than the daemon accepts.
+  GEMTEXTD_ERR_TOO_LARGE = -66,
+
+  /// The connection to the daemon failed. Only returned by the client library.
+  GEMTEXTD_ERR_IO = -67,
+};
+
+/// A connection to the daemon.
+struct gemtextd_client
+{
+  int fd;
+  /// Receives the response bodies, grown as needed.
+  char *buffer;
+  size_t capacity;
+};
+
+/// Connects `client` to the daemon listening on `socket_path`.
+/// Returns 0 on success or `GEMTEXTD_ERR_IO`.
+int gemtextdConnect(struct gemtextd_client *client, char const *socket_path);
+
+/// Closes the connection and frees all resources of `client`.
+void gemtextdDisconnect(struct gemtextd_client *client);
+
+/// Converts the `length` bytes of `payload` with `renderer`.
+/// On success, returns 0 and stores the rendered document in `body` and
+/// `body_length`. Otherwise returns a `gemtext_error` or `gemtextd_error` code,
+/// and `body` holds the error message of the daemon, if any.
+/// `body` is owned by `client` and stays valid until the next request.
+int gemtextdRender(
+    struct gemtextd_client *client,
+    enum gemtextd_source source,
+    enum gemtext_renderer renderer,
+    unsigned flags,
+    char const *payload,
+    size_t length,
+    char const **body,
+    size_t *body_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GEMTEXTD_H
@@ -0,0 +1,162 @@
+//! Selects the kernel tier of the C library at runtime.
+//!
+//! On x86-64, the library links a copy of the kernels for each of the SSE2,
+//! AVX2 and AVX-512 tiers. The best tier the CPU supports is selected once on
+//! first use via CPUID, unless `GEMTEXT_CPU_TIER` is set to `generic`, `sse2`,
+//! `avx2` or `avx512` in the environment.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const build_options = @import("build_options");
+const kernels = @import("kernels.zig");
+
+const Tier = kernels.Tier;
+
+const has_tiers = builtin.cpu.arch == .x86_64 and build_options.kernel_tiers;
+
+var tier_table: kernels.Table = undefined;
+
+var init_once = std.once(init);
+
+/// Selects the kernel tier on first call. Must be called before any parsing or rendering happens.
+pub fn ensureInit() void {
+    init_once.call();
+}
+
+fn init() void {
+    var tier = detect();
+    if (std.posix.getenv("GEMTEXT_CPU_TIER")) |name| {
+        if (std.meta.stringToEnum(Tier, name)) |requested| {
+            if (isSupported(requested))
+                tier = requested;
+        }
+    }
+    select(tier) catch unreachable;
+}
+
+/// Returns whether the kernels for `tier` are linked in and can run on this CPU.
+pub fn isSupported(tier: Tier) bool {
+    if (tier == .generic)
+        return true;
+    if (!has_tiers)
+        return false;
+    return @intFromEnum(tier) <= @intFromEnum(detect());
+}
+
+/// Switches all parsers and renderers to the kernels for `tier`.
+/// Meant for benchmarking, must not be called while other threads parse or render.
+pub fn select(tier: Tier) error{Unsupported}!void {
+    if (!isSupported(tier))
+        return error.Unsupported;
+
+    if (tier == .generic) {
+        kernels.active = &kernels.generic;
+        return;
+    }
+
+    if (has_tiers) {
+        tier_table = switch (tier) {
+            .generic => unreachable,
+            inline else => |t| externTable(t),
+        };
+        kernels.active = &tier_table;
+    }
+}
+
+/// Returns the currently selected tier.
+pub fn current() Tier {
+    return kernels.active.tier;
+}
+
+fn externTable(comptime tier: Tier) kernels.Table {
+    const prefix = "gemtext_kernel_" ++ @tagName(tier) ++ "_";
+    return kernels.Table{
+        .tier = tier,
+        .index_of_newline = @extern(*const fn ([*]const u8, usize) callconv(.C) usize, .{ .name = prefix ++ "index_of_newline" }),
+        .index_of_html_special = @extern(*const fn ([*]const u8, usize) callconv(.C) usize, .{ .name = prefix ++ "index_of_html_special" }),
+        .validate_utf8 = @extern(*const fn ([*]const u8, usize) callconv(.C) bool, .{ .name = prefix ++ "validate_utf8" }),
+        .classify_line = @extern(*const fn ([*]const u8, usize) callconv(.C) kernels.LineKind, .{ .name = prefix ++ "classify_line" }),
+    };
+}
+
+/// Returns the best tier supported by the CPU and the operating system.
+fn detect() Tier {
+    if (!has_tiers)
+        return .generic;
+
+    const max_leaf = cpuid(0, 0).eax;
+    if (max_leaf < 7)
+        return .sse2;
+
+    const leaf1 = cpuid(1, 0);
+    const leaf7 = cpuid(7, 0);
+    const ext1 = cpuid(0x8000_0001, 0);
+
+    const osxsave = bit(leaf1.ecx, 27);
+    if (!osxsave)
+        return .sse2;
+    const xcr0 = xgetbv();
+
+    // x86-64-v3: AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE and OS support for YMM state
+    const v3 = (xcr0 & 0x6) == 0x6 and
+        bit(leaf1.ecx, 28) and // AVX
+        bit(leaf7.ebx, 5) and // AVX2
+        bit(leaf7.ebx, 3) and // BMI1
+        bit(leaf7.ebx, 8) and // BMI2
+        bit(leaf1.ecx, 29) and // F16C
+        bit(leaf1.ecx, 12) and // FMA
+        bit(ext1.ecx, 5) and // LZCNT
+        bit(leaf1.ecx, 22); // MOVBE
+    if (!v3)
+        return .sse2;
+
+    // x86-64-v4: AVX512F, AVX512BW, AVX512CD, AVX512DQ, AVX512VL and OS support for ZMM state
+    const v4 = (xcr0 & 0xE6) == 0xE6 and
+        bit(leaf7.ebx, 16) and // AVX512F
+        bit(leaf7.ebx, 30) and // AVX512BW
+        bit(leaf7.ebx, 28) and // AVX512CD
+        bit(leaf7.ebx, 17) and // AVX512DQ
+        bit(leaf7.ebx, 31); // AVX512VL
+    if (!v4)
+        return .avx2;
+
+    return .avx512;
+}
+
+fn bit(value: u32, comptime index: u5) bool {
+    return (value >> index) & 1 == 1;
+}
+
+const CpuidResult = struct {
+    eax: u32,
+    ebx: u32,
+    ecx: u32,
+    edx: u32,
+};
+
+fn cpuid(leaf: u32, subleaf: u32) CpuidResult {
+    var eax: u32 = undefined;
+    var ebx: u32 = undefined;
+    var ecx: u32 = undefined;
+    var edx: u32 = undefined;
+    asm volatile ("cpuid"
+        : [_] "={eax}" (eax),
+          [_] "={ebx}" (ebx),
+          [_] "={ecx}" (ecx),
+          [_] "={edx}" (edx),
+        : [_] "{eax}" (leaf),
+          [_] "{ecx}" (subleaf),
+    );
+    return CpuidResult{ .eax = eax, .ebx = ebx, .ecx = ecx, .edx = edx };
+}
+
+fn xgetbv() u64 {
+    var eax: u32 = undefined;
+    var edx: u32 = undefined;
+    asm volatile ("xgetbv"
+        : [_] "={eax}" (eax),
+          [_] "={edx}" (edx),
+        : [_] "{ecx}" (@as(u32, 0)),
+    );
+    return (@as(u64, edx) << 32) | eax;
+}
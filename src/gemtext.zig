@@ -7,8 +7,65 @@ pub const renderer = struct {
     pub const html = @import("renderers/html.zig").render;
     pub const markdown = @import("renderers/markdown.zig").render;
     pub const rtf = @import("renderers/rtf.zig").render;
+
+    /// Renders HTML with `id` attributes on headings and an optional table of contents.
+    pub const htmlWithAnchors = @import("renderers/html.zig").renderWithAnchors;
+    pub const HtmlAnchors = @import("renderers/html.zig").Anchors;
+
+    /// Formats text with the HTML special characters escaped, for example `{}` with `fmtHtml(text)`.
+    pub const fmtHtml = @import("renderers/html.zig").fmtHtml;
+
+    /// Renders into gzip, zlib or raw deflate streams in one pass.
+    pub const compressed = @import("renderers/compressed.zig");
+
+    /// The output formats that can be selected at runtime.
+    pub const Format = enum {
+        gemtext,
+        html,
+        markdown,
+        rtf,
+    };
+
+    /// Renders a sequence of fragments with the renderer selected by `format`.
+    pub fn render(format: Format, fragments: []const Fragment, writer: anytype) !void {
+        switch (format) {
+            .gemtext => try gemtext(fragments, writer),
+            .html => try html(fragments, writer),
+            .markdown => try markdown(fragments, writer),
+            .rtf => try rtf(fragments, writer),
+        }
+    }
 };
 
+/// A concurrent, size-bounded cache of rendered documents.
+pub const RenderCache = @import("render_cache.zig").RenderCache;
+
+/// A work-stealing pool of worker threads.
+pub const ThreadPool = @import("thread_pool.zig").ThreadPool;
+
+/// Lock-free counters and latency histograms in the Prometheus text format.
+pub const Metrics = @import("metrics.zig").Metrics;
+
+/// Finds the links of a document without parsing it.
+pub const LinkScanner = @import("links.zig").LinkScanner;
+
+/// Resolves link targets to paths of local files in a capsule.
+pub const resolveLinkTarget = @import("links.zig").resolveTarget;
+pub const hasLinkScheme = @import("links.zig").hasScheme;
+
+/// Counts fragments, lines, words and links of a document without parsing it.
+pub const Statistics = @import("statistics.zig").Statistics;
+pub const LinkScheme = @import("statistics.zig").LinkScheme;
+
+/// SIMD kernels for scanning gemini text, selectable at runtime.
+pub const kernels = @import("kernels.zig");
+
+/// A compressed in-memory store for many documents.
+pub const DocumentStore = @import("store.zig").DocumentStore;
+
+/// A read-mostly document cache in shared memory for multi-process servers.
+pub const SharedCache = @import("shared_cache.zig").SharedCache;
+
 /// The type of a `Fragment`.
 pub const FragmentType = std.meta.Tag(Fragment);
 
@@ -164,7 +221,7 @@ pub const Parser = struct {
     const Self = @This();
 
     comptime {
-        if (@sizeOf(@This()) > 128)
+        if (@sizeOf(@This()) > 256)
             @compileError("Please adjust the limit here and include/gemtext.h to use the new parser size!");
 
         if (@alignOf(@This()) > 16)
@@ -185,11 +242,39 @@ pub const Parser = struct {
         fragment: ?Fragment,
     };
 
+    /// Bounds for the resources a single document may use in the parser.
+    /// The limits are checked once per line or fragment, before the line is buffered,
+    /// so they are cheap enough to be always enabled. All limits are unbounded by default.
+    pub const Limits = struct {
+        /// The maximum number of bytes in a single line, excluding the line feed.
+        /// Exceeding it fails with `error.LineTooLong`.
+        max_line_length: usize = std.math.maxInt(usize),
+        /// The maximum number of lines in a list, quote or preformatted block,
+        /// including the alt text line of preformatted blocks.
+        /// Exceeding it fails with `error.BlockTooLarge`.
+        max_block_lines: usize = std.math.maxInt(usize),
+        /// The maximum number of text bytes buffered for a single block.
+        /// Exceeding it fails with `error.BlockTooLarge`.
+        max_block_bytes: usize = std.math.maxInt(usize),
+        /// The maximum number of fragments in a document.
+        /// Exceeding it fails with `error.TooManyFragments`.
+        max_fragments: usize = std.math.maxInt(usize),
+        /// The maximum number of bytes in a document.
+        /// Exceeding it fails with `error.DocumentTooLarge`.
+        max_total_bytes: usize = std.math.maxInt(usize),
+    };
+
     allocator: std.mem.Allocator,
     line_buffer: std.ArrayList(u8),
     text_block_buffer: std.ArrayList([]u8),
     state: State,
 
+    /// The resource limits for the parsed document. May be changed at any time.
+    limits: Limits,
+    block_bytes: usize,
+    fragment_count: usize,
+    total_bytes: usize,
+
     /// Initialize a new parser.
     pub fn init(allocator: std.mem.Allocator) Self {
         return Self{
@@ -197,6 +282,10 @@ pub const Parser = struct {
             .line_buffer = std.ArrayList(u8).init(allocator),
             .text_block_buffer = std.ArrayList([]u8).init(allocator),
             .state = .default,
+            .limits = Limits{},
+            .block_bytes = 0,
+            .fragment_count = 0,
+            .total_bytes = 0,
         };
     }
 
@@ -210,31 +299,167 @@ pub const Parser = struct {
         self.* = undefined;
     }
 
+    const snapshot_magic = "GTPS";
+    const snapshot_version = 2;
+
+    /// Writes the complete parser state into `writer`, so parsing can be continued later
+    /// with `restore`, possibly in another process.
+    /// The snapshot contains the current block state, the pending bytes of the unterminated
+    /// line and the buffered lines of the current block. Bytes that were consumed by `feed`
+    /// before the snapshot must not be fed again after restoring it.
+    pub fn snapshot(self: Self, writer: anytype) !void {
+        try writer.writeAll(snapshot_magic);
+        try writer.writeByte(snapshot_version);
+        try writer.writeByte(@intFromEnum(self.state));
+        try std.leb.writeULEB128(writer, self.total_bytes);
+        try std.leb.writeULEB128(writer, self.fragment_count);
+
+        try std.leb.writeULEB128(writer, self.line_buffer.items.len);
+        try writer.writeAll(self.line_buffer.items);
+
+        try std.leb.writeULEB128(writer, self.text_block_buffer.items.len);
+        for (self.text_block_buffer.items) |line| {
+            try std.leb.writeULEB128(writer, line.len);
+            try writer.writeAll(line);
+        }
+    }
+
+    /// Replaces the parser state with a state previously written by `snapshot`.
+    /// The snapshot is checked against the current `limits` of the parser.
+    /// If the snapshot is invalid, `error.InvalidSnapshot` is returned and the parser
+    /// is reset to the state of a freshly initialized parser.
+    pub fn restore(self: *Self, reader: anytype) !void {
+        self.reset();
+        errdefer self.reset();
+
+        var magic: [snapshot_magic.len]u8 = undefined;
+        try reader.readNoEof(&magic);
+        if (!std.mem.eql(u8, &magic, snapshot_magic))
+            return error.InvalidSnapshot;
+        if (try reader.readByte() != snapshot_version)
+            return error.InvalidSnapshot;
+
+        const state = std.meta.intToEnum(State, try reader.readByte()) catch return error.InvalidSnapshot;
+        const total_bytes = try std.leb.readULEB128(usize, reader);
+        const fragment_count = try std.leb.readULEB128(usize, reader);
+        if (total_bytes > self.limits.max_total_bytes)
+            return error.DocumentTooLarge;
+        if (fragment_count > self.limits.max_fragments)
+            return error.TooManyFragments;
+
+        const line_len = try std.leb.readULEB128(usize, reader);
+        if (line_len > self.limits.max_line_length)
+            return error.LineTooLong;
+        try self.line_buffer.resize(line_len);
+        try reader.readNoEof(self.line_buffer.items);
+
+        const block_len = try std.leb.readULEB128(usize, reader);
+        if (block_len > self.limits.max_block_lines)
+            return error.BlockTooLarge;
+        for (0..block_len) |_| {
+            const len = try std.leb.readULEB128(usize, reader);
+            if (self.block_bytes + len > self.limits.max_block_bytes)
+                return error.BlockTooLarge;
+
+            const line = try self.allocator.alloc(u8, len);
+            errdefer self.allocator.free(line);
+
+            try reader.readNoEof(line);
+            try self.text_block_buffer.append(line);
+            self.block_bytes += len;
+        }
+
+        // blocks always buffer at least their first line, preformatted blocks also their alt text
+        switch (state) {
+            .default => if (block_len != 0) return error.InvalidSnapshot,
+            .block_quote, .list, .preformatted => if (block_len == 0) return error.InvalidSnapshot,
+        }
+
+        self.state = state;
+        self.total_bytes = total_bytes;
+        self.fragment_count = fragment_count;
+    }
+
+    /// Drops all buffered input and returns the parser to its initial state.
+    /// The configured `limits` are kept.
+    pub fn reset(self: *Self) void {
+        for (self.text_block_buffer.items) |string| {
+            self.allocator.free(string);
+        }
+        self.text_block_buffer.shrinkRetainingCapacity(0);
+        self.line_buffer.shrinkRetainingCapacity(0);
+        self.state = .default;
+        self.block_bytes = 0;
+        self.fragment_count = 0;
+        self.total_bytes = 0;
+    }
+
     /// Feed a slice into the parser.
     /// This will continue parsing the gemtext document. `slice` is the next bytes in the 
     /// document byte sequence.
     /// The result will contain both the number of `consumed` bytes in `slice` and a `fragment` if any line was detected.
     /// `fragment_allocator` will be used to allocate the memory returned in `Fragment` if any.
+    /// Fails if the document exceeds one of the configured `limits`.
     pub fn feed(self: *Self, fragment_allocator: std.mem.Allocator, slice: []const u8) !Result {
+        const budget = self.limits.max_total_bytes -| self.total_bytes;
+        var result = try self.feedUnchecked(fragment_allocator, slice, budget);
+        errdefer if (result.fragment) |*fragment|
+            fragment.free(fragment_allocator);
+
+        self.total_bytes += result.consumed;
+
+        if (result.fragment != null)
+            try self.countFragment();
+
+        return result;
+    }
+
+    fn countFragment(self: *Self) !void {
+        self.fragment_count += 1;
+        if (self.fragment_count > self.limits.max_fragments)
+            return error.TooManyFragments;
+    }
+
+    /// Buffers a line of the current block.
+    fn appendBlockLine(self: *Self, line: []const u8) !void {
+        if (self.text_block_buffer.items.len >= self.limits.max_block_lines)
+            return error.BlockTooLarge;
+        // The limits may have been lowered below the buffered amount, so don't subtract.
+        if (self.block_bytes + line.len > self.limits.max_block_bytes)
+            return error.BlockTooLarge;
+
+        const line_buffer = try self.allocator.dupe(u8, line);
+        errdefer self.allocator.free(line_buffer);
+
+        try self.text_block_buffer.append(line_buffer);
+        self.block_bytes += line.len;
+    }
+
+    /// Parses `slice` without counting bytes and fragments.
+    /// Fails with `error.DocumentTooLarge` before more than `budget` bytes of `slice`
+    /// would be consumed, so an oversized line is never buffered.
+    fn feedUnchecked(self: *Self, fragment_allocator: std.mem.Allocator, slice: []const u8, budget: usize) !Result {
         var offset: usize = 0;
         main_loop: while (offset < slice.len) : (offset += 1) {
             if (slice[offset] == '\n') {
+                if (offset + 1 > budget)
+                    return error.DocumentTooLarge;
+
                 var line = self.line_buffer.items;
                 if (line.len > 0 and line[line.len - 1] == '\r') {
                     line = line[0 .. line.len - 1];
                 }
 
-                if (self.state == .preformatted and !std.mem.startsWith(u8, line, "```")) {
-                    // we are in a preformatted block that is not terminated right now...
-                    const line_buffer = try self.allocator.dupe(u8, line);
-                    errdefer self.allocator.free(line_buffer);
+                const kind = kernels.classifyLine(line);
 
-                    try self.text_block_buffer.append(line_buffer);
+                if (self.state == .preformatted and kind != .preformatted_toggle) {
+                    // we are in a preformatted block that is not terminated right now...
+                    try self.appendBlockLine(line);
 
                     self.line_buffer.shrinkRetainingCapacity(0);
 
                     continue :main_loop;
-                } else if (std.mem.startsWith(u8, line, "* ")) {
+                } else if (kind == .list) {
                     switch (self.state) {
                         .block_quote => {
                             const res = Result{
@@ -260,15 +485,12 @@ pub const Parser = struct {
 
                     self.state = .list;
 
-                    const line_buffer = try self.allocator.dupe(u8, trimLine(line[2..]));
-                    errdefer self.allocator.free(line_buffer);
-
-                    try self.text_block_buffer.append(line_buffer);
+                    try self.appendBlockLine(trimLine(line[2..]));
 
                     self.line_buffer.shrinkRetainingCapacity(0);
 
                     continue :main_loop;
-                } else if (std.mem.startsWith(u8, line, ">")) {
+                } else if (kind == .quote) {
                     switch (self.state) {
                         .list => {
                             const res = Result{
@@ -294,15 +516,12 @@ pub const Parser = struct {
 
                     self.state = .block_quote;
 
-                    const line_buffer = try self.allocator.dupe(u8, trimLine(line[1..]));
-                    errdefer self.allocator.free(line_buffer);
-
-                    try self.text_block_buffer.append(line_buffer);
+                    try self.appendBlockLine(trimLine(line[1..]));
 
                     self.line_buffer.shrinkRetainingCapacity(0);
 
                     continue :main_loop;
-                } else if (std.mem.startsWith(u8, line, "```")) {
+                } else if (kind == .preformatted_toggle) {
                     switch (self.state) {
                         .list => {
                             self.state = .default;
@@ -333,10 +552,7 @@ pub const Parser = struct {
                             // preformatted text blocks are prefixed with a line that stores the alt text.
                             // if the alt text string is empty, we're storing a `null` there later.
 
-                            const line_buffer = try self.allocator.dupe(u8, trimLine(line[3..]));
-                            errdefer self.allocator.free(line_buffer);
-
-                            try self.text_block_buffer.append(line_buffer);
+                            try self.appendBlockLine(trimLine(line[3..]));
 
                             self.line_buffer.shrinkRetainingCapacity(0);
 
@@ -363,13 +579,13 @@ pub const Parser = struct {
 
                 const fragment: Fragment = if (std.mem.eql(u8, trimLine(line), ""))
                     Fragment{ .empty = {} }
-                else if (std.mem.startsWith(u8, line, "###"))
+                else if (kind == .heading_3)
                     Fragment{ .heading = Heading{ .level = .h3, .text = try dupeAndTrim(fragment_allocator, line[3..]) } }
-                else if (std.mem.startsWith(u8, line, "##"))
+                else if (kind == .heading_2)
                     Fragment{ .heading = Heading{ .level = .h2, .text = try dupeAndTrim(fragment_allocator, line[2..]) } }
-                else if (std.mem.startsWith(u8, line, "#"))
+                else if (kind == .heading_1)
                     Fragment{ .heading = Heading{ .level = .h1, .text = try dupeAndTrim(fragment_allocator, line[1..]) } }
-                else if (std.mem.startsWith(u8, line, "=>")) blk: {
+                else if (kind == .link) blk: {
                     const temp = trimLine(line[2..]);
 
                     for (temp, 0..) |c, i| {
@@ -393,7 +609,15 @@ pub const Parser = struct {
                     .fragment = fragment,
                 };
             } else {
-                try self.line_buffer.append(slice[offset]);
+                // copy everything up to the next line feed at once, the loop increment
+                // then lands on the line feed.
+                const line_end = offset + kernels.indexOfNewline(slice[offset..]);
+                if (self.line_buffer.items.len + (line_end - offset) > self.limits.max_line_length)
+                    return error.LineTooLong;
+                if (line_end > budget)
+                    return error.DocumentTooLarge;
+                try self.line_buffer.appendSlice(slice[offset..line_end]);
+                offset = line_end - 1;
             }
         }
 
@@ -416,17 +640,23 @@ pub const Parser = struct {
 
         // feed a line end sequence to guaranteed termination of the current line.
         // This will either finish a normal line or complete the current block.
-        const res = try self.feed(fragment_allocator, "\n");
+        const res = try self.feedUnchecked(fragment_allocator, "\n", std.math.maxInt(usize));
+
+        var fragment = if (res.fragment) |frag|
+            // when we get a fragment, we ended a normal line
+            frag
+        else blk: {
+            // if not, we are currently parsing a block and must now convert the block
+            // into a fragment.
+            std.debug.assert(self.state != .default);
+            const frag_or_null = try self.createBlockFragmentFromStateAndResetState(fragment_allocator);
+            break :blk frag_or_null orelse unreachable;
+        };
+        errdefer fragment.free(fragment_allocator);
 
-        // when we get a fragment, we ended a normal line
-        if (res.fragment != null)
-            return res.fragment.?;
+        try self.countFragment();
 
-        // if not, we are currently parsing a block and must now convert the block
-        // into a fragment.
-        std.debug.assert(self.state != .default);
-        const frag_or_null = try self.createBlockFragmentFromStateAndResetState(fragment_allocator);
-        return frag_or_null orelse unreachable;
+        return fragment;
     }
 
     const BlockType = enum { preformatted, block_quote, list };
@@ -463,6 +693,7 @@ pub const Parser = struct {
         }
 
         self.text_block_buffer.shrinkRetainingCapacity(0);
+        self.block_bytes = 0;
 
         return switch (fragment_type) {
             .preformatted => Fragment{ .preformatted = Preformatted{
@@ -0,0 +1,170 @@
+//! Client library for gemtextd, see include/gemtextd.h.
+
+#include "gemtextd.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int writeAll(int fd, struct iovec *iov, int count)
+{
+  while (count > 0)
+  {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    size_t remaining = (size_t)written;
+    while (count > 0 && remaining >= iov->iov_len)
+    {
+      remaining -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0)
+    {
+      iov->iov_base = (char *)iov->iov_base + remaining;
+      iov->iov_len -= remaining;
+    }
+  }
+  return 0;
+}
+
+static int readAll(int fd, void *buffer, size_t length)
+{
+  size_t offset = 0;
+  while (offset < length)
+  {
+    ssize_t len = read(fd, (char *)buffer + offset, length - offset);
+    if (len < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (len == 0)
+      return -1;
+    offset += (size_t)len;
+  }
+  return 0;
+}
+
+static void writeU32(uint8_t *dst, uint32_t value)
+{
+  dst[0] = (uint8_t)(value);
+  dst[1] = (uint8_t)(value >> 8);
+  dst[2] = (uint8_t)(value >> 16);
+  dst[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t readU32(uint8_t const *src)
+{
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+int gemtextdConnect(struct gemtextd_client *client, char const *socket_path)
+{
+  client->fd = -1;
+  client->buffer = NULL;
+  client->capacity = 0;
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof address);
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof address.sun_path)
+    return GEMTEXTD_ERR_IO;
+  strcpy(address.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return GEMTEXTD_ERR_IO;
+
+  if (connect(fd, (struct sockaddr const *)&address, sizeof address) != 0)
+  {
+    close(fd);
+    return GEMTEXTD_ERR_IO;
+  }
+
+  client->fd = fd;
+  return 0;
+}
+
+void gemtextdDisconnect(struct gemtextd_client *client)
+{
+  if (client->fd >= 0)
+    close(client->fd);
+  free(client->buffer);
+  client->fd = -1;
+  client->buffer = NULL;
+  client->capacity = 0;
+}
+
+int gemtextdRender(
+    struct gemtextd_client *client,
+    enum gemtextd_source source,
+    enum gemtext_renderer renderer,
+    unsigned flags,
+    char const *payload,
+    size_t length,
+    char const **body,
+    size_t *body_length)
+{
+  *body = NULL;
+  *body_length = 0;
+
+  if (client->fd < 0)
+    return GEMTEXTD_ERR_IO;
+  if (length > UINT32_MAX)
+    return GEMTEXTD_ERR_TOO_LARGE;
+
+  uint8_t header[8];
+  header[0] = GEMTEXTD_PROTOCOL_VERSION;
+  header[1] = (uint8_t)source;
+  header[2] = (uint8_t)renderer;
+  header[3] = (uint8_t)flags;
+  writeU32(header + 4, (uint32_t)length);
+
+  // writev only reads the payload, the iovec is just not const-qualified.
+  struct iovec iov[2] = {
+      {.iov_base = header, .iov_len = sizeof header},
+      {.iov_base = (void *)(uintptr_t)payload, .iov_len = length},
+  };
+  if (writeAll(client->fd, iov, length > 0 ? 2 : 1) != 0)
+    goto _io_error;
+
+  uint8_t response[8];
+  if (readAll(client->fd, response, sizeof response) != 0)
+    goto _io_error;
+  if (response[0] != GEMTEXTD_PROTOCOL_VERSION)
+    goto _io_error;
+
+  size_t const response_length = readU32(response + 4);
+  if (response_length > client->capacity)
+  {
+    char *buffer = realloc(client->buffer, response_length);
+    if (buffer == NULL)
+      goto _io_error;
+    client->buffer = buffer;
+    client->capacity = response_length;
+  }
+  if (readAll(client->fd, client->buffer, response_length) != 0)
+    goto _io_error;
+
+  *body = client->buffer;
+  *body_length = response_length;
+  return (int8_t)response[1];
+
+_io_error:
+  // the stream is out of sync now, so it can't be used for further requests
+  close(client->fd);
+  client->fd = -1;
+  return GEMTEXTD_ERR_IO;
+}
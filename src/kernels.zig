@@ -0,0 +1,153 @@
+//! Vectorized scanning kernels used by the parser and the renderers.
+//!
+//! The kernels are generic over the vector length, so the same code can be
+//! compiled for several instruction set tiers. Zig users get the kernels for
+//! the CPU they compile for. The C library additionally links one copy per
+//! x86-64 tier and selects the best one at startup, see `src/cpu_dispatch.zig`.
+
+const std = @import("std");
+
+/// The instruction set tier a kernel table was compiled for.
+pub const Tier = enum(u8) {
+    /// Compiled for the target CPU of the current compilation.
+    generic = 0,
+    sse2 = 1,
+    avx2 = 2,
+    avx512 = 3,
+};
+
+/// The kind of a gemini text line, determined by its prefix.
+pub const LineKind = enum(u8) {
+    text,
+    heading_1,
+    heading_2,
+    heading_3,
+    link,
+    list,
+    quote,
+    preformatted_toggle,
+};
+
+pub const Table = struct {
+    tier: Tier,
+    /// Returns the index of the first line feed, or `len` if there is none.
+    index_of_newline: *const fn (bytes: [*]const u8, len: usize) callconv(.C) usize,
+    /// Returns the index of the first byte that must be escaped in HTML, or `len` if there is none.
+    index_of_html_special: *const fn (bytes: [*]const u8, len: usize) callconv(.C) usize,
+    /// Returns whether the bytes are valid UTF-8.
+    validate_utf8: *const fn (bytes: [*]const u8, len: usize) callconv(.C) bool,
+    /// Returns the kind of a line without its line terminator.
+    classify_line: *const fn (bytes: [*]const u8, len: usize) callconv(.C) LineKind,
+};
+
+/// The kernels for the CPU of the current compilation.
+pub const generic = Kernels(std.simd.suggestVectorLength(u8) orelse 16).table(.generic);
+
+/// The kernel table used by the parser and the renderers.
+/// Only changed once at startup, before any parsing or rendering happens.
+pub var active: *const Table = &generic;
+
+/// Returns the index of the first line feed in `bytes`, or `bytes.len` if there is none.
+pub fn indexOfNewline(bytes: []const u8) usize {
+    return active.index_of_newline(bytes.ptr, bytes.len);
+}
+
+/// Returns the index of the first byte in `bytes` that must be escaped in HTML, or `bytes.len` if there is none.
+pub fn indexOfHtmlSpecial(bytes: []const u8) usize {
+    return active.index_of_html_special(bytes.ptr, bytes.len);
+}
+
+/// Returns whether `bytes` is valid UTF-8.
+pub fn validateUtf8(bytes: []const u8) bool {
+    return active.validate_utf8(bytes.ptr, bytes.len);
+}
+
+/// Returns the kind of `line`, which must not contain the line terminator.
+pub fn classifyLine(line: []const u8) LineKind {
+    return active.classify_line(line.ptr, line.len);
+}
+
+/// The bytes that are replaced by entities when rendering HTML.
+pub const html_special = "<>&\"'";
+
+pub fn Kernels(comptime vector_len: usize) type {
+    return struct {
+        const Vector = @Vector(vector_len, u8);
+
+        pub fn table(tier: Tier) Table {
+            return Table{
+                .tier = tier,
+                .index_of_newline = indexOfNewlineC,
+                .index_of_html_special = indexOfHtmlSpecialC,
+                .validate_utf8 = validateUtf8C,
+                .classify_line = classifyLineC,
+            };
+        }
+
+        pub fn indexOfNewlineC(bytes: [*]const u8, len: usize) callconv(.C) usize {
+            return indexOfAny(bytes[0..len], "\n");
+        }
+
+        pub fn indexOfHtmlSpecialC(bytes: [*]const u8, len: usize) callconv(.C) usize {
+            return indexOfAny(bytes[0..len], html_special);
+        }
+
+        /// Skips ASCII in whole vectors and validates the remainder starting at the first
+        /// vector with a non-ASCII byte, which always starts on a code point boundary.
+        pub fn validateUtf8C(bytes: [*]const u8, len: usize) callconv(.C) bool {
+            var offset: usize = 0;
+            while (offset + vector_len <= len) : (offset += vector_len) {
+                const chunk: Vector = bytes[offset..][0..vector_len].*;
+                if (@reduce(.Or, chunk) & 0x80 != 0)
+                    break;
+            }
+            return std.unicode.utf8ValidateSlice(bytes[offset..len]);
+        }
+
+        pub fn classifyLineC(bytes: [*]const u8, len: usize) callconv(.C) LineKind {
+            return classify(bytes[0..len]);
+        }
+
+        fn indexOfAny(bytes: []const u8, comptime needles: []const u8) usize {
+            const zero: Vector = @splat(0);
+            const one: Vector = @splat(1);
+
+            var offset: usize = 0;
+            while (offset + vector_len <= bytes.len) : (offset += vector_len) {
+                const chunk: Vector = bytes[offset..][0..vector_len].*;
+
+                var hits = zero;
+                inline for (needles) |needle| {
+                    hits |= @select(u8, chunk == @as(Vector, @splat(needle)), one, zero);
+                }
+                if (std.simd.firstTrue(hits != zero)) |index|
+                    return offset + index;
+            }
+
+            while (offset < bytes.len) : (offset += 1) {
+                if (std.mem.indexOfScalar(u8, needles, bytes[offset]) != null)
+                    return offset;
+            }
+            return bytes.len;
+        }
+    };
+}
+
+/// Classification is done on at most three prefix bytes, so all tiers share the scalar version.
+fn classify(line: []const u8) LineKind {
+    if (line.len == 0)
+        return .text;
+    return switch (line[0]) {
+        '*' => if (line.len >= 2 and line[1] == ' ') .list else .text,
+        '>' => .quote,
+        '`' => if (std.mem.startsWith(u8, line, "```")) .preformatted_toggle else .text,
+        '=' => if (line.len >= 2 and line[1] == '>') .link else .text,
+        '#' => if (std.mem.startsWith(u8, line, "###"))
+            .heading_3
+        else if (std.mem.startsWith(u8, line, "##"))
+            .heading_2
+        else
+            .heading_1,
+        else => .text,
+    };
+}
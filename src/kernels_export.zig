@@ -0,0 +1,16 @@
+//! Root of the per-tier kernel objects linked into the C library.
+//! Each object is compiled for one x86-64 tier and exports its kernels
+//! under `gemtext_kernel_<tier>_<name>`, see `src/cpu_dispatch.zig`.
+
+const options = @import("kernel_options");
+const kernels = @import("kernels.zig");
+
+const impl = kernels.Kernels(options.vector_len);
+
+comptime {
+    const prefix = "gemtext_kernel_" ++ options.tier ++ "_";
+    @export(impl.indexOfNewlineC, .{ .name = prefix ++ "index_of_newline" });
+    @export(impl.indexOfHtmlSpecialC, .{ .name = prefix ++ "index_of_html_special" });
+    @export(impl.validateUtf8C, .{ .name = prefix ++ "validate_utf8" });
+    @export(impl.classifyLineC, .{ .name = prefix ++ "classify_line" });
+}
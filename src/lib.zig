@@ -1,22 +1,93 @@
 const std = @import("std");
 const gemini = @import("gemtext.zig");
+const cpu_dispatch = @import("cpu_dispatch.zig");
 
 const c = @cImport({
     @cInclude("gemtext.h");
 });
 
-const allocator = if (@import("builtin").is_test)
-    std.testing.allocator
-else
-    std.heap.c_allocator;
+/// Collects the metrics reported by `gemtextMetricsWrite`.
+var metrics = gemini.Metrics{};
+
+var counting_allocator = gemini.Metrics.CountingAllocator{
+    .child = if (@import("builtin").is_test)
+        std.testing.allocator
+    else
+        std.heap.c_allocator,
+    .metrics = &metrics,
+};
+
+/// The allocator used when the caller doesn't pass a `gemtext_allocator`.
+/// Its allocations are counted in `metrics`.
+const default_allocator = counting_allocator.allocator();
+
+/// Starts measuring a duration for `metrics`. Returns `null` if there is no monotonic clock.
+fn startTimer() ?std.time.Timer {
+    return std.time.Timer.start() catch null;
+}
+
+/// Returns the allocator for `raw`, or the default allocator if `raw` is `null`.
+/// `raw` must stay valid as long as the returned allocator is used.
+fn wrapAllocator(raw: ?*const c.gemtext_allocator) std.mem.Allocator {
+    const callbacks = raw orelse return default_allocator;
+    return std.mem.Allocator{
+        .ptr = @constCast(callbacks),
+        .vtable = &CAllocator.vtable,
+    };
+}
+
+/// Forwards allocations to the callbacks of a `gemtext_allocator`.
+const CAllocator = struct {
+    const vtable = std.mem.Allocator.VTable{
+        .alloc = alloc,
+        .resize = resize,
+        .free = free,
+    };
+
+    fn get(ctx: *anyopaque) *const c.gemtext_allocator {
+        return @ptrCast(@alignCast(ctx));
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, ptr_align: u8, ret_addr: usize) ?[*]u8 {
+        _ = ret_addr;
+        const raw = get(ctx);
+        const memory = raw.alloc.?(raw.context, len, @as(usize, 1) << @intCast(ptr_align)) orelse return null;
+        return @ptrCast(memory);
+    }
+
+    fn resize(ctx: *anyopaque, buf: []u8, buf_align: u8, new_len: usize, ret_addr: usize) bool {
+        // The callbacks can't resize in place, and `free` must be called with the
+        // allocated size, so even shrinking makes the caller copy to a new allocation.
+        _ = ctx;
+        _ = buf;
+        _ = buf_align;
+        _ = new_len;
+        _ = ret_addr;
+        return false;
+    }
+
+    fn free(ctx: *anyopaque, buf: []u8, buf_align: u8, ret_addr: usize) void {
+        _ = ret_addr;
+        const raw = get(ctx);
+        raw.free.?(raw.context, buf.ptr, buf.len, @as(usize, 1) << @intCast(buf_align));
+    }
+};
 
 const Error = error{
     OutOfMemory,
+    LineTooLong,
+    BlockTooLarge,
+    TooManyFragments,
+    DocumentTooLarge,
 };
 
 fn errorToC(err: Error) c.gemtext_error {
     return switch (err) {
         error.OutOfMemory => return c.GEMTEXT_ERR_OUT_OF_MEMORY,
+        error.LineTooLong => return c.GEMTEXT_ERR_LINE_TOO_LONG,
+        error.BlockTooLarge => return c.GEMTEXT_ERR_BLOCK_TOO_LARGE,
+        error.TooManyFragments => return c.GEMTEXT_ERR_TOO_MANY_FRAGMENTS,
+        error.DocumentTooLarge => return c.GEMTEXT_ERR_DOCUMENT_TOO_LARGE,
     };
 }
 
@@ -38,15 +109,15 @@ fn setFragments(document: *c.gemtext_document, slice: []c.gemtext_fragment) void
     document.fragments = slice.ptr;
 }
 
-fn dupeString(src: [*:0]const u8) ![*:0]u8 {
+fn dupeString(allocator: std.mem.Allocator, src: [*:0]const u8) ![*:0]u8 {
     return (try allocator.dupeZ(u8, std.mem.span(src))).ptr;
 }
 
-fn freeString(src: [*:0]const u8) void {
+fn freeString(allocator: std.mem.Allocator, src: [*:0]const u8) void {
     allocator.free(std.mem.sliceTo(@as([*:0]u8, @ptrFromInt(@intFromPtr(src))), 0));
 }
 
-fn dupeLines(src_lines: c.gemtext_lines) !c.gemtext_lines {
+fn dupeLines(allocator: std.mem.Allocator, src_lines: c.gemtext_lines) !c.gemtext_lines {
     const lines = try allocator.alloc([*c]const u8, src_lines.count);
     errdefer allocator.free(lines);
 
@@ -63,13 +134,13 @@ fn dupeLines(src_lines: c.gemtext_lines) !c.gemtext_lines {
     };
 }
 
-fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
+fn duplicateFragment(allocator: std.mem.Allocator, src: c.gemtext_fragment) !c.gemtext_fragment {
     return switch (src.type) {
         c.GEMTEXT_FRAGMENT_EMPTY => return src,
         c.GEMTEXT_FRAGMENT_PARAGRAPH => c.gemtext_fragment{
             .type = c.GEMTEXT_FRAGMENT_PARAGRAPH,
             .unnamed_0 = .{
-                .paragraph = try dupeString(src.unnamed_0.paragraph),
+                .paragraph = try dupeString(allocator, src.unnamed_0.paragraph),
             },
         },
         c.GEMTEXT_FRAGMENT_PREFORMATTED => blk: {
@@ -83,11 +154,11 @@ fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
                 },
             };
 
-            container.unnamed_0.preformatted.lines = try dupeLines(src.unnamed_0.preformatted.lines);
-            errdefer destroyLines(&container.unnamed_0.preformatted.lines);
+            container.unnamed_0.preformatted.lines = try dupeLines(allocator, src.unnamed_0.preformatted.lines);
+            errdefer destroyLines(allocator, &container.unnamed_0.preformatted.lines);
 
             container.unnamed_0.preformatted.alt_text = if (src.unnamed_0.preformatted.alt_text) |alt_text|
-                try dupeString(alt_text)
+                try dupeString(allocator, alt_text)
             else
                 null;
 
@@ -96,7 +167,7 @@ fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
         c.GEMTEXT_FRAGMENT_QUOTE => c.gemtext_fragment{
             .type = c.GEMTEXT_FRAGMENT_QUOTE,
             .unnamed_0 = .{
-                .quote = try dupeLines(src.unnamed_0.quote),
+                .quote = try dupeLines(allocator, src.unnamed_0.quote),
             },
         },
         c.GEMTEXT_FRAGMENT_LINK => blk: {
@@ -110,11 +181,11 @@ fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
                 },
             };
 
-            container.unnamed_0.link.href = try dupeString(src.unnamed_0.link.href);
-            errdefer freeString(container.unnamed_0.link.href);
+            container.unnamed_0.link.href = try dupeString(allocator, src.unnamed_0.link.href);
+            errdefer freeString(allocator, container.unnamed_0.link.href);
 
             container.unnamed_0.link.title = if (src.unnamed_0.link.title) |title|
-                try dupeString(title)
+                try dupeString(allocator, title)
             else
                 null;
 
@@ -123,7 +194,7 @@ fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
         c.GEMTEXT_FRAGMENT_LIST => c.gemtext_fragment{
             .type = c.GEMTEXT_FRAGMENT_LIST,
             .unnamed_0 = .{
-                .list = try dupeLines(src.unnamed_0.list),
+                .list = try dupeLines(allocator, src.unnamed_0.list),
             },
         },
         c.GEMTEXT_FRAGMENT_HEADING => c.gemtext_fragment{
@@ -131,7 +202,7 @@ fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
             .unnamed_0 = .{
                 .heading = .{
                     .level = src.unnamed_0.heading.level,
-                    .text = try dupeString(src.unnamed_0.paragraph),
+                    .text = try dupeString(allocator, src.unnamed_0.paragraph),
                 },
             },
         },
@@ -139,7 +210,7 @@ fn duplicateFragment(src: c.gemtext_fragment) !c.gemtext_fragment {
     };
 }
 
-fn destroyLines(src_lines: *c.gemtext_lines) void {
+fn destroyLines(allocator: std.mem.Allocator, src_lines: *c.gemtext_lines) void {
     if (src_lines.count > 0) {
         const lines = src_lines.lines[0..src_lines.count];
         for (lines) |line| {
@@ -149,35 +220,40 @@ fn destroyLines(src_lines: *c.gemtext_lines) void {
     }
 }
 
-fn destroyFragment(fragment: *c.gemtext_fragment) void {
+fn destroyFragment(allocator: std.mem.Allocator, fragment: *c.gemtext_fragment) void {
     switch (fragment.type) {
         c.GEMTEXT_FRAGMENT_EMPTY => {},
-        c.GEMTEXT_FRAGMENT_PARAGRAPH => freeString(fragment.unnamed_0.paragraph),
+        c.GEMTEXT_FRAGMENT_PARAGRAPH => freeString(allocator, fragment.unnamed_0.paragraph),
         c.GEMTEXT_FRAGMENT_PREFORMATTED => {
             if (fragment.unnamed_0.preformatted.alt_text) |alt|
-                freeString(alt);
-            destroyLines(&fragment.unnamed_0.preformatted.lines);
+                freeString(allocator, alt);
+            destroyLines(allocator, &fragment.unnamed_0.preformatted.lines);
         },
-        c.GEMTEXT_FRAGMENT_QUOTE => destroyLines(&fragment.unnamed_0.quote),
+        c.GEMTEXT_FRAGMENT_QUOTE => destroyLines(allocator, &fragment.unnamed_0.quote),
         c.GEMTEXT_FRAGMENT_LINK => {
             if (fragment.unnamed_0.link.title) |title|
-                freeString(title);
-            freeString(fragment.unnamed_0.link.href);
+                freeString(allocator, title);
+            freeString(allocator, fragment.unnamed_0.link.href);
         },
-        c.GEMTEXT_FRAGMENT_LIST => destroyLines(&fragment.unnamed_0.list),
-        c.GEMTEXT_FRAGMENT_HEADING => freeString(fragment.unnamed_0.heading.text),
+        c.GEMTEXT_FRAGMENT_LIST => destroyLines(allocator, &fragment.unnamed_0.list),
+        c.GEMTEXT_FRAGMENT_HEADING => freeString(allocator, fragment.unnamed_0.heading.text),
         else => @panic("Passed an invalid fragment to gemtext!"),
     }
     fragment.* = undefined;
 }
 
 export fn gemtextDocumentCreate(document: *c.gemtext_document) c.gemtext_error {
+    return gemtextDocumentCreateWithAllocator(document, null);
+}
+
+export fn gemtextDocumentCreateWithAllocator(document: *c.gemtext_document, raw_allocator: ?*const c.gemtext_allocator) c.gemtext_error {
     document.* = .{
         .fragment_count = undefined,
         .fragments = undefined,
+        .allocator = raw_allocator,
     };
 
-    setFragments(document, allocator.alloc(c.gemtext_fragment, 0) catch |e| return errorToC(e));
+    setFragments(document, wrapAllocator(raw_allocator).alloc(c.gemtext_fragment, 0) catch |e| return errorToC(e));
 
     return c.GEMTEXT_SUCCESS;
 }
@@ -203,10 +279,12 @@ export fn gemtextDocumentInsert(document: *c.gemtext_document, index: usize, fra
     if (index > fragments.len)
         return c.GEMTEXT_ERR_OUT_OF_BOUNDS;
 
-    var fragment_dupe = duplicateFragment(fragment.*) catch |e| return errorToC(e);
+    const allocator = wrapAllocator(document.allocator);
+
+    var fragment_dupe = duplicateFragment(allocator, fragment.*) catch |e| return errorToC(e);
 
     fragments = allocator.realloc(fragments, fragments.len + 1) catch |e| {
-        destroyFragment(&fragment_dupe);
+        destroyFragment(allocator, &fragment_dupe);
         return errorToC(e);
     };
 
@@ -235,7 +313,9 @@ export fn gemtextDocumentRemove(document: *c.gemtext_document, index: usize) voi
     if (index > fragments.len)
         return;
 
-    destroyFragment(&fragments[index]);
+    const allocator = wrapAllocator(document.allocator);
+
+    destroyFragment(allocator, &fragments[index]);
 
     const shift_count = document.fragment_count - index;
     if (shift_count > 0) {
@@ -252,17 +332,24 @@ export fn gemtextDocumentRemove(document: *c.gemtext_document, index: usize) voi
 }
 
 export fn gemtextDocumentDestroy(document: *c.gemtext_document) void {
+    const allocator = wrapAllocator(document.allocator);
     const fragments = getFragments(document);
     for (fragments) |*frag| {
-        destroyFragment(frag);
+        destroyFragment(allocator, frag);
     }
     allocator.free(fragments);
     document.* = undefined;
 }
 
 export fn gemtextParserCreate(raw_parser: *c.gemtext_parser) c.gemtext_error {
+    return gemtextParserCreateWithAllocator(raw_parser, null);
+}
+
+export fn gemtextParserCreateWithAllocator(raw_parser: *c.gemtext_parser, raw_allocator: ?*const c.gemtext_allocator) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
     const parser: *gemini.Parser = @ptrCast(raw_parser);
-    parser.* = gemini.Parser.init(allocator);
+    parser.* = gemini.Parser.init(wrapAllocator(raw_allocator));
     return c.GEMTEXT_SUCCESS;
 }
 
@@ -272,6 +359,58 @@ export fn gemtextParserDestroy(raw_parser: *c.gemtext_parser) void {
     raw_parser.* = undefined;
 }
 
+export fn gemtextParserSetLimits(raw_parser: *c.gemtext_parser, limits: *const c.gemtext_parser_limits) void {
+    const parser: *gemini.Parser = @ptrCast(raw_parser);
+
+    const unbounded = struct {
+        fn f(value: usize) usize {
+            return if (value == 0) std.math.maxInt(usize) else value;
+        }
+    }.f;
+
+    parser.limits = gemini.Parser.Limits{
+        .max_line_length = unbounded(limits.max_line_length),
+        .max_block_lines = unbounded(limits.max_block_lines),
+        .max_block_bytes = unbounded(limits.max_block_bytes),
+        .max_fragments = unbounded(limits.max_fragments),
+        .max_total_bytes = unbounded(limits.max_total_bytes),
+    };
+}
+
+export fn gemtextParserSnapshot(
+    raw_parser: *c.gemtext_parser,
+    context: ?*anyopaque,
+    write: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
+) c.gemtext_error {
+    const parser: *gemini.Parser = @ptrCast(raw_parser);
+
+    const stream = CStream{
+        .context = context,
+        .render = write,
+    };
+    parser.snapshot(stream.writer()) catch unreachable; // CStream can't fail
+
+    return c.GEMTEXT_SUCCESS;
+}
+
+export fn gemtextParserRestore(
+    raw_parser: *c.gemtext_parser,
+    bytes: [*]const u8,
+    length: usize,
+) c.gemtext_error {
+    const parser: *gemini.Parser = @ptrCast(raw_parser);
+
+    var stream = std.io.fixedBufferStream(bytes[0..length]);
+    parser.restore(stream.reader()) catch |err| return switch (err) {
+        error.OutOfMemory => c.GEMTEXT_ERR_OUT_OF_MEMORY,
+        error.LineTooLong => c.GEMTEXT_ERR_LINE_TOO_LONG,
+        error.BlockTooLarge => c.GEMTEXT_ERR_BLOCK_TOO_LARGE,
+        else => c.GEMTEXT_ERR_INVALID_SNAPSHOT,
+    };
+
+    return c.GEMTEXT_SUCCESS;
+}
+
 fn ensureCString(str: [*:0]const u8) [*:0]const u8 {
     return str;
 }
@@ -279,7 +418,7 @@ fn ensureCString(str: [*:0]const u8) [*:0]const u8 {
 /// Converts a TextLines element to a c.gemtext_lines and destroys
 /// the `.lines` array of TextLines on the way. If the conversion fails,
 /// the `.lines` is kept alive.
-fn convertTextLinesToC(src_lines: *gemini.TextLines) !c.gemtext_lines {
+fn convertTextLinesToC(allocator: std.mem.Allocator, src_lines: *gemini.TextLines) !c.gemtext_lines {
     const lines = try allocator.alloc([*:0]const u8, src_lines.lines.len);
     for (lines, 0..) |*line, i| {
         line.* = src_lines.lines[i].ptr;
@@ -294,7 +433,7 @@ fn convertTextLinesToC(src_lines: *gemini.TextLines) !c.gemtext_lines {
     };
 }
 
-fn convertFragmentToC(fragment: *gemini.Fragment) !c.gemtext_fragment {
+fn convertFragmentToC(allocator: std.mem.Allocator, fragment: *gemini.Fragment) !c.gemtext_fragment {
     return switch (fragment.*) {
         .empty => c.gemtext_fragment{
             .type = c.GEMTEXT_FRAGMENT_EMPTY,
@@ -314,14 +453,14 @@ fn convertFragmentToC(fragment: *gemini.Fragment) !c.gemtext_fragment {
                         ensureCString(alt_text.ptr)
                     else
                         null,
-                    .lines = try convertTextLinesToC(&preformatted.text),
+                    .lines = try convertTextLinesToC(allocator, &preformatted.text),
                 },
             },
         },
         .quote => |*quote| c.gemtext_fragment{
             .type = c.GEMTEXT_FRAGMENT_QUOTE,
             .unnamed_0 = .{
-                .quote = try convertTextLinesToC(quote),
+                .quote = try convertTextLinesToC(allocator, quote),
             },
         },
         .link => |link| c.gemtext_fragment{
@@ -339,7 +478,7 @@ fn convertFragmentToC(fragment: *gemini.Fragment) !c.gemtext_fragment {
         .list => |*list| c.gemtext_fragment{
             .type = c.GEMTEXT_FRAGMENT_LIST,
             .unnamed_0 = .{
-                .list = try convertTextLinesToC(list),
+                .list = try convertTextLinesToC(allocator, list),
             },
         },
         .heading => |heading| c.gemtext_fragment{
@@ -368,13 +507,16 @@ export fn gemtextParserFeed(
     const parser: *gemini.Parser = @ptrCast(raw_parser);
 
     const input_slice = bytes[0..total_bytes];
-    var result = parser.feed(allocator, input_slice) catch |e| return errorToC(e);
+    var result = parser.feed(parser.allocator, input_slice) catch |e| return errorToC(e);
+
+    metrics.countParsed(result.consumed);
 
     consumed_bytes.* = result.consumed;
     if (result.fragment) |*fragment| {
-        // as we used c_allocator, we can just return a "flat" copy of the gemini.Fragment here
-        out_fragment.* = convertFragmentToC(fragment) catch |e| {
-            fragment.free(allocator);
+        metrics.countFragment(std.meta.activeTag(fragment.*));
+        // as the fragment uses the parser allocator, we can just return a "flat" copy of the gemini.Fragment here
+        out_fragment.* = convertFragmentToC(parser.allocator, fragment) catch |e| {
+            fragment.free(parser.allocator);
             return errorToC(e);
         };
         return c.GEMTEXT_SUCCESS_FRAGMENT;
@@ -390,12 +532,13 @@ export fn gemtextParserFinalize(
 ) c.gemtext_error {
     const parser: *gemini.Parser = @ptrCast(raw_parser);
 
-    var result = parser.finalize(allocator) catch |e| return errorToC(e);
+    var result = parser.finalize(parser.allocator) catch |e| return errorToC(e);
 
     if (result) |*fragment| {
-        // as we used c_allocator, we can just return a "flat" copy of the gemini.Fragment here
-        out_fragment.* = convertFragmentToC(fragment) catch |e| {
-            fragment.free(allocator);
+        metrics.countFragment(std.meta.activeTag(fragment.*));
+        // as the fragment uses the parser allocator, we can just return a "flat" copy of the gemini.Fragment here
+        out_fragment.* = convertFragmentToC(parser.allocator, fragment) catch |e| {
+            fragment.free(parser.allocator);
             return errorToC(e);
         };
         return c.GEMTEXT_SUCCESS_FRAGMENT;
@@ -406,11 +549,11 @@ export fn gemtextParserFinalize(
 }
 
 export fn gemtextParserDestroyFragment(
-    parser: *c.gemtext_parser,
+    raw_parser: *c.gemtext_parser,
     fragment: *c.gemtext_fragment,
 ) void {
-    _ = parser; // we ignore the parser for this, it's just here for future safety
-    destroyFragment(fragment);
+    const parser: *gemini.Parser = @ptrCast(raw_parser);
+    destroyFragment(parser.allocator, fragment);
 }
 
 const CStream = struct {
@@ -432,7 +575,7 @@ const CStream = struct {
     }
 };
 
-fn convertTextLinesToZig(src_lines: c.gemtext_lines) !gemini.TextLines {
+fn convertTextLinesToZig(allocator: std.mem.Allocator, src_lines: c.gemtext_lines) !gemini.TextLines {
     var lines = try allocator.alloc([:0]const u8, src_lines.count);
     errdefer allocator.free(lines);
 
@@ -450,7 +593,7 @@ fn convertTextLinesToZig(src_lines: c.gemtext_lines) !gemini.TextLines {
     };
 }
 
-fn convertFragmentToZig(src_fragment: c.gemtext_fragment) !gemini.Fragment {
+fn convertFragmentToZig(allocator: std.mem.Allocator, src_fragment: c.gemtext_fragment) !gemini.Fragment {
     return switch (src_fragment.type) {
         c.GEMTEXT_FRAGMENT_EMPTY => gemini.Fragment{ .empty = {} },
         c.GEMTEXT_FRAGMENT_PARAGRAPH => gemini.Fragment{
@@ -464,17 +607,17 @@ fn convertFragmentToZig(src_fragment: c.gemtext_fragment) !gemini.Fragment {
                 else
                     null,
             };
-            defer if (pre.alt_text) |alt_text|
+            errdefer if (pre.alt_text) |alt_text|
                 allocator.free(alt_text);
 
-            pre.text = try convertTextLinesToZig(src_fragment.unnamed_0.preformatted.lines);
+            pre.text = try convertTextLinesToZig(allocator, src_fragment.unnamed_0.preformatted.lines);
 
             break :blk gemini.Fragment{
                 .preformatted = pre,
             };
         },
         c.GEMTEXT_FRAGMENT_QUOTE => gemini.Fragment{
-            .quote = try convertTextLinesToZig(src_fragment.unnamed_0.quote),
+            .quote = try convertTextLinesToZig(allocator, src_fragment.unnamed_0.quote),
         },
         c.GEMTEXT_FRAGMENT_LINK => blk: {
             var link = gemini.Link{
@@ -491,7 +634,7 @@ fn convertFragmentToZig(src_fragment: c.gemtext_fragment) !gemini.Fragment {
             break :blk gemini.Fragment{ .link = link };
         },
         c.GEMTEXT_FRAGMENT_LIST => gemini.Fragment{
-            .list = try convertTextLinesToZig(src_fragment.unnamed_0.list),
+            .list = try convertTextLinesToZig(allocator, src_fragment.unnamed_0.list),
         },
         c.GEMTEXT_FRAGMENT_HEADING => gemini.Fragment{
             .heading = .{
@@ -508,6 +651,29 @@ fn convertFragmentToZig(src_fragment: c.gemtext_fragment) !gemini.Fragment {
     };
 }
 
+fn formatFromC(renderer: c.gemtext_renderer) gemini.renderer.Format {
+    return switch (renderer) {
+        c.GEMTEXT_RENDER_GEMTEXT => .gemtext,
+        c.GEMTEXT_RENDER_HTML => .html,
+        c.GEMTEXT_RENDER_MARKDOWN => .markdown,
+        c.GEMTEXT_RENDER_RTF => .rtf,
+        else => @panic("invalid renderer passed to gemtext!"),
+    };
+}
+
+fn renderFragments(format: gemini.renderer.Format, raw_fragments: []const c.gemtext_fragment, writer: anytype) !void {
+    for (raw_fragments) |raw_fragment| {
+        // Each fragment is converted in a fresh stack buffer, so rendering usually doesn't touch the heap.
+        var fallback = std.heap.stackFallback(4096, default_allocator);
+        const allocator = fallback.get();
+
+        var fragment = try convertFragmentToZig(allocator, raw_fragment);
+        defer fragment.free(allocator);
+
+        try gemini.renderer.render(format, &[_]gemini.Fragment{fragment}, writer);
+    }
+}
+
 export fn gemtextRender(
     renderer: c.gemtext_renderer,
     raw_fragments: [*]const c.gemtext_fragment,
@@ -515,6 +681,8 @@ export fn gemtextRender(
     context: ?*anyopaque,
     render: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
 ) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
     var stream = CStream{
         .context = context,
         .render = render,
@@ -522,28 +690,440 @@ export fn gemtextRender(
     if (fragment_count == 0)
         return c.GEMTEXT_SUCCESS;
 
-    for (raw_fragments[0..fragment_count]) |raw_fragment| {
-        var fragment = convertFragmentToZig(raw_fragment) catch |e| return errorToC(e);
-        defer fragment.free(allocator);
+    const format = formatFromC(renderer);
+    var timer = startTimer();
+
+    // The renderers emit many tiny writes, so batch them into fewer, larger callbacks.
+    var counting = std.io.countingWriter(stream.writer());
+    var buffered = std.io.bufferedWriter(counting.writer());
+    renderFragments(format, raw_fragments[0..fragment_count], buffered.writer()) catch |e| return errorToC(e);
+    buffered.flush() catch unreachable; // CStream can't fail
+
+    if (timer) |*t|
+        metrics.observeRender(format, counting.bytes_written, t.read());
+
+    return c.GEMTEXT_SUCCESS;
+}
+
+const Compressed = gemini.renderer.compressed;
+
+fn levelFromC(level: c_int) ?Compressed.Level {
+    return switch (level) {
+        0 => .default,
+        1...4 => .fast,
+        5...9 => @enumFromInt(@as(u4, @intCast(level))),
+        else => null,
+    };
+}
+
+/// Renders `fragments` through a compressor into `writer` and returns the number of uncompressed bytes.
+fn renderCompressed(
+    comptime container: Compressed.Container,
+    format: gemini.renderer.Format,
+    level: Compressed.Level,
+    fragments: []const c.gemtext_fragment,
+    writer: anytype,
+) !u64 {
+    const stream = try Compressed.create(default_allocator, container, writer, level);
+    defer default_allocator.destroy(stream);
+
+    var counting = std.io.countingWriter(stream.writer());
+    try renderFragments(format, fragments, counting.writer());
+    try stream.finish();
+
+    return counting.bytes_written;
+}
+
+export fn gemtextRenderCompressed(
+    renderer: c.gemtext_renderer,
+    compression: c.gemtext_compression,
+    level: c_int,
+    raw_fragments: [*]const c.gemtext_fragment,
+    fragment_count: usize,
+    context: ?*anyopaque,
+    render: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
+) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
+    const container: Compressed.Container = switch (compression) {
+        c.GEMTEXT_COMPRESSION_GZIP => .gzip,
+        c.GEMTEXT_COMPRESSION_ZLIB => .zlib,
+        c.GEMTEXT_COMPRESSION_DEFLATE => .deflate,
+        else => return c.GEMTEXT_ERR_UNSUPPORTED,
+    };
+    const compression_level = levelFromC(level) orelse return c.GEMTEXT_ERR_UNSUPPORTED;
+
+    const stream = CStream{
+        .context = context,
+        .render = render,
+    };
+
+    const format = formatFromC(renderer);
+    const fragments = raw_fragments[0..fragment_count];
+    var timer = startTimer();
+
+    var buffered = std.io.bufferedWriter(stream.writer());
+    const bytes = switch (container) {
+        inline else => |tag| renderCompressed(tag, format, compression_level, fragments, buffered.writer()),
+    } catch |e| return errorToC(e);
+    buffered.flush() catch unreachable; // CStream can't fail
+
+    if (timer) |*t|
+        metrics.observeRender(format, bytes, t.read());
+
+    return c.GEMTEXT_SUCCESS;
+}
+
+/// The pool behind a `gemtext_render_pool`.
+const RenderPool = struct {
+    threads: gemini.ThreadPool,
+    split_fragments: usize,
+};
+
+fn getRenderPool(raw_pool: *c.gemtext_render_pool) *RenderPool {
+    return @ptrCast(@alignCast(raw_pool));
+}
+
+/// A render submitted with `gemtextRenderAsync`.
+/// Documents with many fragments are split into ranges that are rendered into
+/// separate buffers by separate tasks. The task that finishes last passes the
+/// buffers to the callback in order. An unsplit document is rendered straight
+/// into the callback like in `gemtextRender`.
+const AsyncRender = struct {
+    format: gemini.renderer.Format,
+    context: ?*anyopaque,
+    render: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
+    on_done: *const fn (ctx: ?*anyopaque, result: c.gemtext_error) callconv(.C) void,
+    ranges: []Range,
+    remaining: std.atomic.Value(usize),
+    /// The summed render time of all ranges.
+    render_ns: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+
+    const Range = struct {
+        task: gemini.ThreadPool.Task = .{ .run = run },
+        job: *AsyncRender,
+        fragments: []const c.gemtext_fragment,
+        output: std.ArrayListUnmanaged(u8) = .{},
+        bytes: usize = 0,
+        result: c.gemtext_error = c.GEMTEXT_SUCCESS,
+
+        fn run(task: *gemini.ThreadPool.Task) void {
+            const self = @fieldParentPtr(Range, "task", task);
+            const job = self.job;
+
+            var timer = startTimer();
+            if (job.ranges.len == 1) {
+                const stream = CStream{
+                    .context = job.context,
+                    .render = job.render,
+                };
+                var counting = std.io.countingWriter(stream.writer());
+                var buffered = std.io.bufferedWriter(counting.writer());
+                renderFragments(job.format, self.fragments, buffered.writer()) catch |e| {
+                    self.result = errorToC(e);
+                };
+                buffered.flush() catch unreachable; // CStream can't fail
+                self.bytes = counting.bytes_written;
+            } else {
+                renderFragments(job.format, self.fragments, self.output.writer(default_allocator)) catch |e| {
+                    self.result = errorToC(e);
+                };
+                self.bytes = self.output.items.len;
+            }
+            if (timer) |*t|
+                _ = job.render_ns.fetchAdd(t.read(), .monotonic);
+
+            if (job.remaining.fetchSub(1, .acq_rel) == 1)
+                job.finish();
+        }
+    };
+
+    fn finish(self: *AsyncRender) void {
+        var result: c.gemtext_error = c.GEMTEXT_SUCCESS;
+        var bytes: usize = 0;
+        for (self.ranges) |range| {
+            if (range.result != c.GEMTEXT_SUCCESS) {
+                result = range.result;
+                break;
+            }
+            bytes += range.bytes;
+        }
+
+        if (result == c.GEMTEXT_SUCCESS) {
+            if (self.ranges.len > 1) {
+                for (self.ranges) |range| {
+                    if (range.output.items.len > 0)
+                        self.render(self.context, range.output.items.ptr, range.output.items.len);
+                }
+            }
+            metrics.observeRender(self.format, bytes, self.render_ns.load(.monotonic));
+        }
+
+        const on_done = self.on_done;
+        const context = self.context;
+        self.destroy();
 
-        const fragments = &[_]gemini.Fragment{fragment};
+        on_done(context, result);
+    }
 
-        switch (renderer) {
-            c.GEMTEXT_RENDER_GEMTEXT => gemini.renderer.gemtext(fragments, stream.writer()) catch unreachable,
-            c.GEMTEXT_RENDER_HTML => gemini.renderer.html(fragments, stream.writer()) catch unreachable,
-            c.GEMTEXT_RENDER_MARKDOWN => gemini.renderer.markdown(fragments, stream.writer()) catch unreachable,
-            c.GEMTEXT_RENDER_RTF => gemini.renderer.rtf(fragments, stream.writer()) catch unreachable,
-            else => @panic("invalid renderer passed to gemtextRender!"),
+    fn destroy(self: *AsyncRender) void {
+        for (self.ranges) |*range| {
+            range.output.deinit(default_allocator);
         }
+        default_allocator.free(self.ranges);
+        default_allocator.destroy(self);
+    }
+};
+
+export fn gemtextRenderPoolCreate(out_pool: **c.gemtext_render_pool, raw_options: ?*const c.gemtext_render_pool_options) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
+    const options = if (raw_options) |options| options.* else std.mem.zeroes(c.gemtext_render_pool_options);
+
+    const pool = default_allocator.create(RenderPool) catch |e| return errorToC(e);
+    pool.split_fragments = options.split_fragments;
+    pool.threads.init(default_allocator, .{
+        .thread_count = options.thread_count,
+        .pin_threads = (options.pin_threads != 0),
+    }) catch |err| {
+        default_allocator.destroy(pool);
+        return switch (err) {
+            error.OutOfMemory => c.GEMTEXT_ERR_OUT_OF_MEMORY,
+            else => c.GEMTEXT_ERR_SYSTEM_RESOURCES,
+        };
+    };
+    out_pool.* = @ptrCast(pool);
+    return c.GEMTEXT_SUCCESS;
+}
+
+export fn gemtextRenderPoolDestroy(raw_pool: *c.gemtext_render_pool) void {
+    const pool = getRenderPool(raw_pool);
+    pool.threads.deinit();
+    default_allocator.destroy(pool);
+}
+
+export fn gemtextRenderAsync(
+    raw_pool: *c.gemtext_render_pool,
+    renderer: c.gemtext_renderer,
+    raw_fragments: [*]const c.gemtext_fragment,
+    fragment_count: usize,
+    context: ?*anyopaque,
+    render: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
+    on_done: *const fn (ctx: ?*anyopaque, result: c.gemtext_error) callconv(.C) void,
+) c.gemtext_error {
+    const pool = getRenderPool(raw_pool);
+    const fragments = raw_fragments[0..fragment_count];
+
+    // Split into ranges of at least `split_fragments`, but no more than a few per worker,
+    // so idle workers can steal some of them.
+    var range_count: usize = 1;
+    if (pool.split_fragments > 0 and fragments.len > pool.split_fragments) {
+        const max_ranges = 4 * pool.threads.workers.len;
+        range_count = @min(max_ranges, std.math.divCeil(usize, fragments.len, pool.split_fragments) catch unreachable);
+    }
+    const range_length = std.math.divCeil(usize, fragments.len, range_count) catch unreachable;
+
+    const job = default_allocator.create(AsyncRender) catch |e| return errorToC(e);
+    job.* = AsyncRender{
+        .format = formatFromC(renderer),
+        .context = context,
+        .render = render,
+        .on_done = on_done,
+        .ranges = default_allocator.alloc(AsyncRender.Range, range_count) catch |e| {
+            default_allocator.destroy(job);
+            return errorToC(e);
+        },
+        .remaining = std.atomic.Value(usize).init(range_count),
+    };
+
+    for (job.ranges, 0..) |*range, index| {
+        const start = @min(fragments.len, index * range_length);
+        const end = @min(fragments.len, start + range_length);
+        range.* = AsyncRender.Range{
+            .job = job,
+            .fragments = fragments[start..end],
+        };
+    }
+    for (job.ranges) |*range| {
+        pool.threads.spawn(&range.task);
     }
 
     return c.GEMTEXT_SUCCESS;
 }
 
+fn getRenderCache(raw_cache: *c.gemtext_render_cache) *gemini.RenderCache {
+    return @ptrCast(@alignCast(raw_cache));
+}
+
+export fn gemtextRenderCacheCreate(out_cache: **c.gemtext_render_cache, byte_budget: usize) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
+    const cache = default_allocator.create(gemini.RenderCache) catch |e| return errorToC(e);
+    cache.* = gemini.RenderCache.init(default_allocator, .{ .byte_budget = byte_budget, .metrics = &metrics }) catch |e| {
+        default_allocator.destroy(cache);
+        return errorToC(e);
+    };
+    out_cache.* = @ptrCast(cache);
+    return c.GEMTEXT_SUCCESS;
+}
+
+export fn gemtextRenderCacheDestroy(raw_cache: *c.gemtext_render_cache) void {
+    const cache = getRenderCache(raw_cache);
+    cache.deinit();
+    default_allocator.destroy(cache);
+}
+
+/// Loads a document through the C callback when the render cache misses.
+const CacheSource = struct {
+    context: ?*anyopaque,
+    load: *const fn (ctx: ?*anyopaque, document: *c.gemtext_document) callconv(.C) c.gemtext_error,
+    load_error: c.gemtext_error,
+
+    pub fn render(self: *CacheSource, format: gemini.renderer.Format, writer: anytype) !void {
+        var document: c.gemtext_document = undefined;
+        self.load_error = self.load(self.context, &document);
+        if (self.load_error != c.GEMTEXT_SUCCESS)
+            return error.LoadFailed;
+        defer c.gemtextDocumentDestroy(&document);
+
+        const start_len = writer.context.items.len;
+        var timer = startTimer();
+
+        try renderFragments(format, getFragments(&document), writer);
+
+        if (timer) |*t|
+            metrics.observeRender(format, writer.context.items.len - start_len, t.read());
+    }
+};
+
+export fn gemtextRenderCacheRender(
+    raw_cache: *c.gemtext_render_cache,
+    renderer: c.gemtext_renderer,
+    source: [*:0]const u8,
+    version: u64,
+    load_context: ?*anyopaque,
+    load: *const fn (ctx: ?*anyopaque, document: *c.gemtext_document) callconv(.C) c.gemtext_error,
+    context: ?*anyopaque,
+    render: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
+) c.gemtext_error {
+    const cache = getRenderCache(raw_cache);
+
+    var cache_source = CacheSource{
+        .context = load_context,
+        .load = load,
+        .load_error = c.GEMTEXT_SUCCESS,
+    };
+
+    const key = gemini.RenderCache.Key{
+        .source = std.mem.span(source),
+        .version = version,
+        .format = formatFromC(renderer),
+    };
+
+    const page = cache.get(key, &cache_source) catch |err| switch (err) {
+        error.LoadFailed => return cache_source.load_error,
+        else => |e| return errorToC(e),
+    };
+    defer page.release();
+
+    if (page.bytes.len > 0)
+        render(context, page.bytes.ptr, page.bytes.len);
+
+    return c.GEMTEXT_SUCCESS;
+}
+
+export fn gemtextRenderCacheInvalidate(raw_cache: *c.gemtext_render_cache, source: [*:0]const u8) void {
+    getRenderCache(raw_cache).invalidate(std.mem.span(source));
+}
+
+export fn gemtextRenderCacheGetStats(raw_cache: *c.gemtext_render_cache, out_stats: *c.gemtext_render_cache_stats) void {
+    const stats = getRenderCache(raw_cache).stats();
+    out_stats.* = c.gemtext_render_cache_stats{
+        .hits = stats.hits,
+        .misses = stats.misses,
+        .coalesced = stats.coalesced,
+        .evictions = stats.evictions,
+        .pages = stats.pages,
+        .bytes = stats.bytes,
+    };
+}
+
+export fn gemtextMetricsWrite(
+    context: ?*anyopaque,
+    render: *const fn (ctx: ?*anyopaque, bytes: [*]const u8, length: usize) callconv(.C) void,
+) c.gemtext_error {
+    const stream = CStream{
+        .context = context,
+        .render = render,
+    };
+
+    var buffered = std.io.bufferedWriter(stream.writer());
+    metrics.write(buffered.writer()) catch unreachable; // CStream can't fail
+    buffered.flush() catch unreachable;
+
+    return c.GEMTEXT_SUCCESS;
+}
+
+export fn gemtextStatisticsCollect(out_statistics: *c.gemtext_statistics, text: [*]const u8, length: usize) void {
+    cpu_dispatch.ensureInit();
+
+    const stats = gemini.Statistics.collect(text[0..length]);
+
+    var result = std.mem.zeroes(c.gemtext_statistics);
+    result.fragments[c.GEMTEXT_FRAGMENT_EMPTY] = stats.fragments.get(.empty);
+    result.fragments[c.GEMTEXT_FRAGMENT_PARAGRAPH] = stats.fragments.get(.paragraph);
+    result.fragments[c.GEMTEXT_FRAGMENT_PREFORMATTED] = stats.fragments.get(.preformatted);
+    result.fragments[c.GEMTEXT_FRAGMENT_QUOTE] = stats.fragments.get(.quote);
+    result.fragments[c.GEMTEXT_FRAGMENT_LINK] = stats.fragments.get(.link);
+    result.fragments[c.GEMTEXT_FRAGMENT_LIST] = stats.fragments.get(.list);
+    result.fragments[c.GEMTEXT_FRAGMENT_HEADING] = stats.fragments.get(.heading);
+    result.links[c.GEMTEXT_LINK_RELATIVE] = stats.links.get(.relative);
+    result.links[c.GEMTEXT_LINK_GEMINI] = stats.links.get(.gemini);
+    result.links[c.GEMTEXT_LINK_HTTPS] = stats.links.get(.https);
+    result.links[c.GEMTEXT_LINK_HTTP] = stats.links.get(.http);
+    result.links[c.GEMTEXT_LINK_GOPHER] = stats.links.get(.gopher);
+    result.links[c.GEMTEXT_LINK_MAILTO] = stats.links.get(.mailto);
+    result.links[c.GEMTEXT_LINK_OTHER] = stats.links.get(.other);
+    result.lines = stats.lines;
+    result.bytes = stats.bytes;
+    result.words = stats.words;
+    result.longest_line = stats.longest_line;
+    result.preformatted_lines = stats.preformatted_lines;
+    result.preformatted_bytes = stats.preformatted_bytes;
+
+    out_statistics.* = result;
+}
+
+export fn gemtextGetCpuTier() c.gemtext_cpu_tier {
+    cpu_dispatch.ensureInit();
+    return @intFromEnum(cpu_dispatch.current());
+}
+
+export fn gemtextSetCpuTier(tier: c.gemtext_cpu_tier) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
+    const requested = std.meta.intToEnum(gemini.kernels.Tier, tier) catch return c.GEMTEXT_ERR_UNSUPPORTED;
+    cpu_dispatch.select(requested) catch return c.GEMTEXT_ERR_UNSUPPORTED;
+
+    return c.GEMTEXT_SUCCESS;
+}
+
 export fn gemtextDocumentParseString(document: *c.gemtext_document, raw_text: [*]const u8, length: usize) c.gemtext_error {
+    return gemtextDocumentParseStringWithAllocator(document, null, raw_text, length);
+}
+
+export fn gemtextDocumentParseStringWithAllocator(
+    document: *c.gemtext_document,
+    raw_allocator: ?*const c.gemtext_allocator,
+    raw_text: [*]const u8,
+    length: usize,
+) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
     var err: c.gemtext_error = undefined;
+    var timer = startTimer();
 
-    err = c.gemtextDocumentCreate(document);
+    err = c.gemtextDocumentCreateWithAllocator(document, raw_allocator);
     if (err != c.GEMTEXT_SUCCESS)
         return err;
 
@@ -553,7 +1133,7 @@ export fn gemtextDocumentParseString(document: *c.gemtext_document, raw_text: [*
     };
 
     var parser: c.gemtext_parser = undefined;
-    err = c.gemtextParserCreate(&parser);
+    err = c.gemtextParserCreateWithAllocator(&parser, raw_allocator);
     if (err != c.GEMTEXT_SUCCESS)
         return err;
     defer c.gemtextParserDestroy(&parser);
@@ -592,15 +1172,29 @@ export fn gemtextDocumentParseString(document: *c.gemtext_document, raw_text: [*
     } else if (err != c.GEMTEXT_SUCCESS)
         return err;
 
+    if (timer) |*t|
+        metrics.observeParse(t.read());
+
     success = true; // prevent defer-killing "document"
 
     return c.GEMTEXT_SUCCESS;
 }
 
 export fn gemtextDocumentParseFile(document: *c.gemtext_document, file: *std.c.FILE) c.gemtext_error {
+    return gemtextDocumentParseFileWithAllocator(document, null, file);
+}
+
+export fn gemtextDocumentParseFileWithAllocator(
+    document: *c.gemtext_document,
+    raw_allocator: ?*const c.gemtext_allocator,
+    file: *std.c.FILE,
+) c.gemtext_error {
+    cpu_dispatch.ensureInit();
+
     var err: c.gemtext_error = undefined;
+    var timer = startTimer();
 
-    err = c.gemtextDocumentCreate(document);
+    err = c.gemtextDocumentCreateWithAllocator(document, raw_allocator);
     if (err != c.GEMTEXT_SUCCESS)
         return err;
 
@@ -610,7 +1204,7 @@ export fn gemtextDocumentParseFile(document: *c.gemtext_document, file: *std.c.F
     };
 
     var parser: c.gemtext_parser = undefined;
-    err = c.gemtextParserCreate(&parser);
+    err = c.gemtextParserCreateWithAllocator(&parser, raw_allocator);
     if (err != c.GEMTEXT_SUCCESS)
         return err;
     defer c.gemtextParserDestroy(&parser);
@@ -656,6 +1250,9 @@ export fn gemtextDocumentParseFile(document: *c.gemtext_document, file: *std.c.F
     } else if (err != c.GEMTEXT_SUCCESS)
         return err;
 
+    if (timer) |*t|
+        metrics.observeParse(t.read());
+
     success = true; // prevent defer-killing "document"
 
     return c.GEMTEXT_SUCCESS;
@@ -795,3 +1392,323 @@ test "basic parser invocation and document building, also rendering" {
 
     try std.testing.expectEqualStrings(document_text, list.items);
 }
+
+test "render cache renders each page once" {
+    var cache: ?*c.gemtext_render_cache = null;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRenderCacheCreate(&cache, 4096));
+    defer c.gemtextRenderCacheDestroy(cache);
+
+    const Loader = struct {
+        var load_count: usize = 0;
+
+        fn load(ctx: ?*anyopaque, document: [*c]c.gemtext_document) callconv(.C) c.gemtext_error {
+            _ = ctx;
+            load_count += 1;
+            const text = "# Title\r\nHello, World!\r\n";
+            return c.gemtextDocumentParseString(document, text, text.len);
+        }
+
+        fn render(ctx: ?*anyopaque, text: [*c]const u8, len: usize) callconv(.C) void {
+            var sublist: *std.ArrayList(u8) = @ptrCast(@alignCast(ctx.?));
+            sublist.appendSlice(text[0..len]) catch unreachable;
+        }
+    };
+
+    for (0..2) |_| {
+        var list = std.ArrayList(u8).init(std.testing.allocator);
+        defer list.deinit();
+
+        try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRenderCacheRender(
+            cache,
+            c.GEMTEXT_RENDER_HTML,
+            "index.gmi",
+            1,
+            null,
+            Loader.load,
+            &list,
+            Loader.render,
+        ));
+
+        try std.testing.expectEqualStrings("<h1>Title</h1>\r\n<p>Hello, World!</p>\r\n", list.items);
+    }
+
+    try std.testing.expectEqual(@as(usize, 1), Loader.load_count);
+
+    var stats: c.gemtext_render_cache_stats = undefined;
+    c.gemtextRenderCacheGetStats(cache, &stats);
+    try std.testing.expectEqual(@as(u64, 1), stats.hits);
+    try std.testing.expectEqual(@as(u64, 1), stats.misses);
+    try std.testing.expectEqual(@as(usize, 1), stats.pages);
+}
+
+test "parser snapshot and restore" {
+    var first: c.gemtext_parser = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserCreate(&first));
+    defer c.gemtextParserDestroy(&first);
+
+    const text = "* first\r\n* sec";
+
+    var fragment: c.gemtext_fragment = undefined;
+    var consumed: usize = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserFeed(&first, &fragment, &consumed, text.len, text));
+    try std.testing.expectEqual(text.len, consumed);
+
+    var snapshot = std.ArrayList(u8).init(std.testing.allocator);
+    defer snapshot.deinit();
+
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserSnapshot(&first, &snapshot, struct {
+        fn f(ctx: ?*anyopaque, bytes: [*c]const u8, len: usize) callconv(.C) void {
+            var list: *std.ArrayList(u8) = @ptrCast(@alignCast(ctx.?));
+            list.appendSlice(bytes[0..len]) catch unreachable;
+        }
+    }.f));
+
+    var second: c.gemtext_parser = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserCreate(&second));
+    defer c.gemtextParserDestroy(&second);
+
+    try std.testing.expectEqual(c.GEMTEXT_ERR_INVALID_SNAPSHOT, c.gemtextParserRestore(&second, "GTPX", 4));
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserRestore(&second, snapshot.items.ptr, snapshot.items.len));
+
+    const rest = "ond\r\n";
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserFeed(&second, &fragment, &consumed, rest.len, rest));
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS_FRAGMENT, c.gemtextParserFinalize(&second, &fragment));
+    defer c.gemtextParserDestroyFragment(&second, &fragment);
+
+    try std.testing.expectEqual(@as(c_uint, @intCast(c.GEMTEXT_FRAGMENT_LIST)), fragment.type);
+    try std.testing.expectEqual(@as(usize, 2), fragment.unnamed_0.list.count);
+    try std.testing.expectEqualStrings("first", std.mem.span(fragment.unnamed_0.list.lines[0]));
+    try std.testing.expectEqualStrings("second", std.mem.span(fragment.unnamed_0.list.lines[1]));
+}
+
+test "cpu tier selection" {
+    const tier = c.gemtextGetCpuTier();
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextSetCpuTier(c.GEMTEXT_CPU_TIER_GENERIC));
+    try std.testing.expectEqual(@as(c.gemtext_cpu_tier, c.GEMTEXT_CPU_TIER_GENERIC), c.gemtextGetCpuTier());
+    try std.testing.expectEqual(c.GEMTEXT_ERR_UNSUPPORTED, c.gemtextSetCpuTier(42));
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextSetCpuTier(tier));
+}
+
+test "parser limits" {
+    var parser: c.gemtext_parser = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserCreate(&parser));
+    defer c.gemtextParserDestroy(&parser);
+
+    c.gemtextParserSetLimits(&parser, &c.gemtext_parser_limits{
+        .max_line_length = 16,
+        .max_block_lines = 0,
+        .max_block_bytes = 0,
+        .max_fragments = 0,
+        .max_total_bytes = 0,
+    });
+
+    const text = "a short line\nand a line that is far too long\n";
+
+    var fragment: c.gemtext_fragment = undefined;
+    var consumed: usize = undefined;
+
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS_FRAGMENT, c.gemtextParserFeed(&parser, &fragment, &consumed, text.len, text));
+    c.gemtextParserDestroyFragment(&parser, &fragment);
+
+    try std.testing.expectEqual(c.GEMTEXT_ERR_LINE_TOO_LONG, c.gemtextParserFeed(&parser, &fragment, &consumed, text.len - consumed, @as([*]const u8, text) + consumed));
+}
+
+test "custom allocator" {
+    const Counting = struct {
+        allocations: usize = 0,
+        live_bytes: usize = 0,
+
+        fn alloc(ctx: ?*anyopaque, size: usize, alignment: usize) callconv(.C) ?*anyopaque {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            std.debug.assert(alignment <= 16);
+            const memory = std.testing.allocator.alignedAlloc(u8, 16, size) catch return null;
+            self.allocations += 1;
+            self.live_bytes += size;
+            return memory.ptr;
+        }
+
+        fn free(ctx: ?*anyopaque, memory: ?*anyopaque, size: usize, alignment: usize) callconv(.C) void {
+            _ = alignment;
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            const ptr: [*]align(16) u8 = @ptrCast(@alignCast(memory.?));
+            std.testing.allocator.free(ptr[0..size]);
+            self.live_bytes -= size;
+        }
+    };
+
+    var counting = Counting{};
+    const callbacks = c.gemtext_allocator{
+        .context = &counting,
+        .alloc = Counting.alloc,
+        .free = Counting.free,
+    };
+
+    const text = "# Title\r\n```alt\r\ncode\r\n```\r\n=> gemini://example.com/ Example\r\n";
+
+    {
+        var document: c.gemtext_document = undefined;
+        try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextDocumentParseStringWithAllocator(&document, &callbacks, text, text.len));
+        defer c.gemtextDocumentDestroy(&document);
+
+        try std.testing.expectEqual(@as(usize, 3), document.fragment_count);
+        try std.testing.expect(counting.allocations > 0);
+        try std.testing.expect(counting.live_bytes > 0);
+    }
+    try std.testing.expectEqual(@as(usize, 0), counting.live_bytes);
+
+    {
+        var parser: c.gemtext_parser = undefined;
+        try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextParserCreateWithAllocator(&parser, &callbacks));
+        defer c.gemtextParserDestroy(&parser);
+
+        var fragment: c.gemtext_fragment = undefined;
+        var consumed: usize = undefined;
+        try std.testing.expectEqual(c.GEMTEXT_SUCCESS_FRAGMENT, c.gemtextParserFeed(&parser, &fragment, &consumed, text.len, text));
+        defer c.gemtextParserDestroyFragment(&parser, &fragment);
+
+        try std.testing.expectEqualStrings("Title", std.mem.span(fragment.unnamed_0.heading.text));
+        try std.testing.expect(counting.live_bytes > 0);
+    }
+    try std.testing.expectEqual(@as(usize, 0), counting.live_bytes);
+}
+
+test "metrics" {
+    const text = "# Title\r\nHello, World!\r\n";
+
+    var document: c.gemtext_document = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextDocumentParseString(&document, text, text.len));
+    defer c.gemtextDocumentDestroy(&document);
+
+    const before = metrics.snapshot();
+
+    var list = std.ArrayList(u8).init(std.testing.allocator);
+    defer list.deinit();
+
+    const Sink = struct {
+        fn render(ctx: ?*anyopaque, bytes: [*c]const u8, len: usize) callconv(.C) void {
+            var sublist: *std.ArrayList(u8) = @ptrCast(@alignCast(ctx.?));
+            sublist.appendSlice(bytes[0..len]) catch unreachable;
+        }
+    };
+
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRender(c.GEMTEXT_RENDER_HTML, document.fragments, document.fragment_count, &list, Sink.render));
+
+    const after = metrics.snapshot();
+    try std.testing.expectEqual(before.rendered_bytes.get(.html) + list.items.len, after.rendered_bytes.get(.html));
+    try std.testing.expectEqual(before.render_duration.get(.html).count() + 1, after.render_duration.get(.html).count());
+    try std.testing.expect(after.parsed_bytes >= text.len);
+    try std.testing.expect(after.allocations > 0);
+
+    list.clearRetainingCapacity();
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextMetricsWrite(&list, Sink.render));
+    try std.testing.expect(std.mem.indexOf(u8, list.items, "# TYPE gemtext_render_duration_seconds histogram\n") != null);
+    try std.testing.expect(std.mem.indexOf(u8, list.items, "gemtext_fragments_total{type=\"heading\"} ") != null);
+}
+
+test "async render on a pool" {
+    var pool: ?*c.gemtext_render_pool = null;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRenderPoolCreate(&pool, &c.gemtext_render_pool_options{
+        .thread_count = 3,
+        .pin_threads = 0,
+        .split_fragments = 2,
+    }));
+    defer c.gemtextRenderPoolDestroy(pool);
+
+    const text = "# Title\r\nfirst\r\n* item\r\n> quote\r\n=> gemini://example.com/ Example\r\nlast\r\n";
+
+    var document: c.gemtext_document = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextDocumentParseString(&document, text, text.len));
+    defer c.gemtextDocumentDestroy(&document);
+
+    const Sink = struct {
+        output: std.ArrayList(u8),
+        result: c.gemtext_error = c.GEMTEXT_ERR_UNSUPPORTED,
+        done: std.Thread.ResetEvent = .{},
+
+        fn render(ctx: ?*anyopaque, bytes: [*c]const u8, len: usize) callconv(.C) void {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            self.output.appendSlice(bytes[0..len]) catch unreachable;
+        }
+
+        fn onDone(ctx: ?*anyopaque, result: c.gemtext_error) callconv(.C) void {
+            const self: *@This() = @ptrCast(@alignCast(ctx.?));
+            self.result = result;
+            self.done.set();
+        }
+    };
+
+    var expected = Sink{ .output = std.ArrayList(u8).init(std.testing.allocator) };
+    defer expected.output.deinit();
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRender(c.GEMTEXT_RENDER_HTML, document.fragments, document.fragment_count, &expected, Sink.render));
+
+    // The document is split into three ranges, a single fragment is rendered directly.
+    for ([_]usize{ document.fragment_count, 1 }) |count| {
+        var sink = Sink{ .output = std.ArrayList(u8).init(std.testing.allocator) };
+        defer sink.output.deinit();
+
+        try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRenderAsync(pool, c.GEMTEXT_RENDER_HTML, document.fragments, count, &sink, Sink.render, Sink.onDone));
+        sink.done.wait();
+
+        try std.testing.expectEqual(c.GEMTEXT_SUCCESS, sink.result);
+        if (count == document.fragment_count) {
+            try std.testing.expectEqualStrings(expected.output.items, sink.output.items);
+        } else {
+            try std.testing.expectEqualStrings("<h1>Title</h1>\r\n", sink.output.items);
+        }
+    }
+}
+
+test "compressed rendering" {
+    const text = "# Title\r\nHello, World!\r\n=> gemini://example.com/ Example\r\n";
+
+    var document: c.gemtext_document = undefined;
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextDocumentParseString(&document, text, text.len));
+    defer c.gemtextDocumentDestroy(&document);
+
+    const Sink = struct {
+        fn render(ctx: ?*anyopaque, bytes: [*c]const u8, len: usize) callconv(.C) void {
+            var sublist: *std.ArrayList(u8) = @ptrCast(@alignCast(ctx.?));
+            sublist.appendSlice(bytes[0..len]) catch unreachable;
+        }
+    };
+
+    var plain = std.ArrayList(u8).init(std.testing.allocator);
+    defer plain.deinit();
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRender(c.GEMTEXT_RENDER_HTML, document.fragments, document.fragment_count, &plain, Sink.render));
+
+    var compressed = std.ArrayList(u8).init(std.testing.allocator);
+    defer compressed.deinit();
+    try std.testing.expectEqual(c.GEMTEXT_SUCCESS, c.gemtextRenderCompressed(
+        c.GEMTEXT_RENDER_HTML,
+        c.GEMTEXT_COMPRESSION_GZIP,
+        9,
+        document.fragments,
+        document.fragment_count,
+        &compressed,
+        Sink.render,
+    ));
+
+    var decompressed = std.ArrayList(u8).init(std.testing.allocator);
+    defer decompressed.deinit();
+    var source = std.io.fixedBufferStream(compressed.items);
+    try std.compress.gzip.decompress(source.reader(), decompressed.writer());
+    try std.testing.expectEqualStrings(plain.items, decompressed.items);
+
+    try std.testing.expectEqual(c.GEMTEXT_ERR_UNSUPPORTED, c.gemtextRenderCompressed(c.GEMTEXT_RENDER_HTML, c.GEMTEXT_COMPRESSION_GZIP, 10, document.fragments, document.fragment_count, &compressed, Sink.render));
+    try std.testing.expectEqual(c.GEMTEXT_ERR_UNSUPPORTED, c.gemtextRenderCompressed(c.GEMTEXT_RENDER_HTML, 42, 0, document.fragments, document.fragment_count, &compressed, Sink.render));
+}
+
+test "statistics" {
+    const text = "# Title\r\n* a\r\n* b\r\n=> gemini://example.com/ Example\r\n";
+
+    var stats: c.gemtext_statistics = undefined;
+    c.gemtextStatisticsCollect(&stats, text, text.len);
+
+    try std.testing.expectEqual(@as(usize, 1), stats.fragments[c.GEMTEXT_FRAGMENT_HEADING]);
+    try std.testing.expectEqual(@as(usize, 1), stats.fragments[c.GEMTEXT_FRAGMENT_LIST]);
+    try std.testing.expectEqual(@as(usize, 1), stats.fragments[c.GEMTEXT_FRAGMENT_LINK]);
+    try std.testing.expectEqual(@as(usize, 1), stats.links[c.GEMTEXT_LINK_GEMINI]);
+    try std.testing.expectEqual(@as(usize, 4), stats.lines);
+    try std.testing.expectEqual(@as(usize, 4), stats.words);
+    try std.testing.expectEqual(text.len, stats.bytes);
+}
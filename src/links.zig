@@ -0,0 +1,95 @@
+const std = @import("std");
+const kernels = @import("kernels.zig");
+
+const legal_whitespace = "\t ";
+
+/// Iterates over the links of a gemini text document without building fragments
+/// or allocating. Lines inside preformatted blocks are skipped, just like the
+/// parser does. The returned slices point into the scanned text.
+pub const LinkScanner = struct {
+    const Self = @This();
+
+    pub const Link = struct {
+        href: []const u8,
+        title: ?[]const u8,
+        /// The 1-based line number of the link line.
+        line: usize,
+    };
+
+    text: []const u8,
+    offset: usize = 0,
+    line: usize = 0,
+    preformatted: bool = false,
+
+    pub fn init(text: []const u8) Self {
+        return Self{ .text = text };
+    }
+
+    /// Returns the next link with a non-empty target, or `null` at the end of the text.
+    pub fn next(self: *Self) ?Link {
+        while (self.offset < self.text.len) {
+            const rest = self.text[self.offset..];
+            const end = kernels.indexOfNewline(rest);
+            self.offset += @min(end + 1, rest.len);
+            self.line += 1;
+
+            var line = rest[0..end];
+            if (line.len > 0 and line[line.len - 1] == '\r')
+                line = line[0 .. line.len - 1];
+
+            switch (kernels.classifyLine(line)) {
+                .preformatted_toggle => self.preformatted = !self.preformatted,
+                .link => if (!self.preformatted) {
+                    const content = std.mem.trim(u8, line[2..], legal_whitespace);
+                    if (content.len == 0)
+                        continue;
+
+                    const split = std.mem.indexOfAny(u8, content, legal_whitespace) orelse content.len;
+                    const title = std.mem.trim(u8, content[split..], legal_whitespace);
+                    return Link{
+                        .href = content[0..split],
+                        .title = if (title.len > 0) title else null,
+                        .line = self.line,
+                    };
+                },
+                else => {},
+            }
+        }
+        return null;
+    }
+};
+
+/// Returns whether `href` starts with a URI scheme like `gemini:`, as defined by RFC 3986.
+pub fn hasScheme(href: []const u8) bool {
+    for (href, 0..) |c, i| {
+        switch (c) {
+            'a'...'z', 'A'...'Z' => {},
+            '0'...'9', '+', '-', '.' => if (i == 0) return false,
+            ':' => return i > 0,
+            else => return false,
+        }
+    }
+    return false;
+}
+
+/// Returns the path of the local file `href` points to, relative to the root of
+/// the capsule, or `null` if `href` has a scheme or authority or only points into
+/// the same document. `directory` is the directory of the linking document
+/// relative to the root; absolute paths are resolved against the root.
+/// Links that leave the root resolve to `..` or a path starting with `../`.
+/// The query and fragment are dropped and percent-encoding is decoded.
+pub fn resolveTarget(allocator: std.mem.Allocator, directory: []const u8, href: []const u8) !?[]u8 {
+    if (std.mem.startsWith(u8, href, "//") or hasScheme(href))
+        return null;
+
+    const end = std.mem.indexOfAny(u8, href, "?#") orelse href.len;
+    if (end == 0)
+        return null; // a link into the same document
+
+    const decoded = try std.Uri.unescapeString(allocator, href[0..end]);
+    defer allocator.free(decoded);
+
+    if (decoded.len > 0 and decoded[0] == '/')
+        return try std.fs.path.resolvePosix(allocator, &.{decoded[1..]});
+    return try std.fs.path.resolvePosix(allocator, &.{ directory, decoded });
+}
@@ -0,0 +1,272 @@
+const std = @import("std");
+const gemtext = @import("gemtext.zig");
+const FragmentType = gemtext.FragmentType;
+const Format = gemtext.renderer.Format;
+
+/// Counters and latency histograms for parsing, rendering, caching and allocations,
+/// written in the Prometheus text exposition format.
+///
+/// All updates are lock-free. Each thread updates its own cache line aligned shard,
+/// so threads converting documents in parallel don't contend on the counters;
+/// `write` and `snapshot` sum up all shards.
+///
+/// Nothing is recorded automatically: the owner of a `Metrics` reports parses and
+/// renders, passes it to `RenderCache.Options.metrics` and wraps its allocator with
+/// `CountingAllocator`.
+pub const Metrics = struct {
+    const Self = @This();
+
+    const shard_count = 16;
+
+    const fragment_types = std.enums.values(FragmentType);
+    const formats = std.enums.values(Format);
+
+    /// Upper bounds of the latency histogram buckets in nanoseconds, 1µs to about 16s.
+    pub const bucket_bounds = blk: {
+        var bounds: [13]u64 = undefined;
+        for (&bounds, 0..) |*bound, i| {
+            bound.* = std.time.ns_per_us << (2 * i);
+        }
+        break :blk bounds;
+    };
+
+    pub const CacheResult = enum { hit, miss, coalesced };
+
+    const Counter = std.atomic.Value(u64);
+
+    const Histogram = struct {
+        /// Non-cumulative; the last bucket counts all observations above the largest bound.
+        buckets: [bucket_bounds.len + 1]Counter = [_]Counter{Counter.init(0)} ** (bucket_bounds.len + 1),
+        sum_ns: Counter = Counter.init(0),
+
+        fn observe(self: *Histogram, duration_ns: u64) void {
+            const bucket = for (bucket_bounds, 0..) |bound, i| {
+                if (duration_ns <= bound) break i;
+            } else bucket_bounds.len;
+            _ = self.buckets[bucket].fetchAdd(1, .monotonic);
+            _ = self.sum_ns.fetchAdd(duration_ns, .monotonic);
+        }
+    };
+
+    const Shard = struct {
+        // Aligning the first field pads each shard to whole cache lines.
+        parsed_bytes: Counter align(std.atomic.cache_line) = Counter.init(0),
+        fragments: [fragment_types.len]Counter = [_]Counter{Counter.init(0)} ** fragment_types.len,
+        parse_duration: Histogram = .{},
+        rendered_bytes: [formats.len]Counter = [_]Counter{Counter.init(0)} ** formats.len,
+        render_duration: [formats.len]Histogram = [_]Histogram{.{}} ** formats.len,
+        cache: [std.enums.values(CacheResult).len]Counter = [_]Counter{Counter.init(0)} ** std.enums.values(CacheResult).len,
+        allocations: Counter = Counter.init(0),
+        allocated_bytes: Counter = Counter.init(0),
+        frees: Counter = Counter.init(0),
+        freed_bytes: Counter = Counter.init(0),
+    };
+
+    /// The sums of all shards at one point in time.
+    pub const Snapshot = struct {
+        pub const HistogramSnapshot = struct {
+            buckets: [bucket_bounds.len + 1]u64 = [_]u64{0} ** (bucket_bounds.len + 1),
+            sum_ns: u64 = 0,
+
+            pub fn count(self: HistogramSnapshot) u64 {
+                var total: u64 = 0;
+                for (self.buckets) |bucket| total += bucket;
+                return total;
+            }
+        };
+
+        parsed_bytes: u64 = 0,
+        fragments: std.enums.EnumArray(FragmentType, u64) = std.enums.EnumArray(FragmentType, u64).initFill(0),
+        parse_duration: HistogramSnapshot = .{},
+        rendered_bytes: std.enums.EnumArray(Format, u64) = std.enums.EnumArray(Format, u64).initFill(0),
+        render_duration: std.enums.EnumArray(Format, HistogramSnapshot) = std.enums.EnumArray(Format, HistogramSnapshot).initFill(.{}),
+        cache: std.enums.EnumArray(CacheResult, u64) = std.enums.EnumArray(CacheResult, u64).initFill(0),
+        allocations: u64 = 0,
+        allocated_bytes: u64 = 0,
+        frees: u64 = 0,
+        freed_bytes: u64 = 0,
+    };
+
+    shards: [shard_count]Shard = [_]Shard{.{}} ** shard_count,
+
+    /// Spreads threads over the shards in the order they first record something.
+    var next_shard = std.atomic.Value(usize).init(0);
+    threadlocal var thread_shard: ?usize = null;
+
+    fn shard(self: *Self) *Shard {
+        const index = thread_shard orelse blk: {
+            const assigned = next_shard.fetchAdd(1, .monotonic) % shard_count;
+            thread_shard = assigned;
+            break :blk assigned;
+        };
+        return &self.shards[index];
+    }
+
+    /// Counts `bytes` of gemini text consumed by a parser.
+    pub fn countParsed(self: *Self, bytes: usize) void {
+        _ = self.shard().parsed_bytes.fetchAdd(bytes, .monotonic);
+    }
+
+    /// Counts a fragment emitted by a parser.
+    pub fn countFragment(self: *Self, fragment_type: FragmentType) void {
+        _ = self.shard().fragments[@intFromEnum(fragment_type)].fetchAdd(1, .monotonic);
+    }
+
+    /// Records the time it took to parse a whole document.
+    pub fn observeParse(self: *Self, duration_ns: u64) void {
+        self.shard().parse_duration.observe(duration_ns);
+    }
+
+    /// Records a render of `bytes` output bytes that took `duration_ns`.
+    pub fn observeRender(self: *Self, format: Format, bytes: usize, duration_ns: u64) void {
+        const s = self.shard();
+        _ = s.rendered_bytes[@intFromEnum(format)].fetchAdd(bytes, .monotonic);
+        s.render_duration[@intFromEnum(format)].observe(duration_ns);
+    }
+
+    /// Counts a render cache lookup.
+    pub fn countCache(self: *Self, result: CacheResult) void {
+        _ = self.shard().cache[@intFromEnum(result)].fetchAdd(1, .monotonic);
+    }
+
+    /// Sums up all shards.
+    pub fn snapshot(self: *Self) Snapshot {
+        var result = Snapshot{};
+        for (&self.shards) |*s| {
+            result.parsed_bytes += s.parsed_bytes.load(.monotonic);
+            for (fragment_types) |fragment_type| {
+                result.fragments.getPtr(fragment_type).* += s.fragments[@intFromEnum(fragment_type)].load(.monotonic);
+            }
+            addHistogram(&result.parse_duration, &s.parse_duration);
+            for (formats) |format| {
+                result.rendered_bytes.getPtr(format).* += s.rendered_bytes[@intFromEnum(format)].load(.monotonic);
+                addHistogram(result.render_duration.getPtr(format), &s.render_duration[@intFromEnum(format)]);
+            }
+            for (std.enums.values(CacheResult)) |cache_result| {
+                result.cache.getPtr(cache_result).* += s.cache[@intFromEnum(cache_result)].load(.monotonic);
+            }
+            result.allocations += s.allocations.load(.monotonic);
+            result.allocated_bytes += s.allocated_bytes.load(.monotonic);
+            result.frees += s.frees.load(.monotonic);
+            result.freed_bytes += s.freed_bytes.load(.monotonic);
+        }
+        return result;
+    }
+
+    fn addHistogram(dst: *Snapshot.HistogramSnapshot, src: *const Histogram) void {
+        for (&dst.buckets, &src.buckets) |*d, *s| {
+            d.* += s.load(.monotonic);
+        }
+        dst.sum_ns += src.sum_ns.load(.monotonic);
+    }
+
+    /// Writes all metrics in the Prometheus text exposition format.
+    /// Metric names are prefixed with `gemtext_`.
+    pub fn write(self: *Self, writer: anytype) !void {
+        const s = self.snapshot();
+
+        try writeHeader(writer, "parsed_bytes_total", "counter", "Bytes of gemini text consumed by the parser.");
+        try writer.print("gemtext_parsed_bytes_total {}\n", .{s.parsed_bytes});
+
+        try writeHeader(writer, "fragments_total", "counter", "Fragments emitted by the parser.");
+        for (fragment_types) |fragment_type| {
+            try writer.print("gemtext_fragments_total{{type=\"{s}\"}} {}\n", .{ @tagName(fragment_type), s.fragments.get(fragment_type) });
+        }
+
+        try writeHeader(writer, "parse_duration_seconds", "histogram", "Time to parse a whole document.");
+        try writeHistogram(writer, "gemtext_parse_duration_seconds", "", s.parse_duration);
+
+        try writeHeader(writer, "rendered_bytes_total", "counter", "Bytes produced by the renderers.");
+        for (formats) |format| {
+            try writer.print("gemtext_rendered_bytes_total{{renderer=\"{s}\"}} {}\n", .{ @tagName(format), s.rendered_bytes.get(format) });
+        }
+
+        try writeHeader(writer, "render_duration_seconds", "histogram", "Time to render a document.");
+        inline for (formats) |format| {
+            try writeHistogram(writer, "gemtext_render_duration_seconds", "renderer=\"" ++ @tagName(format) ++ "\"", s.render_duration.get(format));
+        }
+
+        try writeHeader(writer, "cache_lookups_total", "counter", "Render cache lookups by result.");
+        for (std.enums.values(CacheResult)) |cache_result| {
+            try writer.print("gemtext_cache_lookups_total{{result=\"{s}\"}} {}\n", .{ @tagName(cache_result), s.cache.get(cache_result) });
+        }
+
+        try writeHeader(writer, "allocations_total", "counter", "Allocations through counted allocators.");
+        try writer.print("gemtext_allocations_total {}\n", .{s.allocations});
+        try writeHeader(writer, "allocated_bytes_total", "counter", "Bytes allocated through counted allocators.");
+        try writer.print("gemtext_allocated_bytes_total {}\n", .{s.allocated_bytes});
+        try writeHeader(writer, "frees_total", "counter", "Frees through counted allocators.");
+        try writer.print("gemtext_frees_total {}\n", .{s.frees});
+        try writeHeader(writer, "freed_bytes_total", "counter", "Bytes freed through counted allocators.");
+        try writer.print("gemtext_freed_bytes_total {}\n", .{s.freed_bytes});
+    }
+
+    fn writeHeader(writer: anytype, comptime name: []const u8, comptime kind: []const u8, comptime help: []const u8) !void {
+        try writer.writeAll("# HELP gemtext_" ++ name ++ " " ++ help ++ "\n# TYPE gemtext_" ++ name ++ " " ++ kind ++ "\n");
+    }
+
+    fn writeHistogram(writer: anytype, comptime name: []const u8, comptime labels: []const u8, histogram: Snapshot.HistogramSnapshot) !void {
+        const bucket_labels = if (labels.len > 0) labels ++ "," else "";
+        const series_labels = if (labels.len > 0) "{{" ++ labels ++ "}}" else "";
+
+        var cumulative: u64 = 0;
+        for (bucket_bounds, 0..) |bound, i| {
+            cumulative += histogram.buckets[i];
+            const seconds = @as(f64, @floatFromInt(bound)) / std.time.ns_per_s;
+            try writer.print(name ++ "_bucket{{" ++ bucket_labels ++ "le=\"{d}\"}} {}\n", .{ seconds, cumulative });
+        }
+        cumulative += histogram.buckets[bucket_bounds.len];
+        try writer.print(name ++ "_bucket{{" ++ bucket_labels ++ "le=\"+Inf\"}} {}\n", .{cumulative});
+
+        const sum = @as(f64, @floatFromInt(histogram.sum_ns)) / std.time.ns_per_s;
+        try writer.print(name ++ "_sum" ++ series_labels ++ " {d}\n", .{sum});
+        try writer.print(name ++ "_count" ++ series_labels ++ " {}\n", .{cumulative});
+    }
+
+    /// Forwards to `child` and counts all allocations and frees in `metrics`.
+    pub const CountingAllocator = struct {
+        child: std.mem.Allocator,
+        metrics: *Metrics,
+
+        pub fn allocator(self: *CountingAllocator) std.mem.Allocator {
+            return .{
+                .ptr = self,
+                .vtable = &.{
+                    .alloc = alloc,
+                    .resize = resize,
+                    .free = free,
+                },
+            };
+        }
+
+        fn alloc(ctx: *anyopaque, len: usize, ptr_align: u8, ret_addr: usize) ?[*]u8 {
+            const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+            const memory = self.child.rawAlloc(len, ptr_align, ret_addr) orelse return null;
+            const s = self.metrics.shard();
+            _ = s.allocations.fetchAdd(1, .monotonic);
+            _ = s.allocated_bytes.fetchAdd(len, .monotonic);
+            return memory;
+        }
+
+        fn resize(ctx: *anyopaque, buf: []u8, buf_align: u8, new_len: usize, ret_addr: usize) bool {
+            const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+            if (!self.child.rawResize(buf, buf_align, new_len, ret_addr))
+                return false;
+            const s = self.metrics.shard();
+            if (new_len > buf.len) {
+                _ = s.allocated_bytes.fetchAdd(new_len - buf.len, .monotonic);
+            } else {
+                _ = s.freed_bytes.fetchAdd(buf.len - new_len, .monotonic);
+            }
+            return true;
+        }
+
+        fn free(ctx: *anyopaque, buf: []u8, buf_align: u8, ret_addr: usize) void {
+            const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+            self.child.rawFree(buf, buf_align, ret_addr);
+            const s = self.metrics.shard();
+            _ = s.frees.fetchAdd(1, .monotonic);
+            _ = s.freed_bytes.fetchAdd(buf.len, .monotonic);
+        }
+    };
+};
@@ -0,0 +1,313 @@
+const std = @import("std");
+const gemtext = @import("gemtext.zig");
+const Format = gemtext.renderer.Format;
+const Metrics = gemtext.Metrics;
+
+/// A thread-safe cache of rendered documents with a strict byte budget.
+///
+/// Pages are identified by their source (usually a path), a version of that
+/// source (for example a hash of mtime and size, or of the content) and the
+/// output format. The cache is split into shards with their own lock and LRU
+/// list, so concurrent lookups of different pages rarely contend.
+/// Concurrent misses on the same page are coalesced: only the first caller
+/// renders the page, all others wait for its result.
+pub const RenderCache = struct {
+    const Self = @This();
+
+    pub const Key = struct {
+        /// Identifies the source document, usually its path.
+        source: []const u8,
+        /// Identifies the version of the source document.
+        version: u64,
+        /// The format the document is rendered to.
+        format: Format,
+
+        fn hash(self: Key) u64 {
+            var hasher = std.hash.Wyhash.init(0);
+            hasher.update(self.source);
+            hasher.update(std.mem.asBytes(&self.version));
+            hasher.update(&[_]u8{@intFromEnum(self.format)});
+            return hasher.final();
+        }
+    };
+
+    const KeyContext = struct {
+        pub fn hash(_: KeyContext, key: Key) u64 {
+            return key.hash();
+        }
+
+        pub fn eql(_: KeyContext, a: Key, b: Key) bool {
+            return a.version == b.version and a.format == b.format and std.mem.eql(u8, a.source, b.source);
+        }
+    };
+
+    pub const Options = struct {
+        /// The maximum number of rendered bytes held by the cache.
+        byte_budget: usize = 64 * 1024 * 1024,
+        /// The number of independently locked shards. Each shard gets an equal part of the budget.
+        shard_count: usize = 16,
+        /// Receives a count of every lookup by its result, if set.
+        metrics: ?*Metrics = null,
+    };
+
+    pub const Stats = struct {
+        /// Number of lookups that found a rendered page.
+        hits: u64,
+        /// Number of lookups that had to render the page.
+        misses: u64,
+        /// Number of lookups that waited for a concurrent render of the same page.
+        coalesced: u64,
+        /// Number of pages dropped to stay within the byte budget.
+        evictions: u64,
+        /// Number of pages currently in the cache.
+        pages: usize,
+        /// Number of rendered bytes currently in the cache.
+        bytes: usize,
+    };
+
+    /// A reference to a rendered page. Must be returned with `release`.
+    pub const Page = struct {
+        allocator: std.mem.Allocator,
+        key: Key,
+        bytes: []const u8,
+        refs: std.atomic.Value(usize),
+        state: State,
+        done: std.Thread.ResetEvent,
+        node: LruList.Node,
+
+        const State = enum { pending, ready, failed };
+
+        fn create(allocator: std.mem.Allocator, key: Key) !*Page {
+            const page = try allocator.create(Page);
+            errdefer allocator.destroy(page);
+
+            const source = try allocator.dupe(u8, key.source);
+
+            page.* = Page{
+                .allocator = allocator,
+                .key = Key{ .source = source, .version = key.version, .format = key.format },
+                .bytes = "",
+                .refs = std.atomic.Value(usize).init(1),
+                .state = .pending,
+                .done = .{},
+                .node = LruList.Node{ .data = page },
+            };
+            return page;
+        }
+
+        fn acquire(self: *Page) void {
+            _ = self.refs.fetchAdd(1, .monotonic);
+        }
+
+        /// Returns the reference to the cache. `bytes` must not be used afterwards.
+        pub fn release(self: *Page) void {
+            if (self.refs.fetchSub(1, .release) != 1)
+                return;
+            _ = self.refs.load(.acquire);
+
+            self.allocator.free(self.bytes);
+            self.allocator.free(self.key.source);
+            self.allocator.destroy(self);
+        }
+    };
+
+    const LruList = std.DoublyLinkedList(*Page);
+
+    const Shard = struct {
+        mutex: std.Thread.Mutex = .{},
+        pages: std.HashMapUnmanaged(Key, *Page, KeyContext, std.hash_map.default_max_load_percentage) = .{},
+        lru: LruList = .{},
+        bytes: usize = 0,
+    };
+
+    allocator: std.mem.Allocator,
+    shards: []Shard,
+    shard_budget: usize,
+    hits: std.atomic.Value(u64),
+    misses: std.atomic.Value(u64),
+    coalesced: std.atomic.Value(u64),
+    evictions: std.atomic.Value(u64),
+    metrics: ?*Metrics,
+
+    pub fn init(allocator: std.mem.Allocator, options: Options) !Self {
+        std.debug.assert(options.shard_count > 0);
+
+        const shards = try allocator.alloc(Shard, options.shard_count);
+        for (shards) |*shard| {
+            shard.* = Shard{};
+        }
+
+        return Self{
+            .allocator = allocator,
+            .shards = shards,
+            .shard_budget = options.byte_budget / options.shard_count,
+            .hits = std.atomic.Value(u64).init(0),
+            .misses = std.atomic.Value(u64).init(0),
+            .coalesced = std.atomic.Value(u64).init(0),
+            .evictions = std.atomic.Value(u64).init(0),
+            .metrics = options.metrics,
+        };
+    }
+
+    /// Destroys the cache. Pages that are still referenced stay alive until they are released.
+    pub fn deinit(self: *Self) void {
+        for (self.shards) |*shard| {
+            var iter = shard.pages.valueIterator();
+            while (iter.next()) |page| {
+                page.*.release();
+            }
+            shard.pages.deinit(self.allocator);
+        }
+        self.allocator.free(self.shards);
+        self.* = undefined;
+    }
+
+    /// Returns the rendered page for `key`.
+    /// On a miss, `source.render(key.format, writer)` is called to render the page into
+    /// `writer`, which is a `std.ArrayList(u8).Writer`. Concurrent callers asking for the
+    /// same page wait for that render instead of starting their own.
+    /// Pages larger than a shard's part of the budget are returned, but not cached.
+    /// The returned page must be released with `Page.release`.
+    pub fn get(self: *Self, key: Key, source: anytype) !*Page {
+        const shard = &self.shards[key.hash() % self.shards.len];
+
+        while (true) {
+            shard.mutex.lock();
+
+            if (shard.pages.get(key)) |page| {
+                page.acquire();
+                switch (page.state) {
+                    .ready => {
+                        shard.lru.remove(&page.node);
+                        shard.lru.prepend(&page.node);
+                        shard.mutex.unlock();
+                        _ = self.hits.fetchAdd(1, .monotonic);
+                        if (self.metrics) |metrics| metrics.countCache(.hit);
+                        return page;
+                    },
+                    .pending => {
+                        shard.mutex.unlock();
+                        _ = self.coalesced.fetchAdd(1, .monotonic);
+                        if (self.metrics) |metrics| metrics.countCache(.coalesced);
+
+                        page.done.wait();
+                        if (page.state == .ready)
+                            return page;
+
+                        // The render failed, so we retry and render the page ourselves.
+                        page.release();
+                        continue;
+                    },
+                    .failed => unreachable, // failed pages are removed before being marked done
+                }
+            }
+
+            const page = Page.create(self.allocator, key) catch |err| {
+                shard.mutex.unlock();
+                return err;
+            };
+            shard.pages.put(self.allocator, page.key, page) catch |err| {
+                shard.mutex.unlock();
+                page.release();
+                return err;
+            };
+            page.acquire(); // one reference for the cache, one for the caller
+            shard.mutex.unlock();
+
+            _ = self.misses.fetchAdd(1, .monotonic);
+            if (self.metrics) |metrics| metrics.countCache(.miss);
+
+            self.fill(shard, page, source) catch |err| {
+                shard.mutex.lock();
+                _ = shard.pages.remove(page.key);
+                page.state = .failed;
+                shard.mutex.unlock();
+
+                page.done.set();
+                page.release();
+                page.release();
+                return err;
+            };
+            return page;
+        }
+    }
+
+    /// Drops all cached pages with the given `source`, for example when the file changed.
+    pub fn invalidate(self: *Self, source: []const u8) void {
+        for (self.shards) |*shard| {
+            shard.mutex.lock();
+            defer shard.mutex.unlock();
+
+            var node = shard.lru.first;
+            while (node) |current| {
+                node = current.next;
+                if (std.mem.eql(u8, current.data.key.source, source))
+                    self.dropPage(shard, current.data);
+            }
+        }
+    }
+
+    /// Returns the current cache metrics.
+    pub fn stats(self: *Self) Stats {
+        var result = Stats{
+            .hits = self.hits.load(.monotonic),
+            .misses = self.misses.load(.monotonic),
+            .coalesced = self.coalesced.load(.monotonic),
+            .evictions = self.evictions.load(.monotonic),
+            .pages = 0,
+            .bytes = 0,
+        };
+        for (self.shards) |*shard| {
+            shard.mutex.lock();
+            defer shard.mutex.unlock();
+            result.pages += shard.lru.len;
+            result.bytes += shard.bytes;
+        }
+        return result;
+    }
+
+    fn fill(self: *Self, shard: *Shard, page: *Page, source: anytype) !void {
+        var output = std.ArrayList(u8).init(self.allocator);
+        defer output.deinit();
+
+        try source.render(page.key.format, output.writer());
+
+        const bytes = try output.toOwnedSlice();
+
+        shard.mutex.lock();
+        page.bytes = bytes;
+        page.state = .ready;
+        if (bytes.len <= self.shard_budget) {
+            shard.lru.prepend(&page.node);
+            shard.bytes += bytes.len;
+            self.evict(shard, page);
+        } else {
+            _ = shard.pages.remove(page.key);
+            page.release(); // the caller still holds a reference
+        }
+        shard.mutex.unlock();
+
+        page.done.set();
+    }
+
+    /// Drops the least recently used pages of `shard` until it fits into its budget.
+    /// `keep` is never evicted. Must be called with the shard lock held.
+    fn evict(self: *Self, shard: *Shard, keep: *Page) void {
+        while (shard.bytes > self.shard_budget) {
+            const node = shard.lru.last orelse break;
+            if (node.data == keep)
+                break;
+            self.dropPage(shard, node.data);
+            _ = self.evictions.fetchAdd(1, .monotonic);
+        }
+    }
+
+    /// Removes a ready page from `shard`. Must be called with the shard lock held.
+    fn dropPage(self: *Self, shard: *Shard, page: *Page) void {
+        _ = self;
+        shard.lru.remove(&page.node);
+        shard.bytes -= page.bytes.len;
+        _ = shard.pages.remove(page.key);
+        page.release();
+    }
+};
@@ -0,0 +1,78 @@
+//! Renders documents straight into a streaming compressor of `std.compress`, so
+//! compressed output is produced in one pass and only the window of the
+//! compressor is held in memory, never the whole rendered document.
+
+const std = @import("std");
+const gemtext = @import("../gemtext.zig");
+const Fragment = gemtext.Fragment;
+const Format = gemtext.renderer.Format;
+
+/// The framing of the compressed stream. All of them use deflate.
+pub const Container = enum {
+    /// RFC 1952, as used by `Content-Encoding: gzip` and `.gz` files.
+    gzip,
+    /// RFC 1950, as used by `Content-Encoding: deflate`.
+    zlib,
+    /// RFC 1951, without any framing.
+    deflate,
+};
+
+/// The compression level, from `.fast` (level 4) to `.best` (level 9).
+pub const Level = std.meta.FieldType(std.compress.flate.Options, .level);
+
+/// The streaming compressor for `container` that writes into a `WriterType`.
+pub fn Compressor(comptime container: Container, comptime WriterType: type) type {
+    return switch (container) {
+        .gzip => std.compress.gzip.Compressor(WriterType),
+        .zlib => std.compress.zlib.Compressor(WriterType),
+        .deflate => std.compress.flate.Compressor(WriterType),
+    };
+}
+
+/// Creates a streaming compressor for `container` that writes into `writer`.
+/// Call `finish` after the last write to flush the compressor and write the trailer.
+pub fn compressor(comptime container: Container, writer: anytype, level: Level) !Compressor(container, @TypeOf(writer)) {
+    const options = std.compress.flate.Options{ .level = level };
+    return switch (container) {
+        .gzip => try std.compress.gzip.compressor(writer, options),
+        .zlib => try std.compress.zlib.compressor(writer, options),
+        .deflate => try std.compress.flate.compressor(writer, options),
+    };
+}
+
+/// Creates a streaming compressor like `compressor`, but on the heap, so its window,
+/// hash chains and token buffer don't stay in the caller's frame while it's used.
+/// `std.compress` only initializes compressors by value, so this call still needs
+/// stack space for a temporary copy. Free it with `allocator.destroy`.
+pub fn create(
+    allocator: std.mem.Allocator,
+    comptime container: Container,
+    writer: anytype,
+    level: Level,
+) !*Compressor(container, @TypeOf(writer)) {
+    const stream = try allocator.create(Compressor(container, @TypeOf(writer)));
+    errdefer allocator.destroy(stream);
+    stream.* = try compressor(container, writer, level);
+    return stream;
+}
+
+/// Renders `fragments` with the renderer selected by `format` and writes the
+/// output compressed with `container` and `level` into `writer`.
+/// The compressor is allocated with `allocator` for the duration of the call.
+pub fn render(
+    allocator: std.mem.Allocator,
+    format: Format,
+    container: Container,
+    level: Level,
+    fragments: []const Fragment,
+    writer: anytype,
+) !void {
+    switch (container) {
+        inline else => |tag| {
+            const stream = try create(allocator, tag, writer, level);
+            defer allocator.destroy(stream);
+            try gemtext.renderer.render(format, fragments, stream.writer());
+            try stream.finish();
+        },
+    }
+}
@@ -11,7 +11,7 @@ fn fmtHtmlText(
     _ = fmt;
     _ = options;
 
-    const illegal = "<>&\"\'";
+    const illegal = gemtext.kernels.html_special;
 
     const replacement = [_][]const u8{
         "&lt;",
@@ -22,17 +22,16 @@ fn fmtHtmlText(
     };
 
     var last_offset: usize = 0;
-    for (data, 0..) |c, index| {
-        if (std.mem.indexOf(u8, illegal, &[1]u8{c})) |i| {
-            if (index > last_offset) {
-                try writer.writeAll(data[last_offset..index]);
-            }
-            last_offset = index + 1;
-            try writer.writeAll(replacement[i]);
+    while (last_offset < data.len) {
+        const index = last_offset + gemtext.kernels.indexOfHtmlSpecial(data[last_offset..]);
+        if (index > last_offset) {
+            try writer.writeAll(data[last_offset..index]);
         }
-    }
-    if (data.len > last_offset) {
-        try writer.writeAll(data[last_offset..]);
+        if (index == data.len)
+            break;
+        const i = std.mem.indexOfScalar(u8, illegal, data[index]).?;
+        try writer.writeAll(replacement[i]);
+        last_offset = index + 1;
     }
 }
 
@@ -40,59 +39,223 @@ pub fn fmtHtml(slice: []const u8) std.fmt.Formatter(fmtHtmlText) {
     return .{ .data = slice };
 }
 
+/// Generates unique `id` attributes for headings and keeps the state of the
+/// table of contents. The same instance can be passed to several calls of
+/// `renderWithAnchors`, for example when rendering a stream fragment by fragment,
+/// and keeps all ids unique across them.
+pub const Anchors = struct {
+    const Self = @This();
+
+    arena: std.heap.ArenaAllocator,
+    /// All ids handed out so far.
+    ids: std.StringHashMapUnmanaged(void) = .{},
+    slug_buffer: std.ArrayListUnmanaged(u8) = .{},
+    /// The number of open lists in the table of contents.
+    toc_depth: usize = 0,
+
+    pub fn init(allocator: std.mem.Allocator) Self {
+        return Self{ .arena = std.heap.ArenaAllocator.init(allocator) };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.arena.deinit();
+        self.* = undefined;
+    }
+
+    /// Maps every ASCII character to its slug character, or 0 if it is dropped.
+    const ascii_slug = blk: {
+        var table = [_]u8{0} ** 128;
+        for ('a'..'z' + 1) |c| table[c] = c;
+        for ('A'..'Z' + 1) |c| table[c] = c - 'A' + 'a';
+        for ('0'..'9' + 1) |c| table[c] = c;
+        table['_'] = '_';
+        table['-'] = '-';
+        table[' '] = '-';
+        table['\t'] = '-';
+        break :blk table;
+    };
+
+    fn appendSlugChar(self: *Self, allocator: std.mem.Allocator, c: u8) !void {
+        if (c == '-') {
+            // Collapse runs of separators and drop leading ones.
+            if (self.slug_buffer.items.len == 0 or self.slug_buffer.items[self.slug_buffer.items.len - 1] == '-')
+                return;
+        }
+        try self.slug_buffer.append(allocator, c);
+    }
+
+    /// Returns a unique id for a heading with `text`, which stays valid until `deinit`.
+    /// ASCII letters are lowercased, digits, `_` and `-` are kept, runs of
+    /// whitespace become a single `-` and all other ASCII characters are dropped.
+    /// Non-ASCII characters are kept as they are, except for Unicode whitespace,
+    /// which becomes a `-`, and invalid UTF-8, which is dropped.
+    /// Repeated slugs get a `-2`, `-3`, ... suffix.
+    pub fn id(self: *Self, text: []const u8) ![]const u8 {
+        const allocator = self.arena.allocator();
+        self.slug_buffer.clearRetainingCapacity();
+
+        var i: usize = 0;
+        while (i < text.len) {
+            const c = text[i];
+            if (c < 0x80) {
+                if (ascii_slug[c] != 0)
+                    try self.appendSlugChar(allocator, ascii_slug[c]);
+                i += 1;
+                continue;
+            }
+
+            const length = std.unicode.utf8ByteSequenceLength(c) catch {
+                i += 1;
+                continue;
+            };
+            if (i + length > text.len) {
+                i = text.len;
+                continue;
+            }
+            const sequence = text[i .. i + length];
+            i += length;
+
+            const codepoint = std.unicode.utf8Decode(sequence) catch continue;
+            if (isUnicodeSpace(codepoint)) {
+                try self.appendSlugChar(allocator, '-');
+            } else {
+                try self.slug_buffer.appendSlice(allocator, sequence);
+            }
+        }
+
+        var slug: []const u8 = self.slug_buffer.items;
+        if (slug.len > 0 and slug[slug.len - 1] == '-')
+            slug = slug[0 .. slug.len - 1];
+        if (slug.len == 0)
+            slug = "section";
+
+        const entry = try self.ids.getOrPut(allocator, slug);
+        if (!entry.found_existing) {
+            entry.key_ptr.* = try allocator.dupe(u8, slug);
+            return entry.key_ptr.*;
+        }
+
+        var suffix: usize = 2;
+        while (true) : (suffix += 1) {
+            const candidate = try std.fmt.allocPrint(allocator, "{s}-{}", .{ slug, suffix });
+            const unique = try self.ids.getOrPut(allocator, candidate);
+            if (!unique.found_existing)
+                return candidate;
+            allocator.free(candidate);
+        }
+    }
+
+    fn isUnicodeSpace(codepoint: u21) bool {
+        return switch (codepoint) {
+            0x85, 0xA0, 0x1680, 0x2000...0x200A, 0x2028, 0x2029, 0x202F, 0x205F, 0x3000 => true,
+            else => false,
+        };
+    }
+
+    /// Adds a link to the heading `id` with `text` at `depth` 1 to 3 to the table of contents.
+    /// Deeper headings are nested into the list item of the last shallower heading.
+    fn writeTocEntry(self: *Self, depth: usize, heading_id: []const u8, text: []const u8, writer: anytype) !void {
+        if (self.toc_depth >= depth) {
+            while (self.toc_depth > depth) : (self.toc_depth -= 1) {
+                try writer.writeAll("</li>\r\n</ul>\r\n");
+            }
+            try writer.writeAll("</li>\r\n");
+        } else {
+            while (self.toc_depth < depth) {
+                try writer.writeAll("<ul>\r\n");
+                self.toc_depth += 1;
+                if (self.toc_depth < depth)
+                    try writer.writeAll("<li>\r\n");
+            }
+        }
+        try writer.print("<li><a href=\"#{s}\">{}</a>\r\n", .{ heading_id, fmtHtml(text) });
+    }
+
+    /// Closes all open lists of the table of contents written into `writer`.
+    pub fn finishToc(self: *Self, writer: anytype) !void {
+        while (self.toc_depth > 0) : (self.toc_depth -= 1) {
+            try writer.writeAll("</li>\r\n</ul>\r\n");
+        }
+    }
+};
+
 /// Renders a sequence of fragments into a html document.
 /// `fragments` is a slice of fragments which describe the document,
 /// `writer` is a `std.io.Writer` structure that will be the target of the document rendering.
 /// The document will be rendered with CR LF line endings.
 pub fn render(fragments: []const Fragment, writer: anytype) !void {
-    const line_ending = "\r\n";
     for (fragments) |fragment| {
-        switch (fragment) {
-            .empty => try writer.writeAll("<p>&nbsp;</p>\r\n"),
-            .paragraph => |paragraph| try writer.print("<p>{s}</p>" ++ line_ending, .{fmtHtml(paragraph)}),
-            .preformatted => |preformatted| {
-                if (preformatted.alt_text) |alt| {
-                    try writer.print("<pre alt=\"{}\">", .{fmtHtml(alt)});
-                } else {
-                    try writer.writeAll("<pre>");
-                }
-                for (preformatted.text.lines, 0..) |line, i| {
-                    if (i > 0)
-                        try writer.writeAll(line_ending);
-                    try writer.print("{}", .{fmtHtml(line)});
-                }
-                try writer.writeAll("</pre>" ++ line_ending);
-            },
-            .quote => |quote| {
-                try writer.writeAll("<blockquote>");
-                for (quote.lines, 0..) |line, i| {
-                    if (i > 0)
-                        try writer.writeAll("<br>" ++ line_ending);
-                    try writer.print("{}", .{fmtHtml(line)});
-                }
-                try writer.writeAll("</blockquote>" ++ line_ending);
-            },
-            .link => |link| {
-                if (link.title) |title| {
-                    try writer.print("<p><a href=\"{s}\">{}</a></p>" ++ line_ending, .{ link.href, fmtHtml(title) });
-                } else {
-                    try writer.print("<p><a href=\"{s}\">{}</a></p>" ++ line_ending, .{ link.href, fmtHtml(link.href) });
-                }
-            },
-            .list => |list| {
-                try writer.writeAll("<ul>" ++ line_ending);
-                for (list.lines) |line| {
-                    try writer.print("<li>{}</li>" ++ line_ending, .{fmtHtml(line)});
-                }
-                try writer.writeAll("</ul>" ++ line_ending);
-            },
-            .heading => |heading| {
-                switch (heading.level) {
-                    .h1 => try writer.print("<h1>{}</h1>" ++ line_ending, .{fmtHtml(heading.text)}),
-                    .h2 => try writer.print("<h2>{}</h1>" ++ line_ending, .{fmtHtml(heading.text)}),
-                    .h3 => try writer.print("<h3>{}</h1>" ++ line_ending, .{fmtHtml(heading.text)}),
+        try renderFragment(fragment, writer, null, null);
+    }
+}
+
+/// Renders like `render`, but gives every heading an `id` attribute generated by `anchors`.
+/// If `toc` is a writer and not `null`, a nested list of links to the headings is
+/// written into it in the same pass; call `anchors.finishToc(toc)` after the last
+/// fragment to close the list.
+pub fn renderWithAnchors(fragments: []const Fragment, anchors: *Anchors, writer: anytype, toc: anytype) !void {
+    for (fragments) |fragment| {
+        try renderFragment(fragment, writer, anchors, toc);
+    }
+}
+
+fn renderFragment(fragment: Fragment, writer: anytype, anchors: ?*Anchors, toc: anytype) !void {
+    const line_ending = "\r\n";
+    switch (fragment) {
+        .empty => try writer.writeAll("<p>&nbsp;</p>\r\n"),
+        .paragraph => |paragraph| try writer.print("<p>{s}</p>" ++ line_ending, .{fmtHtml(paragraph)}),
+        .preformatted => |preformatted| {
+            if (preformatted.alt_text) |alt| {
+                try writer.print("<pre alt=\"{}\">", .{fmtHtml(alt)});
+            } else {
+                try writer.writeAll("<pre>");
+            }
+            for (preformatted.text.lines, 0..) |line, i| {
+                if (i > 0)
+                    try writer.writeAll(line_ending);
+                try writer.print("{}", .{fmtHtml(line)});
+            }
+            try writer.writeAll("</pre>" ++ line_ending);
+        },
+        .quote => |quote| {
+            try writer.writeAll("<blockquote>");
+            for (quote.lines, 0..) |line, i| {
+                if (i > 0)
+                    try writer.writeAll("<br>" ++ line_ending);
+                try writer.print("{}", .{fmtHtml(line)});
+            }
+            try writer.writeAll("</blockquote>" ++ line_ending);
+        },
+        .link => |link| {
+            if (link.title) |title| {
+                try writer.print("<p><a href=\"{s}\">{}</a></p>" ++ line_ending, .{ link.href, fmtHtml(title) });
+            } else {
+                try writer.print("<p><a href=\"{s}\">{}</a></p>" ++ line_ending, .{ link.href, fmtHtml(link.href) });
+            }
+        },
+        .list => |list| {
+            try writer.writeAll("<ul>" ++ line_ending);
+            for (list.lines) |line| {
+                try writer.print("<li>{}</li>" ++ line_ending, .{fmtHtml(line)});
+            }
+            try writer.writeAll("</ul>" ++ line_ending);
+        },
+        .heading => |heading| {
+            const tag = @tagName(heading.level);
+            if (anchors) |generator| {
+                const heading_id = try generator.id(heading.text);
+                try writer.print("<{s} id=\"{s}\">{}</{s}>" ++ line_ending, .{ tag, heading_id, fmtHtml(heading.text), tag });
+                if (@TypeOf(toc) != @TypeOf(null)) {
+                    const depth: usize = switch (heading.level) {
+                        .h1 => 1,
+                        .h2 => 2,
+                        .h3 => 3,
+                    };
+                    try generator.writeTocEntry(depth, heading_id, heading.text, toc);
                 }
-            },
-        }
+            } else {
+                try writer.print("<{s}>{}</{s}>" ++ line_ending, .{ tag, fmtHtml(heading.text), tag });
+            }
+        },
     }
 }
@@ -0,0 +1,315 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const gemtext = @import("gemtext.zig");
+const Fragment = gemtext.Fragment;
+const Document = gemtext.Document;
+
+/// A document cache in a shared memory segment that can be read by many processes at once.
+///
+/// The segment is created by a single builder process with `create`, which is the only
+/// process allowed to insert entries. Worker processes map the same segment read-only
+/// with `open`, either by inheriting the file descriptor through `fork()` or by receiving
+/// it over a unix socket.
+///
+/// Entries are append-only: a key can only be inserted once, and the segment is never
+/// compacted. To update documents, the builder creates a fresh segment and hands it out
+/// to the workers.
+///
+/// Lookups are lock-free. The index is an open-addressing hash table with linear probing,
+/// and each slot is published by storing its hash last with release semantics, so readers
+/// never observe partially written entries.
+pub const SharedCache = struct {
+    const Self = @This();
+
+    comptime {
+        if (builtin.os.tag != .linux)
+            @compileError("SharedCache requires memfd_create() and is only available on Linux!");
+    }
+
+    /// The kind of data stored for a source.
+    pub const Kind = enum(u8) {
+        /// The compiled document, stored as canonical gemini text.
+        document,
+        gemtext,
+        html,
+        markdown,
+        rtf,
+
+        /// Returns the kind for output rendered with `format`.
+        pub fn rendered(format: gemtext.renderer.Format) Kind {
+            return switch (format) {
+                .gemtext => .gemtext,
+                .html => .html,
+                .markdown => .markdown,
+                .rtf => .rtf,
+            };
+        }
+    };
+
+    pub const Error = error{
+        /// The data region of the segment is full.
+        OutOfSpace,
+        /// The index of the segment is full.
+        OutOfSlots,
+        /// An entry with the same source and kind already exists.
+        DuplicateKey,
+    };
+
+    const magic: u32 = 0x43535447; // "GTSC"
+    const layout_version: u32 = 1;
+
+    /// Fill factor of the index in percent. Beyond this, probe sequences get long.
+    const max_load_percentage = 75;
+
+    const Header = extern struct {
+        magic: u32,
+        version: u32,
+        slot_count: u64,
+        data_offset: u64,
+        data_capacity: u64,
+        data_used: u64,
+        entry_count: u64,
+    };
+
+    const Slot = extern struct {
+        /// The hash of the key. Zero marks an empty slot. Written last when publishing an entry.
+        hash: u64,
+        key_offset: u64,
+        key_len: u64,
+        value_offset: u64,
+        value_len: u64,
+        kind: Kind,
+        reserved: [7]u8,
+    };
+
+    memory: []align(std.mem.page_size) u8,
+    fd: std.posix.fd_t,
+    writable: bool,
+
+    /// Creates a new shared segment of `size` bytes with an index of `slot_count` slots.
+    /// `slot_count` must be a power of two. The returned cache owns `fd` and may insert entries.
+    pub fn create(size: usize, slot_count: usize) !Self {
+        std.debug.assert(std.math.isPowerOfTwo(slot_count));
+
+        const data_offset = std.mem.alignForward(usize, @sizeOf(Header) + slot_count * @sizeOf(Slot), 64);
+        if (data_offset >= size)
+            return error.OutOfSpace;
+
+        const fd = try std.posix.memfd_create("gemtext-cache", 0);
+        errdefer std.posix.close(fd);
+
+        try std.posix.ftruncate(fd, size);
+
+        const memory = try std.posix.mmap(
+            null,
+            size,
+            std.posix.PROT.READ | std.posix.PROT.WRITE,
+            .{ .TYPE = .SHARED },
+            fd,
+            0,
+        );
+
+        // memfd segments are zero-filled, so all slots start out empty.
+        const header: *Header = @ptrCast(memory.ptr);
+        header.* = Header{
+            .magic = magic,
+            .version = layout_version,
+            .slot_count = slot_count,
+            .data_offset = data_offset,
+            .data_capacity = size - data_offset,
+            .data_used = 0,
+            .entry_count = 0,
+        };
+
+        return Self{
+            .memory = memory,
+            .fd = fd,
+            .writable = true,
+        };
+    }
+
+    /// Maps an existing segment read-only. `fd` is not owned by the returned cache.
+    pub fn open(fd: std.posix.fd_t) !Self {
+        const stat = try std.posix.fstat(fd);
+        const size: usize = @intCast(stat.size);
+        if (size < @sizeOf(Header))
+            return error.InvalidSegment;
+
+        const memory = try std.posix.mmap(
+            null,
+            size,
+            std.posix.PROT.READ,
+            .{ .TYPE = .SHARED },
+            fd,
+            0,
+        );
+        errdefer std.posix.munmap(memory);
+
+        const header: *const Header = @ptrCast(memory.ptr);
+        if (header.magic != magic or header.version != layout_version)
+            return error.InvalidSegment;
+        if (!std.math.isPowerOfTwo(header.slot_count))
+            return error.InvalidSegment;
+        // The header may be corrupt or hostile, so none of the sums may overflow.
+        const slots_size = std.math.mul(u64, header.slot_count, @sizeOf(Slot)) catch return error.InvalidSegment;
+        if (header.data_offset < @sizeOf(Header) +| slots_size)
+            return error.InvalidSegment;
+        if (header.data_offset > size or header.data_capacity > size - header.data_offset)
+            return error.InvalidSegment;
+
+        return Self{
+            .memory = memory,
+            .fd = fd,
+            .writable = false,
+        };
+    }
+
+    /// Unmaps the segment. The builder also closes the segment file descriptor;
+    /// the memory stays valid for all other processes that still map it.
+    pub fn deinit(self: *Self) void {
+        std.posix.munmap(self.memory);
+        if (self.writable)
+            std.posix.close(self.fd);
+        self.* = undefined;
+    }
+
+    /// Stores a copy of `value` for `source` and `kind`.
+    pub fn insert(self: *Self, source: []const u8, kind: Kind, value: []const u8) Error!void {
+        const slot = try self.reserveSlot(source, kind);
+        const region = self.freeRegion();
+        if (region.len < source.len + value.len)
+            return error.OutOfSpace;
+
+        @memcpy(region[0..source.len], source);
+        @memcpy(region[source.len..][0..value.len], value);
+
+        self.publish(slot, source, kind, value.len);
+    }
+
+    /// Renders `fragments` directly into the segment and stores them for `source` and `kind`.
+    /// `.document` entries are rendered as canonical gemini text.
+    pub fn render(self: *Self, source: []const u8, kind: Kind, fragments: []const Fragment) Error!void {
+        const slot = try self.reserveSlot(source, kind);
+        const region = self.freeRegion();
+        if (region.len < source.len)
+            return error.OutOfSpace;
+
+        @memcpy(region[0..source.len], source);
+
+        var stream = std.io.fixedBufferStream(region[source.len..]);
+        const format: gemtext.renderer.Format = switch (kind) {
+            .document, .gemtext => .gemtext,
+            .html => .html,
+            .markdown => .markdown,
+            .rtf => .rtf,
+        };
+        gemtext.renderer.render(format, fragments, stream.writer()) catch return error.OutOfSpace;
+
+        self.publish(slot, source, kind, stream.getWritten().len);
+    }
+
+    /// Returns the bytes stored for `source` and `kind`, or `null` if there are none.
+    /// The returned slice points into the shared segment and stays valid until `deinit`.
+    pub fn get(self: Self, source: []const u8, kind: Kind) ?[]const u8 {
+        const slots = self.slots();
+        const mask = slots.len - 1;
+        const hash = hashKey(source, kind);
+
+        var index = hash & mask;
+        var probes: usize = 0;
+        while (probes < slots.len) : (probes += 1) {
+            const slot = &slots[index];
+            const slot_hash = @atomicLoad(u64, &slot.hash, .acquire);
+            if (slot_hash == 0)
+                return null;
+            if (slot_hash == hash and self.slotMatches(slot, source, kind)) {
+                if (slot.value_offset + slot.value_len > self.memory.len)
+                    return null;
+                return self.memory[slot.value_offset..][0..slot.value_len];
+            }
+            index = (index + 1) & mask;
+        }
+        return null;
+    }
+
+    /// Parses the document stored for `source`, or returns `null` if there is none.
+    pub fn parseDocument(self: Self, allocator: std.mem.Allocator, source: []const u8) !?Document {
+        const text = self.get(source, .document) orelse return null;
+        return try Document.parseString(allocator, text);
+    }
+
+    /// Returns the number of stored entries.
+    pub fn count(self: Self) usize {
+        return @atomicLoad(u64, &self.header().entry_count, .acquire);
+    }
+
+    fn header(self: Self) *Header {
+        return @ptrCast(self.memory.ptr);
+    }
+
+    fn slots(self: Self) []Slot {
+        const slot_count = self.header().slot_count;
+        const first: [*]Slot = @ptrCast(@alignCast(self.memory.ptr + @sizeOf(Header)));
+        return first[0..slot_count];
+    }
+
+    fn freeRegion(self: Self) []u8 {
+        const hdr = self.header();
+        return self.memory[hdr.data_offset + hdr.data_used .. hdr.data_offset + hdr.data_capacity];
+    }
+
+    fn slotMatches(self: Self, slot: *const Slot, source: []const u8, kind: Kind) bool {
+        if (slot.kind != kind or slot.key_len != source.len)
+            return false;
+        if (slot.key_offset + slot.key_len > self.memory.len)
+            return false;
+        return std.mem.eql(u8, self.memory[slot.key_offset..][0..slot.key_len], source);
+    }
+
+    /// Finds the empty slot for a new key. Only called by the builder, so slots can't change concurrently.
+    fn reserveSlot(self: *Self, source: []const u8, kind: Kind) Error!*Slot {
+        std.debug.assert(self.writable);
+
+        const hdr = self.header();
+        if (100 * (hdr.entry_count + 1) > max_load_percentage * hdr.slot_count)
+            return error.OutOfSlots;
+
+        const slots = self.slots();
+        const mask = slots.len - 1;
+        const hash = hashKey(source, kind);
+
+        var index = hash & mask;
+        while (true) : (index = (index + 1) & mask) {
+            const slot = &slots[index];
+            if (slot.hash == 0)
+                return slot;
+            if (slot.hash == hash and self.slotMatches(slot, source, kind))
+                return error.DuplicateKey;
+        }
+    }
+
+    /// Makes an entry whose key and value were written to the start of the free region visible to readers.
+    fn publish(self: *Self, slot: *Slot, source: []const u8, kind: Kind, value_len: usize) void {
+        const hdr = self.header();
+        const key_offset = hdr.data_offset + hdr.data_used;
+
+        slot.key_offset = key_offset;
+        slot.key_len = source.len;
+        slot.value_offset = key_offset + source.len;
+        slot.value_len = value_len;
+        slot.kind = kind;
+        slot.reserved = [_]u8{0} ** 7;
+
+        hdr.data_used += source.len + value_len;
+        @atomicStore(u64, &hdr.entry_count, hdr.entry_count + 1, .release);
+        @atomicStore(u64, &slot.hash, hashKey(source, kind), .release);
+    }
+
+    fn hashKey(source: []const u8, kind: Kind) u64 {
+        var hasher = std.hash.Wyhash.init(@intFromEnum(kind));
+        hasher.update(source);
+        const hash = hasher.final();
+        // zero marks empty slots
+        return if (hash == 0) 1 else hash;
+    }
+};
@@ -0,0 +1,247 @@
+const std = @import("std");
+const kernels = @import("kernels.zig");
+const FragmentType = @import("gemtext.zig").FragmentType;
+
+const legal_whitespace = "\t ";
+
+/// The scheme of a link target.
+pub const LinkScheme = enum {
+    /// A link without a scheme, relative to the document.
+    relative,
+    gemini,
+    https,
+    http,
+    gopher,
+    mailto,
+    other,
+
+    /// Returns the scheme of `href`. Schemes are compared case-insensitively.
+    pub fn of(href: []const u8) LinkScheme {
+        const end = std.mem.indexOfAny(u8, href, ":/?#") orelse return .relative;
+        if (href[end] != ':' or end == 0)
+            return .relative;
+        const scheme = href[0..end];
+        inline for (comptime std.enums.values(LinkScheme)) |tag| {
+            if (tag != .relative and tag != .other and std.ascii.eqlIgnoreCase(scheme, @tagName(tag)))
+                return tag;
+        }
+        return .other;
+    }
+};
+
+/// Statistics of a gemini text document, collected without building fragments.
+pub const Statistics = struct {
+    const Self = @This();
+
+    /// The number of fragments the parser produces for the document, per type.
+    fragments: std.EnumArray(FragmentType, usize) = std.EnumArray(FragmentType, usize).initFill(0),
+    /// The number of lines, including a last line without a line feed.
+    lines: usize = 0,
+    /// The size of the document.
+    bytes: usize = 0,
+    /// The number of words in headings, paragraphs, lists, quotes and link titles.
+    words: usize = 0,
+    /// The number of bytes in the longest line, excluding the line ending.
+    longest_line: usize = 0,
+    /// The number of lines inside preformatted blocks, excluding the fences.
+    preformatted_lines: usize = 0,
+    /// The number of bytes of the lines inside preformatted blocks, excluding line endings.
+    preformatted_bytes: usize = 0,
+    /// The number of links, per scheme of their target.
+    links: std.EnumArray(LinkScheme, usize) = std.EnumArray(LinkScheme, usize).initFill(0),
+
+    /// Collects the statistics of the complete document `text` without allocating.
+    pub fn collect(text: []const u8) Self {
+        var collector = Collector{ .allocator = undefined };
+        collector.statistics.bytes = text.len;
+
+        var rest = text;
+        while (rest.len > 0) {
+            const end = kernels.indexOfNewline(rest);
+            collector.countLine(rest[0..end]);
+            rest = rest[@min(end + 1, rest.len)..];
+        }
+        return collector.statistics;
+    }
+
+    /// Adds the statistics of `other` to these, for example to sum up a corpus.
+    /// The longest line is the longer one of both.
+    pub fn add(self: *Self, other: Self) void {
+        inline for (comptime std.enums.values(FragmentType)) |tag| {
+            self.fragments.getPtr(tag).* += other.fragments.get(tag);
+        }
+        inline for (comptime std.enums.values(LinkScheme)) |tag| {
+            self.links.getPtr(tag).* += other.links.get(tag);
+        }
+        self.lines += other.lines;
+        self.bytes += other.bytes;
+        self.words += other.words;
+        self.longest_line = @max(self.longest_line, other.longest_line);
+        self.preformatted_lines += other.preformatted_lines;
+        self.preformatted_bytes += other.preformatted_bytes;
+    }
+
+    /// The total number of links.
+    pub fn linkCount(self: Self) usize {
+        var count: usize = 0;
+        for (self.links.values) |value| {
+            count += value;
+        }
+        return count;
+    }
+
+    /// Collects statistics of a document that is fed in chunks, like `Parser`.
+    /// Lines are counted straight from the fed chunks; only a line that is
+    /// split across two chunks is copied.
+    pub const Collector = struct {
+        allocator: std.mem.Allocator,
+        statistics: Self = .{},
+        state: enum { default, list, quote, preformatted } = .default,
+        /// The start of a line that continues in the next chunk.
+        partial: std.ArrayListUnmanaged(u8) = .{},
+
+        pub fn init(allocator: std.mem.Allocator) Collector {
+            return Collector{ .allocator = allocator };
+        }
+
+        pub fn deinit(self: *Collector) void {
+            self.partial.deinit(self.allocator);
+            self.* = undefined;
+        }
+
+        /// Counts the next `slice` of the document.
+        pub fn feed(self: *Collector, slice: []const u8) !void {
+            self.statistics.bytes += slice.len;
+
+            var rest = slice;
+            if (self.partial.items.len > 0) {
+                const end = kernels.indexOfNewline(rest);
+                try self.partial.appendSlice(self.allocator, rest[0..end]);
+                if (end == rest.len)
+                    return;
+                self.countLine(self.partial.items);
+                self.partial.clearRetainingCapacity();
+                rest = rest[end + 1 ..];
+            }
+
+            while (rest.len > 0) {
+                const end = kernels.indexOfNewline(rest);
+                if (end == rest.len) {
+                    try self.partial.appendSlice(self.allocator, rest);
+                    return;
+                }
+                self.countLine(rest[0..end]);
+                rest = rest[end + 1 ..];
+            }
+        }
+
+        /// Counts a last line without a line feed and returns the statistics of the document.
+        pub fn finalize(self: *Collector) Self {
+            if (self.partial.items.len > 0) {
+                self.countLine(self.partial.items);
+                self.partial.clearRetainingCapacity();
+            }
+            return self.statistics;
+        }
+
+        fn countLine(self: *Collector, raw_line: []const u8) void {
+            const stats = &self.statistics;
+
+            var line = raw_line;
+            if (line.len > 0 and line[line.len - 1] == '\r')
+                line = line[0 .. line.len - 1];
+
+            stats.lines += 1;
+            stats.longest_line = @max(stats.longest_line, line.len);
+
+            const kind = kernels.classifyLine(line);
+            if (self.state == .preformatted) {
+                if (kind == .preformatted_toggle) {
+                    self.state = .default;
+                } else {
+                    stats.preformatted_lines += 1;
+                    stats.preformatted_bytes += line.len;
+                }
+                return;
+            }
+
+            // Blocks are counted when they start, so unterminated blocks are counted too.
+            switch (kind) {
+                .list => {
+                    if (self.state != .list)
+                        stats.fragments.getPtr(.list).* += 1;
+                    self.state = .list;
+                    stats.words += countWords(line[2..]);
+                },
+                .quote => {
+                    if (self.state != .quote)
+                        stats.fragments.getPtr(.quote).* += 1;
+                    self.state = .quote;
+                    stats.words += countWords(line[1..]);
+                },
+                .preformatted_toggle => {
+                    stats.fragments.getPtr(.preformatted).* += 1;
+                    self.state = .preformatted;
+                },
+                .heading_1, .heading_2, .heading_3, .link, .text => {
+                    self.state = .default;
+                    if (std.mem.trim(u8, line, legal_whitespace).len == 0) {
+                        stats.fragments.getPtr(.empty).* += 1;
+                        return;
+                    }
+                    switch (kind) {
+                        .heading_1, .heading_2, .heading_3 => {
+                            stats.fragments.getPtr(.heading).* += 1;
+                            stats.words += countWords(std.mem.trimLeft(u8, line, "#"));
+                        },
+                        .link => {
+                            stats.fragments.getPtr(.link).* += 1;
+
+                            const content = std.mem.trim(u8, line[2..], legal_whitespace);
+                            const split = std.mem.indexOfAny(u8, content, legal_whitespace) orelse content.len;
+                            stats.links.getPtr(LinkScheme.of(content[0..split])).* += 1;
+                            stats.words += countWords(content[split..]);
+                        },
+                        else => {
+                            stats.fragments.getPtr(.paragraph).* += 1;
+                            stats.words += countWords(line);
+                        },
+                    }
+                },
+            }
+        }
+    };
+};
+
+/// Counts the runs of non-whitespace characters in `text`.
+fn countWords(text: []const u8) usize {
+    const vector_len = std.simd.suggestVectorLength(u8) orelse 16;
+    const Vector = @Vector(vector_len, u8);
+    const zero: Vector = @splat(0);
+    const one: Vector = @splat(1);
+
+    var count: usize = 0;
+    // Whether the byte before the current one is whitespace, as 0 or 1.
+    var previous_space: u8 = 1;
+
+    var offset: usize = 0;
+    while (offset + vector_len <= text.len) : (offset += vector_len) {
+        const chunk: Vector = text[offset..][0..vector_len].*;
+        const space = @select(u8, chunk == @as(Vector, @splat(' ')), one, zero) |
+            @select(u8, chunk == @as(Vector, @splat('\t')), one, zero);
+
+        // A word starts at every non-whitespace byte after a whitespace byte.
+        const before = std.simd.shiftElementsRight(space, 1, previous_space);
+        const starts = (one - space) & before;
+        count += @reduce(.Add, starts);
+
+        previous_space = space[vector_len - 1];
+    }
+
+    for (text[offset..]) |c| {
+        const space: u8 = if (c == ' ' or c == '\t') 1 else 0;
+        count += (1 - space) & previous_space;
+        previous_space = space;
+    }
+    return count;
+}
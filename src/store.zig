@@ -0,0 +1,223 @@
+const std = @import("std");
+const gemtext = @import("gemtext.zig");
+const Document = gemtext.Document;
+
+/// A keyed collection of gemtext documents that keeps cold documents compressed
+/// in memory and decompresses them on access.
+///
+/// Documents are stored as deflate-compressed canonical gemini text, which the
+/// parser reads back into the same fragments. The most recently accessed documents
+/// are kept parsed in an LRU list; the least recently used ones are dropped back
+/// to their compressed form when the memory budget is exceeded.
+///
+/// The store is not thread-safe. Use one store per thread or guard it with a lock.
+pub const DocumentStore = struct {
+    const Self = @This();
+
+    pub const Options = struct {
+        /// The number of bytes the store may use for compressed and hot documents together.
+        /// Compressed documents are never evicted, so only the hot documents are bounded by this.
+        memory_budget: usize = 64 * 1024 * 1024,
+
+        /// The compression settings for cold documents.
+        compression: std.compress.flate.Options = .{ .level = .fast },
+    };
+
+    pub const Stats = struct {
+        /// Total number of stored documents.
+        documents: usize,
+        /// Number of documents that are currently held in parsed form.
+        hot_documents: usize,
+        /// Number of bytes used by the compressed documents.
+        compressed_bytes: usize,
+        /// Number of bytes used by the parsed documents.
+        hot_bytes: usize,
+        /// Number of `get` calls that found a parsed document.
+        hits: u64,
+        /// Number of `get` calls that had to decompress and parse the document.
+        misses: u64,
+
+        /// Returns the fraction of `get` calls that were served without decompression.
+        pub fn hitRate(self: Stats) f64 {
+            const total = self.hits + self.misses;
+            if (total == 0)
+                return 0.0;
+            return @as(f64, @floatFromInt(self.hits)) / @as(f64, @floatFromInt(total));
+        }
+
+        /// Returns the number of bytes used by the store.
+        pub fn memoryUsage(self: Stats) usize {
+            return self.compressed_bytes + self.hot_bytes;
+        }
+    };
+
+    const LruList = std.DoublyLinkedList(*Entry);
+
+    const Entry = struct {
+        key: []const u8,
+        compressed: []u8,
+        hot: ?Document,
+        hot_size: usize,
+        node: LruList.Node,
+    };
+
+    allocator: std.mem.Allocator,
+    options: Options,
+    entries: std.StringHashMap(*Entry),
+    lru: LruList,
+    scratch: std.ArrayList(u8),
+    compressed_bytes: usize,
+    hot_bytes: usize,
+    hits: u64,
+    misses: u64,
+
+    pub fn init(allocator: std.mem.Allocator, options: Options) Self {
+        return Self{
+            .allocator = allocator,
+            .options = options,
+            .entries = std.StringHashMap(*Entry).init(allocator),
+            .lru = LruList{},
+            .scratch = std.ArrayList(u8).init(allocator),
+            .compressed_bytes = 0,
+            .hot_bytes = 0,
+            .hits = 0,
+            .misses = 0,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        var iter = self.entries.valueIterator();
+        while (iter.next()) |entry| {
+            self.destroyEntry(entry.*);
+        }
+        self.entries.deinit();
+        self.scratch.deinit();
+        self.* = undefined;
+    }
+
+    /// Stores a copy of `document` under `key`, replacing any previous document with that key.
+    /// The document is compressed right away, `document` is not referenced after the call.
+    pub fn put(self: *Self, key: []const u8, document: Document) !void {
+        self.scratch.shrinkRetainingCapacity(0);
+        try document.render(self.scratch.writer());
+
+        var compressed = std.ArrayList(u8).init(self.allocator);
+        defer compressed.deinit();
+
+        var stream = std.io.fixedBufferStream(self.scratch.items);
+        try std.compress.flate.compress(stream.reader(), compressed.writer(), self.options.compression);
+
+        const compressed_slice = try compressed.toOwnedSlice();
+        errdefer self.allocator.free(compressed_slice);
+
+        if (self.entries.get(key)) |entry| {
+            self.dropHot(entry);
+            self.compressed_bytes -= entry.compressed.len;
+            self.allocator.free(entry.compressed);
+            entry.compressed = compressed_slice;
+        } else {
+            const entry = try self.allocator.create(Entry);
+            errdefer self.allocator.destroy(entry);
+
+            const owned_key = try self.allocator.dupe(u8, key);
+            errdefer self.allocator.free(owned_key);
+
+            entry.* = Entry{
+                .key = owned_key,
+                .compressed = compressed_slice,
+                .hot = null,
+                .hot_size = 0,
+                .node = LruList.Node{ .data = entry },
+            };
+
+            try self.entries.put(owned_key, entry);
+        }
+        self.compressed_bytes += compressed_slice.len;
+
+        self.evict(null);
+    }
+
+    /// Returns the document stored under `key` or `null` if there is none.
+    /// Cold documents are decompressed and parsed on access.
+    /// The returned document is owned by the store and is valid until the next call
+    /// to `put`, `get` or `remove`.
+    pub fn get(self: *Self, key: []const u8) !?*const Document {
+        const entry = self.entries.get(key) orelse return null;
+
+        if (entry.hot) |*document| {
+            self.hits += 1;
+            self.lru.remove(&entry.node);
+            self.lru.prepend(&entry.node);
+            return document;
+        }
+        self.misses += 1;
+
+        self.scratch.shrinkRetainingCapacity(0);
+        var stream = std.io.fixedBufferStream(entry.compressed);
+        try std.compress.flate.decompress(stream.reader(), self.scratch.writer());
+
+        var document = try Document.parseString(self.allocator, self.scratch.items);
+        errdefer document.deinit();
+
+        entry.hot_size = documentSize(&document);
+        entry.hot = document;
+        self.hot_bytes += entry.hot_size;
+        self.lru.prepend(&entry.node);
+
+        self.evict(entry);
+
+        return &entry.hot.?;
+    }
+
+    /// Removes the document stored under `key`. Returns `true` if a document was removed.
+    pub fn remove(self: *Self, key: []const u8) bool {
+        const kv = self.entries.fetchRemove(key) orelse return false;
+        self.destroyEntry(kv.value);
+        return true;
+    }
+
+    /// Returns the current memory usage and access statistics.
+    pub fn stats(self: Self) Stats {
+        return Stats{
+            .documents = self.entries.count(),
+            .hot_documents = self.lru.len,
+            .compressed_bytes = self.compressed_bytes,
+            .hot_bytes = self.hot_bytes,
+            .hits = self.hits,
+            .misses = self.misses,
+        };
+    }
+
+    /// Drops hot documents, starting with the least recently used one, until the store
+    /// fits into the memory budget again. `keep` is never evicted.
+    fn evict(self: *Self, keep: ?*Entry) void {
+        while (self.compressed_bytes + self.hot_bytes > self.options.memory_budget) {
+            const node = self.lru.last orelse break;
+            if (node.data == keep)
+                break;
+            self.dropHot(node.data);
+        }
+    }
+
+    fn dropHot(self: *Self, entry: *Entry) void {
+        if (entry.hot) |*document| {
+            document.deinit();
+            entry.hot = null;
+            self.hot_bytes -= entry.hot_size;
+            entry.hot_size = 0;
+            self.lru.remove(&entry.node);
+        }
+    }
+
+    fn destroyEntry(self: *Self, entry: *Entry) void {
+        self.dropHot(entry);
+        self.compressed_bytes -= entry.compressed.len;
+        self.allocator.free(entry.compressed);
+        self.allocator.free(entry.key);
+        self.allocator.destroy(entry);
+    }
+
+    fn documentSize(document: *const Document) usize {
+        return document.arena.queryCapacity() + document.fragments.capacity * @sizeOf(gemtext.Fragment);
+    }
+};
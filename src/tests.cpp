@@ -0,0 +1,398 @@
+//! Tests for the C++ bindings in include/gemtext.hpp.
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory_resource>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "gemtext.hpp"
+
+#define EXPECT(cond)                                                                   \
+  do                                                                                   \
+  {                                                                                    \
+    if (!(cond))                                                                       \
+    {                                                                                  \
+      std::fprintf(stderr, "%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #cond); \
+      std::exit(1);                                                                    \
+    }                                                                                  \
+  } while (false)
+
+static constexpr std::string_view features =
+    "# Heading\n"
+    "Paragraph\n"
+    "=> gemini://example.com/ Example\n"
+    "=> gemini://example.com/bare\n"
+    "* one\n"
+    "* two\n"
+    "> quote\n"
+    "```alt\n"
+    "code\n"
+    "```\n";
+
+static void testDocumentViews()
+{
+  auto document = gemtext::Document::parse(features);
+  EXPECT(document.size() == 6);
+
+  auto heading = std::get<gemtext::heading>(document[0]);
+  EXPECT(heading.level == GEMTEXT_HEADING_H1);
+  EXPECT(heading.text == "Heading");
+
+  EXPECT(std::get<gemtext::paragraph>(document[1]).text == "Paragraph");
+
+  auto link = std::get<gemtext::link>(document[2]);
+  EXPECT(link.href == "gemini://example.com/");
+  EXPECT(link.title == "Example");
+  EXPECT(!std::get<gemtext::link>(document[3]).title);
+
+  auto list = std::get<gemtext::list>(document[4]);
+  EXPECT(list.lines.size() == 2);
+  EXPECT(list.lines[1] == "two");
+
+  // the views point into the document, nothing is copied
+  EXPECT(heading.text.data() == document.fragments()[0].heading.text);
+}
+
+static void testVisit()
+{
+  auto document = gemtext::Document::parse(features);
+
+  std::size_t lines = 0;
+  std::vector<std::string_view> alt_texts;
+  for (auto const &fragment : document)
+  {
+    gemtext::visit(fragment, gemtext::overloaded{
+                                 [&](gemtext::list const &list)
+                                 { lines += list.lines.size(); },
+                                 [&](gemtext::quote const &quote)
+                                 { lines += quote.lines.size(); },
+                                 [&](gemtext::preformatted const &pre)
+                                 {
+                                   lines += pre.lines.size();
+                                   alt_texts.push_back(pre.alt_text.value_or(""));
+                                 },
+                                 [](auto const &) {},
+                             });
+  }
+  EXPECT(lines == 4);
+  EXPECT(alt_texts.size() == 1 && alt_texts[0] == "alt");
+}
+
+static void testParserAndMove()
+{
+  gemtext::Parser parser;
+  std::vector<gemtext::Fragment> fragments;
+
+  std::string_view input = features;
+  while (!input.empty())
+  {
+    auto result = parser.feed(input.substr(0, 3));
+    if (result.fragment)
+      fragments.push_back(std::move(*result.fragment));
+    input.remove_prefix(result.consumed);
+  }
+
+  gemtext::Parser moved = std::move(parser);
+  if (auto fragment = moved.finalize())
+    fragments.push_back(std::move(*fragment));
+
+  EXPECT(fragments.size() == 6);
+  EXPECT(fragments[0].type() == GEMTEXT_FRAGMENT_HEADING);
+  EXPECT(fragments[5].type() == GEMTEXT_FRAGMENT_PREFORMATTED);
+  EXPECT(std::get<gemtext::preformatted>(fragments[5].view()).lines[0] == "code");
+}
+
+static void testRender()
+{
+  auto document = gemtext::Document::parse("# Title\n");
+
+  std::string html;
+  document.render(GEMTEXT_RENDER_HTML, [&](std::string_view bytes)
+                  { html.append(bytes); });
+  EXPECT(html.find("Title") != std::string::npos);
+
+  gemtext::Document copy;
+  copy.append(document.fragments()[0]);
+  std::string text;
+  copy.render(GEMTEXT_RENDER_GEMTEXT, [&](std::string_view bytes)
+              { text.append(bytes); });
+  EXPECT(text == "# Title\r\n");
+}
+
+static void testErrors()
+{
+  gemtext::Parser parser;
+  gemtext_parser_limits limits{};
+  limits.max_line_length = 4;
+  parser.set_limits(limits);
+
+  try
+  {
+    parser.feed("too long\n");
+    EXPECT(false);
+  }
+  catch (gemtext::error const &err)
+  {
+    EXPECT(err.code() == GEMTEXT_ERR_LINE_TOO_LONG);
+  }
+
+  gemtext::Document document;
+  try
+  {
+    document.remove(0);
+    EXPECT(false);
+  }
+  catch (gemtext::error const &err)
+  {
+    EXPECT(err.code() == GEMTEXT_ERR_OUT_OF_BOUNDS);
+  }
+}
+
+static void testParseRange()
+{
+  std::size_t count = 0;
+  for (auto &&fragment : gemtext::parse(features))
+  {
+    EXPECT(fragment.type() != GEMTEXT_FRAGMENT_EMPTY);
+    count += 1;
+  }
+  EXPECT(count == 6);
+
+  std::istringstream stream{std::string(features)};
+  stream >> std::noskipws;
+
+  std::vector<std::string> hrefs;
+  auto links = gemtext::parse(std::views::istream<char>(stream)) |
+               std::views::filter([](gemtext::Fragment const &fragment)
+                                  { return fragment.type() == GEMTEXT_FRAGMENT_LINK; }) |
+               std::views::transform([](gemtext::Fragment const &fragment)
+                                     { return std::string(std::get<gemtext::link>(fragment.view()).href); });
+  for (auto &&href : links)
+    hrefs.push_back(href);
+
+  EXPECT(hrefs.size() == 2);
+  EXPECT(hrefs[0] == "gemini://example.com/");
+  EXPECT(hrefs[1] == "gemini://example.com/bare");
+}
+
+static void testParseRangeMoveOut()
+{
+  std::vector<gemtext::Fragment> fragments;
+  for (auto &&fragment : gemtext::parse(std::string_view("# One\n\n# Two")))
+    fragments.push_back(std::move(fragment));
+
+  EXPECT(fragments.size() == 3);
+  EXPECT(std::get<gemtext::heading>(fragments[2].view()).text == "Two");
+}
+
+/// A minimal event loop: suspended coroutines wait in a queue until the loop resumes them.
+struct EventLoop
+{
+  std::deque<std::coroutine_handle<>> ready;
+
+  auto yield()
+  {
+    struct awaiter
+    {
+      EventLoop &loop;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) { loop.ready.push_back(handle); }
+      void await_resume() const noexcept {}
+    };
+    return awaiter{*this};
+  }
+
+  void run()
+  {
+    while (!ready.empty())
+    {
+      auto handle = ready.front();
+      ready.pop_front();
+      handle.resume();
+    }
+  }
+};
+
+/// The client side of the connection. Every read would block once and then returns a few bytes.
+struct Connection
+{
+  EventLoop &loop;
+  std::string_view input;
+  std::string output;
+  std::size_t writes = 0;
+
+  gemtext::task<std::size_t> read(std::span<char> buffer)
+  {
+    co_await loop.yield();
+    std::size_t const length = std::min({buffer.size(), input.size(), std::size_t(5)});
+    input.copy(buffer.data(), length);
+    input.remove_prefix(length);
+    co_return length;
+  }
+
+  gemtext::task<void> write(std::string_view bytes)
+  {
+    co_await loop.yield();
+    output.append(bytes);
+    writes += 1;
+  }
+};
+
+static gemtext::task<std::size_t> echo(Connection &connection)
+{
+  gemtext::AsyncParser parser;
+  std::size_t fragments = 0;
+  while (auto fragment = co_await parser.next_fragment(connection))
+  {
+    co_await gemtext::render(*fragment, GEMTEXT_RENDER_GEMTEXT, connection);
+    fragments += 1;
+  }
+  co_return fragments;
+}
+
+static void testCoroutineEcho()
+{
+  EventLoop loop;
+  Connection first{loop, features, {}};
+  Connection second{loop, "# Hello\n* a\n* b", {}};
+
+  auto first_echo = echo(first);
+  auto second_echo = echo(second);
+  first_echo.start();
+  second_echo.start();
+  EXPECT(!first_echo.done() && !second_echo.done());
+
+  loop.run();
+  EXPECT(first_echo.done() && second_echo.done());
+  EXPECT(first_echo.get() == 6);
+  EXPECT(second_echo.get() == 2);
+
+  std::string expected;
+  gemtext::Document::parse(features).render(GEMTEXT_RENDER_GEMTEXT, [&](std::string_view bytes)
+                                            { expected.append(bytes); });
+  EXPECT(first.output == expected);
+  EXPECT(first.writes == 6);
+  EXPECT(second.output == "# Hello\r\n* a\r\n* b\r\n");
+}
+
+static void testCoroutineRenderDocument()
+{
+  EventLoop loop;
+  Connection connection{loop, {}, {}};
+  auto document = gemtext::Document::parse(features);
+
+  auto render = gemtext::render(document, GEMTEXT_RENDER_HTML, connection);
+  render.start();
+  loop.run();
+  EXPECT(render.done());
+  render.get();
+  EXPECT(connection.writes == document.size());
+  EXPECT(connection.output.find("<h1>Heading</h1>") != std::string::npos);
+}
+
+/// Counts the allocations that reach the upstream resource.
+struct CountingResource : std::pmr::memory_resource
+{
+  std::size_t allocations = 0;
+  std::size_t live_bytes = 0;
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    allocations += 1;
+    live_bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *memory, std::size_t bytes, std::size_t alignment) override
+  {
+    live_bytes -= bytes;
+    std::pmr::new_delete_resource()->deallocate(memory, bytes, alignment);
+  }
+
+  bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+};
+
+static void testMemoryResource()
+{
+  CountingResource resource;
+  {
+    auto document = gemtext::Document::parse(features, &resource);
+    EXPECT(document.size() == 6);
+    EXPECT(resource.allocations > 0);
+
+    gemtext::Document moved = std::move(document);
+    moved.append(moved.fragments()[0]);
+    EXPECT(moved.size() == 7);
+
+    gemtext::Parser parser(&resource);
+    auto result = parser.feed("# Title\n");
+    EXPECT(result.fragment);
+
+    std::size_t count = 0;
+    for (auto &&fragment : gemtext::parse(features, &resource))
+      count += fragment.type() != GEMTEXT_FRAGMENT_EMPTY;
+    EXPECT(count == 6);
+  }
+  EXPECT(resource.live_bytes == 0);
+
+  std::pmr::monotonic_buffer_resource arena(&resource);
+  std::size_t const before = resource.allocations;
+  {
+    auto document = gemtext::Document::parse(features, &arena);
+    EXPECT(document.size() == 6);
+  }
+  arena.release();
+  EXPECT(resource.allocations > before);
+  EXPECT(resource.live_bytes == 0);
+}
+
+static void testStreamSinks()
+{
+  auto document = gemtext::Document::parse(features);
+
+  std::string expected;
+  document.render(GEMTEXT_RENDER_HTML, [&](std::string_view bytes)
+                  { expected.append(bytes); });
+
+  std::ostringstream stream;
+  gemtext::render(document, GEMTEXT_RENDER_HTML, stream) << "trailer";
+  EXPECT(stream.good());
+  EXPECT(stream.str() == expected + "trailer");
+
+  std::stringbuf buffer;
+  EXPECT(document.render(GEMTEXT_RENDER_HTML, buffer));
+  EXPECT(buffer.str() == expected);
+
+  // a buffer that refuses all output makes the stream fail
+  struct FullBuffer : std::streambuf
+  {
+    std::streamsize xsputn(char const *, std::streamsize) override { return 0; }
+  } full;
+  std::ostream broken(&full);
+  EXPECT(broken.good());
+  gemtext::render(document, GEMTEXT_RENDER_HTML, broken);
+  EXPECT(broken.bad());
+}
+
+int main()
+{
+  testDocumentViews();
+  testVisit();
+  testParserAndMove();
+  testRender();
+  testErrors();
+  testParseRange();
+  testParseRangeMoveOut();
+  testCoroutineEcho();
+  testCoroutineRenderDocument();
+  testMemoryResource();
+  testStreamSinks();
+  return 0;
+}
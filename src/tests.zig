@@ -695,11 +695,11 @@ test "render html" {
         \\</ul>
         \\<p>&nbsp;</p>
         \\<p>or empty lines!</p>
-        \\<h2>Code Example</h1>
+        \\<h2>Code Example</h2>
         \\<pre alt="c">int main() {
         \\    return 0;
         \\}</pre>
-        \\<h3>Quotes</h1>
+        \\<h3>Quotes</h3>
         \\<p>we can also quote Einstein</p>
         \\<blockquote>This is a small step for a ziguana<br>
         \\but a great step for zig-kind!</blockquote>
@@ -775,3 +775,566 @@ test "render rtf" {
 
     try testDocumentFormatter(document_rtf, "rtf");
 }
+
+test "document store round trip" {
+    var store = gemini.DocumentStore.init(std.testing.allocator, .{});
+    defer store.deinit();
+
+    var input_stream = std.io.fixedBufferStream(document_text);
+    var document = try Document.parse(std.testing.allocator, input_stream.reader());
+    defer document.deinit();
+
+    try store.put("features", document);
+
+    try std.testing.expect((try store.get("missing")) == null);
+
+    var output_buffer: [4096]u8 = undefined;
+    for (0..2) |_| {
+        var output_stream = std.io.fixedBufferStream(&output_buffer);
+        const stored = (try store.get("features")).?;
+        try stored.render(output_stream.writer());
+        try std.testing.expectEqualStrings(document_text, output_stream.getWritten());
+    }
+
+    const stats = store.stats();
+    try std.testing.expectEqual(@as(usize, 1), stats.documents);
+    try std.testing.expectEqual(@as(usize, 1), stats.hot_documents);
+    try std.testing.expectEqual(@as(u64, 1), stats.hits);
+    try std.testing.expectEqual(@as(u64, 1), stats.misses);
+
+    try std.testing.expect(store.remove("features"));
+    try std.testing.expectEqual(@as(usize, 0), store.stats().memoryUsage());
+}
+
+test "document store evicts hot documents over budget" {
+    var store = gemini.DocumentStore.init(std.testing.allocator, .{ .memory_budget = 1 });
+    defer store.deinit();
+
+    var document = try Document.parseString(std.testing.allocator, "# Hello\r\nWorld!\r\n");
+    defer document.deinit();
+
+    try store.put("a", document);
+    try store.put("b", document);
+
+    _ = try store.get("a");
+    _ = try store.get("b");
+
+    const stats = store.stats();
+    try std.testing.expectEqual(@as(usize, 2), stats.documents);
+    try std.testing.expectEqual(@as(usize, 1), stats.hot_documents);
+    try std.testing.expectEqual(@as(u64, 2), stats.misses);
+}
+
+test "shared cache entries are visible through a second mapping" {
+    if (@import("builtin").os.tag != .linux)
+        return error.SkipZigTest;
+
+    var builder = try gemini.SharedCache.create(64 * 1024, 64);
+    defer builder.deinit();
+
+    var document = try Document.parseString(std.testing.allocator, document_text);
+    defer document.deinit();
+
+    try builder.render("features.gmi", .document, document.fragments.items);
+    try builder.render("features.gmi", .html, document.fragments.items);
+    try builder.insert("raw.txt", .gemtext, "Hello\r\n");
+
+    try std.testing.expectError(error.DuplicateKey, builder.insert("raw.txt", .gemtext, "World\r\n"));
+
+    var worker = try gemini.SharedCache.open(builder.fd);
+    defer worker.deinit();
+
+    try std.testing.expectEqual(@as(usize, 3), worker.count());
+    try std.testing.expectEqualStrings("Hello\r\n", worker.get("raw.txt", .gemtext).?);
+    try std.testing.expect(worker.get("raw.txt", .html) == null);
+    try std.testing.expect(worker.get("missing.gmi", .document) == null);
+
+    var output = std.ArrayList(u8).init(std.testing.allocator);
+    defer output.deinit();
+    try renderer.html(document.fragments.items, output.writer());
+    try std.testing.expectEqualStrings(output.items, worker.get("features.gmi", .html).?);
+
+    var parsed = (try worker.parseDocument(std.testing.allocator, "features.gmi")).?;
+    defer parsed.deinit();
+    try std.testing.expectEqual(document.fragments.items.len, parsed.fragments.items.len);
+}
+
+test "parser snapshot continues in a fresh parser" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+
+    var expected = try Document.parseString(std.testing.allocator, document_text);
+    defer expected.deinit();
+
+    // split inside the preformatted block, so the snapshot has to carry buffered block lines
+    const split = std.mem.indexOf(u8, document_text, "return 0;").?;
+
+    var fragments = std.ArrayList(Fragment).init(std.testing.allocator);
+    defer fragments.deinit();
+
+    var snapshot = std.ArrayList(u8).init(std.testing.allocator);
+    defer snapshot.deinit();
+
+    {
+        var parser = Parser.init(std.testing.allocator);
+        defer parser.deinit();
+
+        var offset: usize = 0;
+        while (offset < split) {
+            const res = try parser.feed(arena.allocator(), document_text[offset..split]);
+            offset += res.consumed;
+            if (res.fragment) |frag|
+                try fragments.append(frag);
+        }
+
+        try parser.snapshot(snapshot.writer());
+    }
+
+    {
+        var parser = Parser.init(std.testing.allocator);
+        defer parser.deinit();
+
+        var stream = std.io.fixedBufferStream(snapshot.items);
+        try parser.restore(stream.reader());
+
+        var offset: usize = split;
+        while (offset < document_text.len) {
+            const res = try parser.feed(arena.allocator(), document_text[offset..]);
+            offset += res.consumed;
+            if (res.fragment) |frag|
+                try fragments.append(frag);
+        }
+        if (try parser.finalize(arena.allocator())) |frag|
+            try fragments.append(frag);
+    }
+
+    try std.testing.expectEqual(expected.fragments.items.len, fragments.items.len);
+    for (expected.fragments.items, 0..) |frag, i| {
+        try expectFragmentEqual(frag, fragments.items[i]);
+    }
+}
+
+test "scanning kernels agree for all vector lengths" {
+    const kernels = gemini.kernels;
+
+    const inputs = [_][]const u8{
+        "",
+        "no special bytes at all",
+        "a line\nand another one",
+        "this one has a very long prefix before the first special byte, so that several whole vectors are scanned <b>",
+        "\u{00e4}\u{00f6}\u{00fc} multi byte before the line feed\n",
+        "invalid \xff utf-8 after some ascii padding to fill vectors .........................................",
+        "fifteen bytes .\u{00e4} crosses the first vector boundary, and the input ends in a truncated sequence \xc3",
+    };
+
+    inline for (.{ 16, 32, 64 }) |vector_len| {
+        const impl = kernels.Kernels(vector_len);
+        for (inputs) |input| {
+            try std.testing.expectEqual(
+                std.mem.indexOfScalar(u8, input, '\n') orelse input.len,
+                impl.indexOfNewlineC(input.ptr, input.len),
+            );
+            try std.testing.expectEqual(
+                std.mem.indexOfAny(u8, input, kernels.html_special) orelse input.len,
+                impl.indexOfHtmlSpecialC(input.ptr, input.len),
+            );
+            try std.testing.expectEqual(
+                std.unicode.utf8ValidateSlice(input),
+                impl.validateUtf8C(input.ptr, input.len),
+            );
+        }
+    }
+
+    try std.testing.expectEqual(kernels.LineKind.list, kernels.classifyLine("* item"));
+    try std.testing.expectEqual(kernels.LineKind.text, kernels.classifyLine("*item"));
+    try std.testing.expectEqual(kernels.LineKind.quote, kernels.classifyLine(">"));
+    try std.testing.expectEqual(kernels.LineKind.preformatted_toggle, kernels.classifyLine("```zig"));
+    try std.testing.expectEqual(kernels.LineKind.heading_2, kernels.classifyLine("## Title"));
+    try std.testing.expectEqual(kernels.LineKind.link, kernels.classifyLine("=>gemini://example.org/"));
+}
+
+fn expectLimitError(expected: anyerror, limits: Parser.Limits, text: []const u8) !void {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+
+    var parser = Parser.init(std.testing.allocator);
+    defer parser.deinit();
+    parser.limits = limits;
+
+    const result: anyerror!void = blk: {
+        var offset: usize = 0;
+        while (offset < text.len) {
+            const res = parser.feed(arena.allocator(), text[offset..]) catch |err| break :blk err;
+            offset += res.consumed;
+        }
+        _ = parser.finalize(arena.allocator()) catch |err| break :blk err;
+        break :blk {};
+    };
+    try std.testing.expectError(expected, result);
+}
+
+test "parser limits" {
+    try expectLimitError(error.LineTooLong, .{ .max_line_length = 8 }, "short\r\nthis line is too long\r\n");
+    try expectLimitError(error.BlockTooLarge, .{ .max_block_lines = 3 }, "```\r\n1\r\n2\r\n3\r\n```\r\n");
+    try expectLimitError(error.BlockTooLarge, .{ .max_block_bytes = 8 }, "* 1234\r\n* 5678\r\n* 9\r\n");
+    try expectLimitError(error.TooManyFragments, .{ .max_fragments = 2 }, "a\r\nb\r\nc\r\n");
+    try expectLimitError(error.DocumentTooLarge, .{ .max_total_bytes = 10 }, "# Title\r\nSome text\r\n");
+}
+
+fn feedAll(parser: *Parser, allocator: std.mem.Allocator, text: []const u8) !void {
+    var offset: usize = 0;
+    while (offset < text.len) {
+        const res = try parser.feed(allocator, text[offset..]);
+        offset += res.consumed;
+    }
+}
+
+test "parser limits lowered below the buffered input" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+
+    var parser = Parser.init(std.testing.allocator);
+    defer parser.deinit();
+
+    try feedAll(&parser, arena.allocator(), "an unterminated line");
+    parser.limits = .{ .max_line_length = 8 };
+    try std.testing.expectError(error.LineTooLong, parser.feed(arena.allocator(), " continues"));
+
+    parser.reset();
+    parser.limits = .{};
+    try feedAll(&parser, arena.allocator(), "* 1234\r\n* 5678\r\n");
+    parser.limits = .{ .max_block_bytes = 2 };
+    try std.testing.expectError(error.BlockTooLarge, feedAll(&parser, arena.allocator(), "* 9\r\n"));
+
+    // A restored snapshot must fit into the limits of the restoring parser.
+    parser.reset();
+    parser.limits = .{};
+    try feedAll(&parser, arena.allocator(), "# Title\r\nSome text\r\n");
+
+    var snapshot = std.ArrayList(u8).init(std.testing.allocator);
+    defer snapshot.deinit();
+    try parser.snapshot(snapshot.writer());
+
+    parser.limits = .{ .max_total_bytes = 10 };
+    var stream = std.io.fixedBufferStream(snapshot.items);
+    try std.testing.expectError(error.DocumentTooLarge, parser.restore(stream.reader()));
+
+    parser.limits = .{ .max_fragments = 1 };
+    stream.reset();
+    try std.testing.expectError(error.TooManyFragments, parser.restore(stream.reader()));
+}
+
+test "parser rejects an oversized line before buffering it" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+
+    var parser = Parser.init(std.testing.allocator);
+    defer parser.deinit();
+    parser.limits = .{ .max_total_bytes = 64 };
+
+    const line = [_]u8{'x'} ** 4096;
+    try std.testing.expectError(error.DocumentTooLarge, parser.feed(arena.allocator(), &line));
+    try std.testing.expectEqual(@as(usize, 0), parser.line_buffer.items.len);
+
+    // Lines up to the limit are still parsed, also when they are fed in pieces.
+    parser.reset();
+    _ = try parser.feed(arena.allocator(), line[0..40]);
+    try std.testing.expectError(error.DocumentTooLarge, parser.feed(arena.allocator(), line[0..40]));
+    try std.testing.expectEqual(@as(usize, 40), parser.line_buffer.items.len);
+}
+
+/// Expects `text` to contain `line`. The line of the same series is compared with it,
+/// so a failure shows the actual value, or that the series is missing.
+fn expectMetricLine(text: []const u8, line: []const u8) !void {
+    const expected = std.mem.trimRight(u8, line, "\n");
+    const series = expected[0 .. std.mem.lastIndexOfScalar(u8, expected, ' ').? + 1];
+    var lines = std.mem.splitScalar(u8, text, '\n');
+    while (lines.next()) |actual| {
+        if (std.mem.startsWith(u8, actual, series))
+            return std.testing.expectEqualStrings(expected, actual);
+    }
+    return std.testing.expectEqualStrings(expected, "");
+}
+
+test "metrics sum up threads and write the exposition format" {
+    var metrics = gemini.Metrics{};
+
+    const Worker = struct {
+        fn run(m: *gemini.Metrics) void {
+            for (0..100) |_| {
+                m.countParsed(10);
+                m.countFragment(.heading);
+                m.observeParse(5 * std.time.ns_per_us);
+                m.observeRender(.html, 20, 2 * std.time.ns_per_s);
+                m.countCache(.hit);
+            }
+        }
+    };
+
+    var threads: [4]std.Thread = undefined;
+    for (&threads) |*thread| {
+        thread.* = try std.Thread.spawn(.{}, Worker.run, .{&metrics});
+    }
+    for (threads) |thread| {
+        thread.join();
+    }
+
+    var counted = gemini.Metrics.CountingAllocator{ .child = std.testing.allocator, .metrics = &metrics };
+    const allocator = counted.allocator();
+    allocator.free(try allocator.alloc(u8, 64));
+
+    const snapshot = metrics.snapshot();
+    try std.testing.expectEqual(@as(u64, 4000), snapshot.parsed_bytes);
+    try std.testing.expectEqual(@as(u64, 400), snapshot.fragments.get(.heading));
+    try std.testing.expectEqual(@as(u64, 400), snapshot.parse_duration.count());
+    try std.testing.expectEqual(@as(u64, 8000), snapshot.rendered_bytes.get(.html));
+    try std.testing.expectEqual(@as(u64, 400), snapshot.cache.get(.hit));
+    try std.testing.expectEqual(@as(u64, 1), snapshot.allocations);
+    try std.testing.expectEqual(@as(u64, 64), snapshot.freed_bytes);
+
+    var output = std.ArrayList(u8).init(std.testing.allocator);
+    defer output.deinit();
+    try metrics.write(output.writer());
+
+    const expected_lines = [_][]const u8{
+        "# TYPE gemtext_parsed_bytes_total counter\n",
+        "gemtext_parsed_bytes_total 4000\n",
+        "gemtext_fragments_total{type=\"heading\"} 400\n",
+        "gemtext_fragments_total{type=\"paragraph\"} 0\n",
+        "gemtext_parse_duration_seconds_bucket{le=\"0.000004\"} 0\n",
+        "gemtext_parse_duration_seconds_bucket{le=\"0.000016\"} 400\n",
+        "gemtext_parse_duration_seconds_count 400\n",
+        "gemtext_render_duration_seconds_bucket{renderer=\"html\",le=\"1.048576\"} 0\n",
+        "gemtext_render_duration_seconds_bucket{renderer=\"html\",le=\"+Inf\"} 400\n",
+        "gemtext_render_duration_seconds_sum{renderer=\"html\"} 800\n",
+        "gemtext_cache_lookups_total{result=\"hit\"} 400\n",
+        "gemtext_allocated_bytes_total 64\n",
+    };
+    for (expected_lines) |line| {
+        try expectMetricLine(output.items, line);
+    }
+}
+
+test "link scanner" {
+    const text =
+        "# Links\r\n" ++
+        "=> gemini://example.com/ Example\r\n" ++
+        "=>\tdocs/index.gmi\r\n" ++
+        "=>\r\n" ++
+        "```\n" ++
+        "=> not/a/link.gmi\n" ++
+        "```\n" ++
+        "=> ../up.gmi  Up  \n" ++
+        "=> last.gmi";
+
+    var scanner = gemini.LinkScanner.init(text);
+
+    const expected = [_]gemini.LinkScanner.Link{
+        .{ .href = "gemini://example.com/", .title = "Example", .line = 2 },
+        .{ .href = "docs/index.gmi", .title = null, .line = 3 },
+        .{ .href = "../up.gmi", .title = "Up", .line = 8 },
+        .{ .href = "last.gmi", .title = null, .line = 9 },
+    };
+    for (expected) |link| {
+        const actual = scanner.next() orelse return error.MissingLink;
+        try std.testing.expectEqualStrings(link.href, actual.href);
+        try std.testing.expectEqual(link.line, actual.line);
+        if (link.title) |title| {
+            try std.testing.expectEqualStrings(title, actual.title.?);
+        } else {
+            try std.testing.expectEqual(@as(?[]const u8, null), actual.title);
+        }
+    }
+    try std.testing.expectEqual(@as(?gemini.LinkScanner.Link, null), scanner.next());
+}
+
+test "resolve link targets" {
+    const allocator = std.testing.allocator;
+
+    const Case = struct { directory: []const u8, href: []const u8, expected: ?[]const u8 };
+    const cases = [_]Case{
+        .{ .directory = "log", .href = "post.gmi", .expected = "log/post.gmi" },
+        .{ .directory = "log", .href = "./post.gmi?query#part", .expected = "log/post.gmi" },
+        .{ .directory = "log", .href = "../index.gmi", .expected = "index.gmi" },
+        .{ .directory = "log", .href = "/about%20me.gmi", .expected = "about me.gmi" },
+        .{ .directory = "", .href = "../outside.gmi", .expected = "../outside.gmi" },
+        .{ .directory = "", .href = "..draft.gmi", .expected = "..draft.gmi" },
+        .{ .directory = "", .href = "#part", .expected = null },
+        .{ .directory = "", .href = "//example.org/", .expected = null },
+        .{ .directory = "", .href = "gemini://example.org/", .expected = null },
+        .{ .directory = "", .href = "mailto:someone@example.org", .expected = null },
+        // A colon in a path segment doesn't make a scheme.
+        .{ .directory = "", .href = "notes/10:30.gmi", .expected = "notes/10:30.gmi" },
+    };
+    for (cases) |case| {
+        const actual = try gemini.resolveLinkTarget(allocator, case.directory, case.href);
+        defer if (actual) |path| allocator.free(path);
+
+        if (case.expected) |expected| {
+            try std.testing.expectEqualStrings(expected, actual orelse return error.TestExpectedPath);
+        } else {
+            try std.testing.expectEqual(@as(?[]u8, null), actual);
+        }
+    }
+}
+
+test "thread pool runs nested tasks before shutting down" {
+    const Node = struct {
+        task: gemini.ThreadPool.Task = .{ .run = run },
+        pool: *gemini.ThreadPool,
+        children: []@This(),
+        count: *std.atomic.Value(usize),
+
+        fn run(task: *gemini.ThreadPool.Task) void {
+            const self = @fieldParentPtr(@This(), "task", task);
+            for (self.children) |*child| {
+                self.pool.spawn(&child.task);
+            }
+            _ = self.count.fetchAdd(1, .monotonic);
+        }
+    };
+
+    var count = std.atomic.Value(usize).init(0);
+    var pool: gemini.ThreadPool = undefined;
+    try pool.init(std.testing.allocator, .{ .thread_count = 4 });
+
+    // A root with 8 children with 8 children each.
+    var nodes: [1 + 8 + 64]Node = undefined;
+    for (&nodes, 0..) |*node, index| {
+        const first_child = 1 + 8 * index;
+        node.* = Node{
+            .pool = &pool,
+            .children = if (first_child < nodes.len) nodes[first_child .. first_child + 8] else nodes[0..0],
+            .count = &count,
+        };
+    }
+    pool.spawn(&nodes[0].task);
+    pool.deinit();
+
+    try std.testing.expectEqual(@as(usize, nodes.len), count.load(.monotonic));
+}
+
+test "render compressed" {
+    var input_stream = std.io.fixedBufferStream(document_text);
+    var document = try Document.parse(std.testing.allocator, input_stream.reader());
+    defer document.deinit();
+
+    var plain = std.ArrayList(u8).init(std.testing.allocator);
+    defer plain.deinit();
+    try renderer.html(document.fragments.items, plain.writer());
+
+    inline for (comptime std.enums.values(renderer.compressed.Container)) |container| {
+        const module = switch (container) {
+            .gzip => std.compress.gzip,
+            .zlib => std.compress.zlib,
+            .deflate => std.compress.flate,
+        };
+
+        var compressed = std.ArrayList(u8).init(std.testing.allocator);
+        defer compressed.deinit();
+        try renderer.compressed.render(std.testing.allocator, .html, container, .best, document.fragments.items, compressed.writer());
+        try std.testing.expect(compressed.items.len < plain.items.len);
+
+        var decompressed = std.ArrayList(u8).init(std.testing.allocator);
+        defer decompressed.deinit();
+        var source = std.io.fixedBufferStream(compressed.items);
+        try module.decompress(source.reader(), decompressed.writer());
+
+        try std.testing.expectEqualStrings(plain.items, decompressed.items);
+    }
+}
+
+test "html heading anchors and table of contents" {
+    const fragments = [_]Fragment{
+        Fragment{ .heading = Heading{ .level = .h1, .text = "Hello, World!" } },
+        Fragment{ .heading = Heading{ .level = .h2, .text = "  Zig & C++  " } },
+        Fragment{ .heading = Heading{ .level = .h3, .text = "Grüße aus Köln" } },
+        Fragment{ .heading = Heading{ .level = .h2, .text = "Zig & C++" } },
+        Fragment{ .heading = Heading{ .level = .h1, .text = "???" } },
+        Fragment{ .heading = Heading{ .level = .h3, .text = "Deep" } },
+    };
+
+    var anchors = renderer.HtmlAnchors.init(std.testing.allocator);
+    defer anchors.deinit();
+
+    var body = std.ArrayList(u8).init(std.testing.allocator);
+    defer body.deinit();
+    var toc = std.ArrayList(u8).init(std.testing.allocator);
+    defer toc.deinit();
+
+    // Rendering in two calls keeps the ids unique across both.
+    try renderer.htmlWithAnchors(fragments[0..3], &anchors, body.writer(), toc.writer());
+    try renderer.htmlWithAnchors(fragments[3..], &anchors, body.writer(), toc.writer());
+    try anchors.finishToc(toc.writer());
+
+    try std.testing.expectEqualStrings(
+        "<h1 id=\"hello-world\">Hello, World!</h1>\r\n" ++
+            "<h2 id=\"zig-c\">  Zig &amp; C++  </h2>\r\n" ++
+            "<h3 id=\"grüße-aus-köln\">Grüße aus Köln</h3>\r\n" ++
+            "<h2 id=\"zig-c-2\">Zig &amp; C++</h2>\r\n" ++
+            "<h1 id=\"section\">???</h1>\r\n" ++
+            "<h3 id=\"deep\">Deep</h3>\r\n",
+        body.items,
+    );
+
+    try std.testing.expectEqualStrings(
+        "<ul>\r\n<li><a href=\"#hello-world\">Hello, World!</a>\r\n" ++
+            "<ul>\r\n<li><a href=\"#zig-c\">  Zig &amp; C++  </a>\r\n" ++
+            "<ul>\r\n<li><a href=\"#grüße-aus-köln\">Grüße aus Köln</a>\r\n" ++
+            "</li>\r\n</ul>\r\n</li>\r\n<li><a href=\"#zig-c-2\">Zig &amp; C++</a>\r\n" ++
+            "</li>\r\n</ul>\r\n</li>\r\n<li><a href=\"#section\">???</a>\r\n" ++
+            "<ul>\r\n<li>\r\n<ul>\r\n<li><a href=\"#deep\">Deep</a>\r\n" ++
+            "</li>\r\n</ul>\r\n</li>\r\n</ul>\r\n</li>\r\n</ul>\r\n",
+        toc.items,
+    );
+
+    // Without anchors, the headings are rendered as before.
+    var plain = std.ArrayList(u8).init(std.testing.allocator);
+    defer plain.deinit();
+    try renderer.html(fragments[1..2], plain.writer());
+    try std.testing.expectEqualStrings("<h2>  Zig &amp; C++  </h2>\r\n", plain.items);
+}
+
+test "statistics match the parser" {
+    const text = "# Intro\r\nSome  words here\r\n\r\n* one\r\n* two three\r\n> a quote\r\n```alt\r\ncode line\r\n```\r\n" ++
+        "=> gemini://example.com/ Example site\r\n=> HTTPS://example.com/\r\n=> relative.gmi\r\n=> mailto:me@example.com Mail\r\nlast line";
+
+    const stats = gemini.Statistics.collect(text);
+
+    var document = try Document.parseString(std.testing.allocator, text);
+    defer document.deinit();
+
+    var expected = std.EnumArray(FragmentType, usize).initFill(0);
+    for (document.fragments.items) |fragment| {
+        expected.getPtr(std.meta.activeTag(fragment)).* += 1;
+    }
+    inline for (comptime std.enums.values(FragmentType)) |tag| {
+        try std.testing.expectEqual(expected.get(tag), stats.fragments.get(tag));
+    }
+
+    try std.testing.expectEqual(@as(usize, 14), stats.lines);
+    try std.testing.expectEqual(text.len, stats.bytes);
+    // Intro, Some words here, one, two three, a quote, Example site, Mail and last line.
+    try std.testing.expectEqual(@as(usize, 14), stats.words);
+    try std.testing.expectEqual(@as(usize, "=> gemini://example.com/ Example site".len), stats.longest_line);
+    try std.testing.expectEqual(@as(usize, 1), stats.preformatted_lines);
+    try std.testing.expectEqual(@as(usize, "code line".len), stats.preformatted_bytes);
+    try std.testing.expectEqual(@as(usize, 4), stats.linkCount());
+    try std.testing.expectEqual(@as(usize, 1), stats.links.get(.gemini));
+    try std.testing.expectEqual(@as(usize, 1), stats.links.get(.https));
+    try std.testing.expectEqual(@as(usize, 1), stats.links.get(.relative));
+    try std.testing.expectEqual(@as(usize, 1), stats.links.get(.mailto));
+
+    // Feeding the document in small chunks splits lines across calls.
+    var collector = gemini.Statistics.Collector.init(std.testing.allocator);
+    defer collector.deinit();
+    var offset: usize = 0;
+    while (offset < text.len) : (offset += 3) {
+        try collector.feed(text[offset..@min(offset + 3, text.len)]);
+    }
+    try std.testing.expectEqualDeep(stats, collector.finalize());
+
+    // Long lines take the vectorized path of the word counter.
+    const long = "word " ** 40 ++ "  \tend";
+    try std.testing.expectEqual(@as(usize, 41), gemini.Statistics.collect(long).words);
+}
@@ -0,0 +1,175 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+/// A fixed pool of worker threads with one task queue per worker.
+///
+/// Workers run the newest task of their own queue first and steal the oldest
+/// task of another queue when their own queue is empty. Tasks spawned by a task
+/// stay on the worker that spawned them, while idle workers balance the load.
+/// All queued tasks are run before the pool shuts down.
+pub const ThreadPool = struct {
+    const Self = @This();
+    const List = std.DoublyLinkedList(void);
+
+    pub const Options = struct {
+        /// The number of worker threads, or 0 for one per CPU.
+        thread_count: usize = 0,
+        /// Pins worker `i` to CPU `i` modulo the CPU count. Only supported on Linux.
+        pin_threads: bool = false,
+    };
+
+    /// A unit of work. Embed it into the state of the task and recover the
+    /// state with `@fieldParentPtr` in `run`.
+    pub const Task = struct {
+        run: *const fn (task: *Task) void,
+        node: List.Node = undefined,
+    };
+
+    const Worker = struct {
+        pool: *Self,
+        index: usize,
+        thread: std.Thread = undefined,
+        mutex: std.Thread.Mutex = .{},
+        tasks: List = .{},
+
+        fn run(self: *Worker, cpu: ?usize) void {
+            if (cpu) |index|
+                pinToCpu(index);
+            current = self;
+
+            while (true) {
+                if (self.pool.take(self)) |task| {
+                    task.run(task);
+                } else if (!self.pool.waitForTask()) {
+                    break;
+                }
+            }
+        }
+
+        fn pop(self: *Worker, newest: bool) ?*Task {
+            self.mutex.lock();
+            const node = if (newest) self.tasks.pop() else self.tasks.popFirst();
+            self.mutex.unlock();
+
+            const task = @fieldParentPtr(Task, "node", node orelse return null);
+            _ = self.pool.pending.fetchSub(1, .monotonic);
+            return task;
+        }
+    };
+
+    /// The worker running on the current thread, if any.
+    threadlocal var current: ?*Worker = null;
+
+    allocator: std.mem.Allocator,
+    workers: []Worker,
+    /// The number of queued tasks of all workers.
+    pending: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    /// Picks the worker for tasks spawned outside of the pool.
+    next_worker: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    idle_mutex: std.Thread.Mutex = .{},
+    idle_condition: std.Thread.Condition = .{},
+    shutdown: bool = false,
+
+    /// Starts the workers. `self` must not move until `deinit` is called.
+    pub fn init(self: *Self, allocator: std.mem.Allocator, options: Options) !void {
+        const cpu_count = std.Thread.getCpuCount() catch 1;
+        const thread_count = if (options.thread_count == 0) cpu_count else options.thread_count;
+
+        self.* = Self{
+            .allocator = allocator,
+            .workers = try allocator.alloc(Worker, thread_count),
+        };
+        errdefer allocator.free(self.workers);
+
+        for (self.workers, 0..) |*worker, index| {
+            worker.* = Worker{ .pool = self, .index = index };
+        }
+
+        var started: usize = 0;
+        errdefer {
+            self.stop();
+            for (self.workers[0..started]) |worker| {
+                worker.thread.join();
+            }
+        }
+        for (self.workers) |*worker| {
+            const cpu: ?usize = if (options.pin_threads) worker.index % cpu_count else null;
+            worker.thread = try std.Thread.spawn(.{}, Worker.run, .{ worker, cpu });
+            started += 1;
+        }
+    }
+
+    /// Runs all queued tasks, then stops the workers.
+    pub fn deinit(self: *Self) void {
+        self.stop();
+        for (self.workers) |worker| {
+            worker.thread.join();
+        }
+        self.allocator.free(self.workers);
+        self.* = undefined;
+    }
+
+    /// Queues `task` to be run by a worker. Tasks spawned by a task of this pool
+    /// are queued on the worker running that task.
+    pub fn spawn(self: *Self, task: *Task) void {
+        const worker = if (current) |own| (if (own.pool == self) own else null) else null;
+        const target = worker orelse &self.workers[self.next_worker.fetchAdd(1, .monotonic) % self.workers.len];
+
+        // Counted before the task is visible, so a worker taking it right away
+        // can't decrement `pending` below zero.
+        _ = self.pending.fetchAdd(1, .monotonic);
+
+        target.mutex.lock();
+        target.tasks.append(&task.node);
+        target.mutex.unlock();
+
+        self.idle_mutex.lock();
+        defer self.idle_mutex.unlock();
+        self.idle_condition.signal();
+    }
+
+    fn stop(self: *Self) void {
+        self.idle_mutex.lock();
+        defer self.idle_mutex.unlock();
+        self.shutdown = true;
+        self.idle_condition.broadcast();
+    }
+
+    /// Takes the newest task of `worker` or steals the oldest task of another worker.
+    fn take(self: *Self, worker: *Worker) ?*Task {
+        if (worker.pop(true)) |task|
+            return task;
+        for (1..self.workers.len) |offset| {
+            const victim = &self.workers[(worker.index + offset) % self.workers.len];
+            if (victim.pop(false)) |task|
+                return task;
+        }
+        return null;
+    }
+
+    /// Blocks until a task is queued. Returns `false` if the pool shuts down.
+    fn waitForTask(self: *Self) bool {
+        self.idle_mutex.lock();
+        defer self.idle_mutex.unlock();
+
+        while (self.pending.load(.monotonic) == 0) {
+            if (self.shutdown)
+                return false;
+            self.idle_condition.wait(&self.idle_mutex);
+        }
+        return true;
+    }
+};
+
+fn pinToCpu(cpu: usize) void {
+    if (builtin.os.tag == .linux) {
+        const linux = std.os.linux;
+        const bits = @bitSizeOf(usize);
+
+        var set = std.mem.zeroes(linux.cpu_set_t);
+        if (cpu >= set.len * bits)
+            return;
+        set[cpu / bits] |= @as(usize, 1) << @intCast(cpu % bits);
+        linux.sched_setaffinity(0, &set) catch {}; // pinning is only a hint
+    }
+}
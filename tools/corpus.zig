@@ -0,0 +1,84 @@
+//! Helpers for the tools that process many gemini text files at once.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+/// Collects the files named by `paths`. Every path that is a directory is
+/// searched for `.gmi` files, every other path is taken as it is.
+/// The returned paths are allocated with `arena`.
+pub fn collectFiles(allocator: std.mem.Allocator, arena: std.mem.Allocator, paths: []const []const u8) ![]const []const u8 {
+    var files = std.ArrayList([]const u8).init(arena);
+
+    for (paths) |path| {
+        var dir = std.fs.cwd().openDir(path, .{ .iterate = true }) catch |err| switch (err) {
+            error.NotDir => {
+                try files.append(path);
+                continue;
+            },
+            else => return err,
+        };
+        defer dir.close();
+
+        var walker = try dir.walk(allocator);
+        defer walker.deinit();
+        while (try walker.next()) |entry| {
+            if (entry.kind == .file and std.mem.endsWith(u8, entry.basename, ".gmi"))
+                try files.append(try std.fs.path.join(arena, &.{ path, entry.path }));
+        }
+    }
+    return files.items;
+}
+
+/// Calls `process(context, index, path)` for every path on a `gemtext.ThreadPool`
+/// with `jobs` threads, or one per CPU if `jobs` is 0. Errors are logged with the
+/// path of the file. Returns the number of paths that failed.
+pub fn forEach(
+    allocator: std.mem.Allocator,
+    jobs: usize,
+    paths: []const []const u8,
+    context: anytype,
+    comptime process: anytype,
+) !usize {
+    if (paths.len == 0)
+        return 0;
+
+    const Context = @TypeOf(context);
+    const Job = struct {
+        task: gemtext.ThreadPool.Task = .{ .run = run },
+        context: Context,
+        index: usize,
+        path: []const u8,
+        failed: *std.atomic.Value(usize),
+
+        fn run(task: *gemtext.ThreadPool.Task) void {
+            const job = @fieldParentPtr(@This(), "task", task);
+            process(job.context, job.index, job.path) catch |err| {
+                std.log.err("{s}: {s}", .{ job.path, @errorName(err) });
+                _ = job.failed.fetchAdd(1, .monotonic);
+            };
+        }
+    };
+
+    var failed = std.atomic.Value(usize).init(0);
+
+    const tasks = try allocator.alloc(Job, paths.len);
+    defer allocator.free(tasks);
+
+    const thread_count = if (jobs > 0) jobs else std.Thread.getCpuCount() catch 1;
+
+    var pool: gemtext.ThreadPool = undefined;
+    try pool.init(allocator, .{ .thread_count = @min(thread_count, paths.len) });
+    for (tasks, paths, 0..) |*job, path, index| {
+        job.* = Job{
+            .context = context,
+            .index = index,
+            .path = path,
+            .failed = &failed,
+        };
+        pool.spawn(&job.task);
+    }
+    // Runs all queued jobs before the workers stop.
+    pool.deinit();
+
+    return failed.load(.monotonic);
+}
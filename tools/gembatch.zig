@@ -0,0 +1,1095 @@
+//! This tool converts a directory of gemini text files into a directory of
+//! rendered pages and only does the work that changed since the last run:
+//!
+//!     gembatch [--format html|markdown|rtf|gemtext] [--jobs N] [--metrics FILE] [--watch] [--debounce MS] SOURCE OUTPUT
+//!
+//! Every page gets a list of the pages linking to it appended. The state of the
+//! last build is kept in `OUTPUT/.gembatch-manifest`: the size, modification time
+//! and content hash of every source, the hash of its rendered page, the hash of
+//! its backlinks and its outgoing links.
+//!
+//! A rebuild only stats the sources. Files with a changed size or mtime are read
+//! and hashed, and only files with changed content are scanned for links again.
+//! Pages are rendered if their content or their backlinks changed, and written
+//! only if the rendered output differs. With `--metrics`, the metrics of the run
+//! are written to FILE in the Prometheus text format.
+//!
+//! With `--watch`, the tool keeps running after the build and watches the source
+//! tree with inotify (Linux only). Events are collected until the tree has been
+//! quiet for the debounce interval (10ms by default), then only the affected
+//! files are updated, with the manifest, parsers and arenas still in memory.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+const Format = gemtext.renderer.Format;
+
+const max_file_size = 64 * 1024 * 1024;
+
+const manifest_name = ".gembatch-manifest";
+const manifest_magic = "GMBM";
+const manifest_version = 2;
+
+/// What the manifest knows about one source file.
+const Entry = struct {
+    size: u64,
+    mtime: i128,
+    content_hash: u64,
+    output_hash: u64,
+    backlinks_hash: u64,
+    /// Resolved paths of all relative link targets, relative to the source root.
+    links: []const []const u8,
+};
+
+/// The state of the last build, keyed by the source path relative to the root.
+const Manifest = struct {
+    format: Format,
+    entries: std.StringArrayHashMapUnmanaged(Entry) = .{},
+
+    /// Loads the manifest from `dir`. Returns an empty manifest if there is none,
+    /// it's corrupt, or it was built for another format.
+    fn load(arena: std.mem.Allocator, dir: std.fs.Dir, format: Format) !Manifest {
+        var manifest = Manifest{ .format = format };
+
+        const data = dir.readFileAlloc(arena, manifest_name, std.math.maxInt(u32)) catch |err| switch (err) {
+            error.FileNotFound => return manifest,
+            else => return err,
+        };
+        var stream = std.io.fixedBufferStream(data);
+        manifest.read(arena, &stream) catch |err| switch (err) {
+            error.EndOfStream, error.Overflow, error.InvalidManifest => {
+                std.log.warn("ignoring invalid manifest, rebuilding everything", .{});
+                manifest.entries = .{};
+            },
+            else => return err,
+        };
+        return manifest;
+    }
+
+    const Stream = std.io.FixedBufferStream([]u8);
+
+    /// The size of the smallest possible entry: a path length, the fixed fields and a link count.
+    const min_entry_size = 1 + 8 + 16 + 8 + 8 + 8 + 4;
+
+    fn read(self: *Manifest, arena: std.mem.Allocator, stream: *Stream) !void {
+        const reader = stream.reader();
+
+        var magic: [manifest_magic.len]u8 = undefined;
+        try reader.readNoEof(&magic);
+        if (!std.mem.eql(u8, &magic, manifest_magic) or try reader.readInt(u32, .little) != manifest_version)
+            return error.InvalidManifest;
+        if (try reader.readByte() != @intFromEnum(self.format))
+            return; // built for another format, so every page must be rendered again
+
+        // The counts are only allocated for if the rest of the file can hold them,
+        // so a corrupt manifest is rejected instead of running out of memory.
+        const count = try reader.readInt(u32, .little);
+        if (count > remaining(stream) / min_entry_size)
+            return error.InvalidManifest;
+        try self.entries.ensureTotalCapacity(arena, count);
+        for (0..count) |_| {
+            const path = try readString(arena, stream);
+            var entry = Entry{
+                .size = try reader.readInt(u64, .little),
+                .mtime = try reader.readInt(i128, .little),
+                .content_hash = try reader.readInt(u64, .little),
+                .output_hash = try reader.readInt(u64, .little),
+                .backlinks_hash = try reader.readInt(u64, .little),
+                .links = undefined,
+            };
+            const link_count = try reader.readInt(u32, .little);
+            if (link_count > remaining(stream))
+                return error.InvalidManifest;
+            const links = try arena.alloc([]const u8, link_count);
+            for (links) |*link| {
+                link.* = try readString(arena, stream);
+            }
+            entry.links = links;
+            self.entries.putAssumeCapacity(path, entry);
+        }
+    }
+
+    fn readString(arena: std.mem.Allocator, stream: *Stream) ![]const u8 {
+        const len = try std.leb.readULEB128(u32, stream.reader());
+        if (len > max_file_size or len > remaining(stream))
+            return error.InvalidManifest;
+        const string = try arena.alloc(u8, len);
+        try stream.reader().readNoEof(string);
+        return string;
+    }
+
+    fn remaining(stream: *Stream) usize {
+        return stream.buffer.len - stream.pos;
+    }
+
+    /// Replaces the manifest in `dir` atomically.
+    fn save(self: Manifest, dir: std.fs.Dir) !void {
+        var file = try dir.atomicFile(manifest_name, .{});
+        defer file.deinit();
+
+        var buffered = std.io.bufferedWriter(file.file.writer());
+        const writer = buffered.writer();
+
+        try writer.writeAll(manifest_magic);
+        try writer.writeInt(u32, manifest_version, .little);
+        try writer.writeByte(@intFromEnum(self.format));
+        try writer.writeInt(u32, @intCast(self.entries.count()), .little);
+        for (self.entries.keys(), self.entries.values()) |path, entry| {
+            try writeString(writer, path);
+            try writer.writeInt(u64, entry.size, .little);
+            try writer.writeInt(i128, entry.mtime, .little);
+            try writer.writeInt(u64, entry.content_hash, .little);
+            try writer.writeInt(u64, entry.output_hash, .little);
+            try writer.writeInt(u64, entry.backlinks_hash, .little);
+            try writer.writeInt(u32, @intCast(entry.links.len), .little);
+            for (entry.links) |link| {
+                try writeString(writer, link);
+            }
+        }
+
+        try buffered.flush();
+        try file.finish();
+    }
+
+    /// Strings are prefixed with their ULEB128 length, like in parser snapshots.
+    fn writeString(writer: anytype, string: []const u8) !void {
+        try std.leb.writeULEB128(writer, @as(u32, @intCast(string.len)));
+        try writer.writeAll(string);
+    }
+};
+
+pub const Options = struct {
+    format: Format = .html,
+    jobs: usize = 0,
+};
+
+/// A page whose source must be read during a build.
+const Job = struct {
+    path: []const u8,
+    stat: std.fs.File.Stat,
+    /// Set by the worker if the content changed.
+    changed: bool = false,
+    /// The new content hash and links if `changed` is set.
+    content_hash: u64 = 0,
+    links: []const []const u8 = &.{},
+};
+
+/// The resident state of a build thread. Kept between builds, so parsers and
+/// scratch memory are reused.
+const Worker = struct {
+    parser: gemtext.Parser,
+    /// Scratch memory of a single page, reset after each page.
+    scratch: std.heap.ArenaAllocator,
+    /// Holds job results until they are merged into the manifest.
+    results: std.heap.ArenaAllocator,
+    source: std.ArrayList(u8),
+    output: std.ArrayList(u8),
+    failure: ?anyerror = null,
+
+    fn init(allocator: std.mem.Allocator) Worker {
+        return Worker{
+            .parser = gemtext.Parser.init(allocator),
+            .scratch = std.heap.ArenaAllocator.init(allocator),
+            .results = std.heap.ArenaAllocator.init(allocator),
+            .source = std.ArrayList(u8).init(allocator),
+            .output = std.ArrayList(u8).init(allocator),
+        };
+    }
+
+    fn deinit(self: *Worker) void {
+        self.parser.deinit();
+        self.scratch.deinit();
+        self.results.deinit();
+        self.source.deinit();
+        self.output.deinit();
+    }
+
+    fn readSource(self: *Worker, dir: std.fs.Dir, path: []const u8) ![]const u8 {
+        const file = try dir.openFile(path, .{});
+        defer file.close();
+
+        const size = (try file.stat()).size;
+        if (size > max_file_size)
+            return error.FileTooBig;
+        try self.source.resize(@intCast(size));
+        self.source.shrinkRetainingCapacity(try file.readAll(self.source.items));
+        return self.source.items;
+    }
+};
+
+/// Converts a source tree incrementally. Keeps the manifest and the workers
+/// resident, so it can be asked to update again and again.
+pub const Builder = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    source_dir: std.fs.Dir,
+    output_dir: std.fs.Dir,
+    /// Owns the manifest. Replaced links of changed pages stay allocated until
+    /// the builder is destroyed.
+    manifest_arena: std.heap.ArenaAllocator,
+    manifest: Manifest,
+    workers: []Worker,
+    metrics: gemtext.Metrics = .{},
+    /// Set if an update failed after links changed, so the next update must
+    /// compare the backlinks of all pages again.
+    backlinks_stale: bool = false,
+
+    pub const Stats = struct {
+        /// Sources that were read because their size or mtime changed.
+        read: usize = 0,
+        /// Sources with new content.
+        changed: usize = 0,
+        /// Sources that were removed.
+        removed: usize = 0,
+        /// Pages that were rendered.
+        rendered: usize = 0,
+        /// Pages that were written because their output changed.
+        written: usize = 0,
+    };
+
+    pub fn init(allocator: std.mem.Allocator, source_dir: std.fs.Dir, output_dir: std.fs.Dir, options: Options) !Builder {
+        const jobs = if (options.jobs > 0) options.jobs else std.Thread.getCpuCount() catch 1;
+
+        var builder = Builder{
+            .allocator = allocator,
+            .options = options,
+            .source_dir = source_dir,
+            .output_dir = output_dir,
+            .manifest_arena = std.heap.ArenaAllocator.init(allocator),
+            .manifest = undefined,
+            .workers = try allocator.alloc(Worker, jobs),
+        };
+        errdefer allocator.free(builder.workers);
+        errdefer builder.manifest_arena.deinit();
+
+        builder.manifest = try Manifest.load(builder.manifest_arena.allocator(), output_dir, options.format);
+        for (builder.workers) |*worker| {
+            worker.* = Worker.init(allocator);
+        }
+        return builder;
+    }
+
+    pub fn deinit(self: *Builder) void {
+        for (self.workers) |*worker| {
+            worker.deinit();
+        }
+        self.allocator.free(self.workers);
+        self.manifest_arena.deinit();
+    }
+
+    /// Brings the output up to date with all sources.
+    pub fn updateAll(self: *Builder) !Stats {
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+
+        var paths = std.ArrayList([]const u8).init(arena.allocator());
+        var walker = try self.source_dir.walk(self.allocator);
+        defer walker.deinit();
+        while (try walker.next()) |entry| {
+            if (entry.kind == .file and std.mem.endsWith(u8, entry.basename, ".gmi"))
+                try paths.append(try arena.allocator().dupe(u8, entry.path));
+        }
+
+        // Every known source that wasn't found anymore was removed.
+        var seen = std.StringHashMap(void).init(arena.allocator());
+        try seen.ensureTotalCapacity(@intCast(paths.items.len));
+        for (paths.items) |path| {
+            seen.putAssumeCapacity(path, {});
+        }
+        for (self.manifest.entries.keys()) |path| {
+            if (!seen.contains(path))
+                try paths.append(path);
+        }
+
+        return self.update(arena.allocator(), paths.items);
+    }
+
+    /// Brings the output up to date with the sources at `paths`, relative to the
+    /// source root. Paths that don't exist anymore are removed from the output.
+    pub fn updatePaths(self: *Builder, paths: []const []const u8) !Stats {
+        var arena = std.heap.ArenaAllocator.init(self.allocator);
+        defer arena.deinit();
+        return self.update(arena.allocator(), paths);
+    }
+
+    fn update(self: *Builder, arena: std.mem.Allocator, paths: []const []const u8) !Stats {
+        var stats = Stats{};
+        const manifest_allocator = self.manifest_arena.allocator();
+
+        // Find the sources that changed on disk.
+        var jobs = std.ArrayList(Job).init(arena);
+        var removed = std.ArrayList([]const u8).init(arena);
+        for (paths) |path| {
+            const stat = self.source_dir.statFile(path) catch |err| switch (err) {
+                error.FileNotFound => {
+                    if (self.manifest.entries.contains(path))
+                        try removed.append(path);
+                    continue;
+                },
+                else => return err,
+            };
+            if (self.manifest.entries.get(path)) |entry| {
+                if (entry.size == stat.size and entry.mtime == stat.mtime)
+                    continue;
+            }
+            try jobs.append(Job{ .path = path, .stat = stat });
+        }
+
+        // Hash them and scan the ones with new content for links.
+        defer {
+            for (self.workers) |*worker| {
+                _ = worker.results.reset(.retain_capacity);
+            }
+        }
+        try self.runParallel(scanJob, jobs.items);
+        stats.read = jobs.items.len;
+
+        var links_changed = self.backlinks_stale or removed.items.len > 0;
+        var render = std.StringArrayHashMap(void).init(arena);
+
+        // The manifest takes the new state of the sources before their pages are rendered.
+        // If the update fails halfway, those pages must look changed to the next update,
+        // so they are read and rendered again instead of being skipped as up to date.
+        errdefer {
+            for (jobs.items) |job| {
+                self.forget(job.path);
+            }
+            for (render.keys()) |path| {
+                self.forget(path);
+            }
+            if (links_changed)
+                self.backlinks_stale = true;
+        }
+        for (jobs.items) |job| {
+            const entry = try self.manifest.entries.getOrPut(manifest_allocator, job.path);
+            if (!entry.found_existing) {
+                entry.key_ptr.* = try manifest_allocator.dupe(u8, job.path);
+                entry.value_ptr.* = Entry{
+                    .size = 0,
+                    .mtime = 0,
+                    .content_hash = 0,
+                    .output_hash = 0,
+                    .backlinks_hash = 0,
+                    .links = &.{},
+                };
+            }
+            entry.value_ptr.size = job.stat.size;
+            entry.value_ptr.mtime = job.stat.mtime;
+            if (!job.changed and entry.found_existing)
+                continue;
+
+            stats.changed += 1;
+            if (!entry.found_existing or !sameLinks(entry.value_ptr.links, job.links)) {
+                links_changed = true;
+                const links = try manifest_allocator.alloc([]const u8, job.links.len);
+                for (links, job.links) |*dst, src| {
+                    dst.* = try manifest_allocator.dupe(u8, src);
+                }
+                entry.value_ptr.links = links;
+            }
+            entry.value_ptr.content_hash = job.content_hash;
+            try render.put(entry.key_ptr.*, {});
+        }
+
+        for (removed.items) |path| {
+            _ = self.manifest.entries.orderedRemove(path);
+            const output_path = try outputPath(arena, path, self.options.format);
+            self.output_dir.deleteFile(output_path) catch |err| switch (err) {
+                error.FileNotFound => {},
+                else => return err,
+            };
+        }
+        stats.removed = removed.items.len;
+
+        // Backlinks only change if links were added or removed somewhere.
+        var backlinks = Backlinks.init(arena);
+        if (links_changed) {
+            try backlinks.collect(self.manifest);
+            for (self.manifest.entries.keys(), self.manifest.entries.values()) |path, entry| {
+                if (backlinks.hash(path) != entry.backlinks_hash)
+                    try render.put(path, {});
+            }
+        } else if (render.count() > 0) {
+            try backlinks.collect(self.manifest);
+        }
+
+        // Render all pages whose content or backlinks changed.
+        const render_jobs = try arena.alloc(RenderJob, render.count());
+        for (render_jobs, render.keys()) |*job, path| {
+            job.* = RenderJob{ .path = path, .backlinks = backlinks.get(path) };
+        }
+        try self.runParallel(renderJob, render_jobs);
+
+        for (render_jobs) |job| {
+            const entry = self.manifest.entries.getPtr(job.path).?;
+            entry.backlinks_hash = backlinks.hash(job.path);
+            if (job.output_hash != entry.output_hash)
+                stats.written += 1;
+            entry.output_hash = job.output_hash;
+        }
+        stats.rendered = render_jobs.len;
+
+        if (stats.read > 0 or stats.removed > 0)
+            try self.manifest.save(self.output_dir);
+
+        self.backlinks_stale = false;
+        return stats;
+    }
+
+    /// Makes the next update read and render the page at `path` again.
+    fn forget(self: *Builder, path: []const u8) void {
+        const entry = self.manifest.entries.getPtr(path) orelse return;
+        entry.mtime = 0;
+        entry.content_hash = 0;
+    }
+
+    /// Runs `func(self, worker, job)` for all `jobs` on the worker threads.
+    fn runParallel(self: *Builder, comptime func: anytype, jobs: anytype) !void {
+        if (jobs.len == 0)
+            return;
+
+        const Runner = struct {
+            builder: *Builder,
+            jobs: @TypeOf(jobs),
+            next: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+            fn run(runner: *@This(), worker: *Worker) void {
+                while (true) {
+                    const index = runner.next.fetchAdd(1, .monotonic);
+                    if (index >= runner.jobs.len)
+                        break;
+                    defer _ = worker.scratch.reset(.retain_capacity);
+                    func(runner.builder, worker, &runner.jobs[index]) catch |err| {
+                        worker.failure = err;
+                        return;
+                    };
+                }
+            }
+        };
+
+        var runner = Runner{ .builder = self, .jobs = jobs };
+
+        // Small updates, like a single saved file, don't pay for spawning threads.
+        const thread_count = @min(self.workers.len, jobs.len);
+        if (thread_count == 1) {
+            runner.run(&self.workers[0]);
+        } else {
+            var threads: [64]std.Thread = undefined;
+            const spawned = @min(thread_count, threads.len);
+            for (threads[0..spawned], self.workers[0..spawned]) |*thread, *worker| {
+                thread.* = try std.Thread.spawn(.{}, Runner.run, .{ &runner, worker });
+            }
+            for (threads[0..spawned]) |thread| {
+                thread.join();
+            }
+        }
+
+        for (self.workers) |*worker| {
+            if (worker.failure) |err| {
+                worker.failure = null;
+                return err;
+            }
+        }
+    }
+
+    /// Hashes the source of `job` and collects its links if the content changed.
+    fn scanJob(self: *Builder, worker: *Worker, job: *Job) !void {
+        const text = try worker.readSource(self.source_dir, job.path);
+
+        job.content_hash = std.hash.Wyhash.hash(0, text);
+        if (self.manifest.entries.get(job.path)) |entry| {
+            if (entry.content_hash == job.content_hash)
+                return; // only touched
+        }
+        job.changed = true;
+
+        // The links must outlive the scratch arena until they are copied into the manifest.
+        const results = worker.results.allocator();
+        var links = std.ArrayList([]const u8).init(results);
+
+        const directory = std.fs.path.dirnamePosix(job.path) orelse "";
+        var scanner = gemtext.LinkScanner.init(text);
+        while (scanner.next()) |link| {
+            const target = try gemtext.resolveLinkTarget(results, directory, link.href) orelse continue;
+            try links.append(target);
+        }
+        std.mem.sort([]const u8, links.items, {}, stringLessThan);
+        job.links = dedupe(links.items);
+    }
+
+    /// Parses and renders a page with its backlinks and writes it if it changed.
+    fn renderJob(self: *Builder, worker: *Worker, job: *RenderJob) !void {
+        const scratch = worker.scratch.allocator();
+        const text = try worker.readSource(self.source_dir, job.path);
+
+        var timer = try std.time.Timer.start();
+
+        worker.parser.reset();
+        var fragments = std.ArrayList(gemtext.Fragment).init(scratch);
+        var offset: usize = 0;
+        while (offset < text.len) {
+            const result = try worker.parser.feed(scratch, text[offset..]);
+            offset += result.consumed;
+            if (result.fragment) |fragment| {
+                self.metrics.countFragment(std.meta.activeTag(fragment));
+                try fragments.append(fragment);
+            }
+        }
+        if (try worker.parser.finalize(scratch)) |fragment| {
+            self.metrics.countFragment(std.meta.activeTag(fragment));
+            try fragments.append(fragment);
+        }
+        self.metrics.countParsed(text.len);
+        self.metrics.observeParse(timer.lap());
+
+        if (job.backlinks.len > 0) {
+            try fragments.append(.empty);
+            try fragments.append(.{ .heading = .{ .level = .h2, .text = "Backlinks" } });
+            for (job.backlinks) |source| {
+                try fragments.append(.{ .link = .{
+                    .href = try std.fmt.allocPrintZ(scratch, "/{s}", .{source}),
+                    .title = null,
+                } });
+            }
+        }
+
+        worker.output.clearRetainingCapacity();
+        try gemtext.renderer.render(self.options.format, fragments.items, worker.output.writer());
+        self.metrics.observeRender(self.options.format, worker.output.items.len, timer.read());
+
+        job.output_hash = std.hash.Wyhash.hash(0, worker.output.items);
+
+        // Unchanged pages are not written, so their mtime stays and sync tools skip them.
+        const previous = self.manifest.entries.get(job.path).?.output_hash;
+        const output_path = try outputPath(scratch, job.path, self.options.format);
+        if (job.output_hash == previous) {
+            if (self.output_dir.access(output_path, .{})) |_| {
+                return;
+            } else |_| {}
+        }
+
+        if (std.fs.path.dirnamePosix(output_path)) |dir|
+            try self.output_dir.makePath(dir);
+        try self.output_dir.writeFile(output_path, worker.output.items);
+    }
+};
+
+const RenderJob = struct {
+    path: []const u8,
+    backlinks: []const []const u8,
+    output_hash: u64 = 0,
+};
+
+/// The sources linking to each page.
+const Backlinks = struct {
+    arena: std.mem.Allocator,
+    sources: std.StringHashMapUnmanaged(std.ArrayListUnmanaged([]const u8)) = .{},
+
+    fn init(arena: std.mem.Allocator) Backlinks {
+        return Backlinks{ .arena = arena };
+    }
+
+    fn collect(self: *Backlinks, manifest: Manifest) !void {
+        for (manifest.entries.keys(), manifest.entries.values()) |path, entry| {
+            for (entry.links) |target| {
+                if (std.mem.eql(u8, target, path))
+                    continue;
+                const list = try self.sources.getOrPut(self.arena, target);
+                if (!list.found_existing)
+                    list.value_ptr.* = .{};
+                try list.value_ptr.append(self.arena, path);
+            }
+        }
+
+        // The manifest order depends on when pages were added, so sort for a stable hash.
+        var lists = self.sources.valueIterator();
+        while (lists.next()) |list| {
+            std.mem.sort([]const u8, list.items, {}, stringLessThan);
+        }
+    }
+
+    fn get(self: Backlinks, path: []const u8) []const []const u8 {
+        const list = self.sources.get(path) orelse return &.{};
+        return list.items;
+    }
+
+    fn hash(self: Backlinks, path: []const u8) u64 {
+        var hasher = std.hash.Wyhash.init(0);
+        for (self.get(path)) |source| {
+            hasher.update(source);
+            hasher.update("\n");
+        }
+        return hasher.final();
+    }
+};
+
+fn sameLinks(a: []const []const u8, b: []const []const u8) bool {
+    if (a.len != b.len)
+        return false;
+    for (a, b) |x, y| {
+        if (!std.mem.eql(u8, x, y))
+            return false;
+    }
+    return true;
+}
+
+fn stringLessThan(_: void, a: []const u8, b: []const u8) bool {
+    return std.mem.lessThan(u8, a, b);
+}
+
+/// Removes duplicates from the sorted `items` in place and returns the unique prefix.
+fn dedupe(items: [][]const u8) []const []const u8 {
+    if (items.len == 0)
+        return items;
+    var count: usize = 1;
+    for (items[1..]) |item| {
+        if (std.mem.eql(u8, item, items[count - 1]))
+            continue;
+        items[count] = item;
+        count += 1;
+    }
+    return items[0..count];
+}
+
+fn outputPath(allocator: std.mem.Allocator, source: []const u8, format: Format) ![]const u8 {
+    const extension = switch (format) {
+        .gemtext => ".gmi",
+        .html => ".html",
+        .markdown => ".md",
+        .rtf => ".rtf",
+    };
+    return std.fmt.allocPrint(allocator, "{s}{s}", .{ source[0 .. source.len - ".gmi".len], extension });
+}
+
+fn writeMetrics(builder: *Builder, path: []const u8) !void {
+    var file = try std.fs.cwd().atomicFile(path, .{});
+    defer file.deinit();
+
+    var buffered = std.io.bufferedWriter(file.file.writer());
+    try builder.metrics.write(buffered.writer());
+    try buffered.flush();
+    try file.finish();
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var options = Options{};
+    var metrics_path: ?[]const u8 = null;
+    var watch_mode = false;
+    var debounce_ms: i32 = 10;
+    var positional = std.ArrayList([]const u8).init(allocator);
+    defer positional.deinit();
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--format") and i + 1 < args.len) {
+            i += 1;
+            options.format = std.meta.stringToEnum(Format, args[i]) orelse {
+                std.log.err("unknown format: {s}", .{args[i]});
+                return 1;
+            };
+        } else if (std.mem.eql(u8, arg, "--jobs") and i + 1 < args.len) {
+            i += 1;
+            options.jobs = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--metrics") and i + 1 < args.len) {
+            i += 1;
+            metrics_path = args[i];
+        } else if (std.mem.eql(u8, arg, "--watch")) {
+            watch_mode = true;
+        } else if (std.mem.eql(u8, arg, "--debounce") and i + 1 < args.len) {
+            i += 1;
+            debounce_ms = try std.fmt.parseInt(i32, args[i], 10);
+        } else {
+            try positional.append(arg);
+        }
+    }
+
+    if (positional.items.len != 2) {
+        std.log.err("usage: gembatch [--format FORMAT] [--jobs N] [--metrics FILE] [--watch] [--debounce MS] SOURCE OUTPUT", .{});
+        return 1;
+    }
+
+    var source_dir = try std.fs.cwd().openDir(positional.items[0], .{ .iterate = true });
+    defer source_dir.close();
+
+    try std.fs.cwd().makePath(positional.items[1]);
+    var output_dir = try std.fs.cwd().openDir(positional.items[1], .{});
+    defer output_dir.close();
+
+    var builder = try Builder.init(allocator, source_dir, output_dir, options);
+    defer builder.deinit();
+
+    var timer = try std.time.Timer.start();
+    const stats = try builder.updateAll();
+    logStats(&builder, stats, timer.read());
+
+    if (metrics_path) |path|
+        try writeMetrics(&builder, path);
+
+    if (watch_mode) {
+        var watcher = try Watcher.init(allocator, positional.items[0]);
+        defer watcher.deinit();
+
+        // Editors replace files and remove temporary directories while we look at them,
+        // so failures are logged and the next update checks the whole tree again.
+        var rescan = false;
+        while (true) {
+            var changes = watcher.wait(debounce_ms) catch |err| {
+                std.log.err("watching failed: {s}", .{@errorName(err)});
+                rescan = true;
+                continue;
+            };
+            defer changes.deinit();
+
+            timer.reset();
+            const update_stats = (if (rescan or changes.rescan)
+                builder.updateAll()
+            else
+                builder.updatePaths(changes.paths.keys())) catch |err| {
+                std.log.err("update failed: {s}", .{@errorName(err)});
+                rescan = true;
+                continue;
+            };
+            rescan = false;
+            logStats(&builder, update_stats, timer.read());
+
+            if (metrics_path) |path| {
+                writeMetrics(&builder, path) catch |err|
+                    std.log.err("writing metrics failed: {s}", .{@errorName(err)});
+            }
+        }
+    }
+
+    return 0;
+}
+
+fn logStats(builder: *Builder, stats: Builder.Stats, duration_ns: u64) void {
+    std.log.info("{} pages: {} read, {} changed, {} removed, {} rendered, {} written in {d:.1} ms", .{
+        builder.manifest.entries.count(),
+        stats.read,
+        stats.changed,
+        stats.removed,
+        stats.rendered,
+        stats.written,
+        @as(f64, @floatFromInt(duration_ns)) / std.time.ns_per_ms,
+    });
+}
+
+/// Watches a source tree with one inotify watch per directory.
+const Watcher = struct {
+    const linux = std.os.linux;
+    const posix = std.posix;
+
+    const events = linux.IN.CLOSE_WRITE | linux.IN.MOVED_TO | linux.IN.MOVED_FROM |
+        linux.IN.CREATE | linux.IN.DELETE | linux.IN.DELETE_SELF | linux.IN.ONLYDIR;
+
+    allocator: std.mem.Allocator,
+    root: []const u8,
+    fd: posix.fd_t,
+    /// The directory of each watch, relative to the root.
+    directories: std.AutoHashMap(i32, []const u8),
+
+    /// The sources affected by a batch of events.
+    const Changes = struct {
+        paths: std.StringArrayHashMap(void),
+        /// Set if the events can't be mapped to single files, so the whole tree must be checked.
+        rescan: bool = false,
+
+        fn deinit(self: *Changes) void {
+            for (self.paths.keys()) |path| {
+                self.paths.allocator.free(path);
+            }
+            self.paths.deinit();
+        }
+    };
+
+    fn init(allocator: std.mem.Allocator, root: []const u8) !Watcher {
+        var watcher = Watcher{
+            .allocator = allocator,
+            .root = root,
+            .fd = try posix.inotify_init1(linux.IN.CLOEXEC),
+            .directories = std.AutoHashMap(i32, []const u8).init(allocator),
+        };
+        errdefer watcher.deinit();
+
+        try watcher.watchTree("", null);
+        return watcher;
+    }
+
+    fn deinit(self: *Watcher) void {
+        var iterator = self.directories.valueIterator();
+        while (iterator.next()) |directory| {
+            self.allocator.free(directory.*);
+        }
+        self.directories.deinit();
+        posix.close(self.fd);
+    }
+
+    /// Watches `directory` and all directories below it. The sources found
+    /// are added to `changes`, if given, as they were created with the directory.
+    fn watchTree(self: *Watcher, directory: []const u8, changes: ?*Changes) !void {
+        try self.watchDirectory(directory);
+
+        const full_path = try std.fs.path.join(self.allocator, &.{ self.root, directory });
+        defer self.allocator.free(full_path);
+
+        var dir = try std.fs.cwd().openDir(full_path, .{ .iterate = true });
+        defer dir.close();
+
+        var walker = try dir.walk(self.allocator);
+        defer walker.deinit();
+        while (try walker.next()) |entry| {
+            const path = try std.fs.path.join(self.allocator, &.{ directory, entry.path });
+            defer self.allocator.free(path);
+
+            switch (entry.kind) {
+                .directory => self.watchDirectory(path) catch |err| switch (err) {
+                    error.FileNotFound => {}, // already removed again
+                    else => return err,
+                },
+                .file => if (changes) |c| {
+                    if (std.mem.endsWith(u8, path, ".gmi"))
+                        try c.paths.put(try self.allocator.dupe(u8, path), {});
+                },
+                else => {},
+            }
+        }
+    }
+
+    fn watchDirectory(self: *Watcher, directory: []const u8) !void {
+        const full_path = try std.fs.path.join(self.allocator, &.{ self.root, directory });
+        defer self.allocator.free(full_path);
+
+        const wd = try posix.inotify_add_watch(self.fd, full_path, events);
+        const entry = try self.directories.getOrPut(wd);
+        if (entry.found_existing)
+            self.allocator.free(entry.value_ptr.*);
+        entry.value_ptr.* = try self.allocator.dupe(u8, directory);
+    }
+
+    /// Blocks until something changed and the tree has been quiet for `debounce_ms`.
+    fn wait(self: *Watcher, debounce_ms: i32) !Changes {
+        var changes = Changes{ .paths = std.StringArrayHashMap(void).init(self.allocator) };
+        errdefer changes.deinit();
+
+        var timeout: i32 = -1;
+        while (true) {
+            var fds = [_]posix.pollfd{.{ .fd = self.fd, .events = posix.POLL.IN, .revents = 0 }};
+            if (try posix.poll(&fds, timeout) == 0) {
+                if (changes.rescan or changes.paths.count() > 0)
+                    return changes;
+                timeout = -1;
+                continue;
+            }
+
+            var buffer: [16 * 1024]u8 align(@alignOf(linux.inotify_event)) = undefined;
+            const len = try posix.read(self.fd, &buffer);
+
+            var offset: usize = 0;
+            while (offset < len) {
+                const event: *const linux.inotify_event = @ptrCast(@alignCast(&buffer[offset]));
+                const name_start = offset + @sizeOf(linux.inotify_event);
+                const name = std.mem.sliceTo(buffer[name_start .. name_start + event.len], 0);
+                offset = name_start + event.len;
+
+                try self.handleEvent(&changes, event.*, name);
+            }
+            timeout = debounce_ms;
+        }
+    }
+
+    fn handleEvent(self: *Watcher, changes: *Changes, event: linux.inotify_event, name: []const u8) !void {
+        if (event.mask & linux.IN.Q_OVERFLOW != 0) {
+            changes.rescan = true; // events were lost
+            return;
+        }
+        if (event.mask & linux.IN.IGNORED != 0) {
+            if (self.directories.fetchRemove(event.wd)) |entry|
+                self.allocator.free(entry.value);
+            return;
+        }
+
+        const directory = self.directories.get(event.wd) orelse return;
+        const path = try std.fs.path.join(self.allocator, &.{ directory, name });
+        defer self.allocator.free(path);
+
+        if (event.mask & linux.IN.ISDIR != 0) {
+            if (event.mask & (linux.IN.CREATE | linux.IN.MOVED_TO) != 0) {
+                self.watchTree(path, changes) catch |err| switch (err) {
+                    error.FileNotFound => {}, // the directory is already gone
+                    else => return err,
+                };
+            } else if (event.mask & linux.IN.MOVED_FROM != 0) {
+                // The sources below a moved directory are only known to the manifest.
+                changes.rescan = true;
+            }
+            return;
+        }
+
+        if (std.mem.endsWith(u8, name, ".gmi")) {
+            const entry = try changes.paths.getOrPut(path);
+            if (!entry.found_existing)
+                entry.key_ptr.* = try self.allocator.dupe(u8, path);
+        }
+    }
+};
+
+const testing = std.testing;
+
+/// Writes a source with an explicit mtime, so changes are detected regardless
+/// of the timestamp granularity of the file system.
+fn writeTestSource(dir: std.fs.Dir, path: []const u8, text: []const u8, mtime: i128) !void {
+    try dir.writeFile(path, text);
+    const file = try dir.openFile(path, .{ .mode = .read_write });
+    defer file.close();
+    try file.updateTimes(mtime, mtime);
+}
+
+fn expectStats(expected: Builder.Stats, actual: Builder.Stats) !void {
+    try testing.expectEqual(expected.read, actual.read);
+    try testing.expectEqual(expected.changed, actual.changed);
+    try testing.expectEqual(expected.removed, actual.removed);
+    try testing.expectEqual(expected.rendered, actual.rendered);
+    try testing.expectEqual(expected.written, actual.written);
+}
+
+fn expectOutputContains(dir: std.fs.Dir, path: []const u8, needle: []const u8, contained: bool) !void {
+    const output = try dir.readFileAlloc(testing.allocator, path, max_file_size);
+    defer testing.allocator.free(output);
+    try testing.expectEqual(contained, std.mem.indexOf(u8, output, needle) != null);
+}
+
+test "builder only renders and writes what changed" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    try tmp.dir.makeDir("source");
+    try tmp.dir.makeDir("output");
+    var source = try tmp.dir.openDir("source", .{ .iterate = true });
+    defer source.close();
+    var output = try tmp.dir.openDir("output", .{});
+    defer output.close();
+
+    const second = std.time.ns_per_s;
+    try writeTestSource(source, "a.gmi", "# A\n=> b.gmi\n", 1 * second);
+    try writeTestSource(source, "b.gmi", "# B\n", 1 * second);
+    try writeTestSource(source, "c.gmi", "# C\n", 1 * second);
+
+    {
+        var builder = try Builder.init(testing.allocator, source, output, .{ .jobs = 2 });
+        defer builder.deinit();
+        try expectStats(.{ .read = 3, .changed = 3, .rendered = 3, .written = 3 }, try builder.updateAll());
+        try expectOutputContains(output, "b.html", "/a.gmi", true);
+    }
+
+    // A new builder starts from the saved manifest, so nothing is read again.
+    var builder = try Builder.init(testing.allocator, source, output, .{ .jobs = 2 });
+    defer builder.deinit();
+    try expectStats(.{}, try builder.updateAll());
+
+    // Touching a source reads it, but its content hash is unchanged.
+    try writeTestSource(source, "c.gmi", "# C\n", 2 * second);
+    try expectStats(.{ .read = 1 }, try builder.updateAll());
+
+    // A content edit renders and writes only that page.
+    try writeTestSource(source, "c.gmi", "# C, edited\n", 3 * second);
+    try expectStats(.{ .read = 1, .changed = 1, .rendered = 1, .written = 1 }, try builder.updatePaths(&.{"c.gmi"}));
+
+    // A new link also renders the page it points to, for the new backlink.
+    try writeTestSource(source, "c.gmi", "# C, edited\n=> b.gmi\n", 4 * second);
+    try expectStats(.{ .read = 1, .changed = 1, .rendered = 2, .written = 2 }, try builder.updateAll());
+    try expectOutputContains(output, "b.html", "/c.gmi", true);
+
+    // Removing a source deletes its page and renders the pages it linked to.
+    try source.deleteFile("a.gmi");
+    try expectStats(.{ .removed = 1, .rendered = 1, .written = 1 }, try builder.updateAll());
+    try testing.expectError(error.FileNotFound, output.access("a.html", .{}));
+    try expectOutputContains(output, "b.html", "/a.gmi", false);
+}
+
+test "manifest keeps links longer than 64 KiB" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    try tmp.dir.makeDir("source");
+    try tmp.dir.makeDir("output");
+    var source = try tmp.dir.openDir("source", .{ .iterate = true });
+    defer source.close();
+    var output = try tmp.dir.openDir("output", .{});
+    defer output.close();
+
+    const target = "t" ** (70 * 1024) ++ ".gmi";
+    try writeTestSource(source, "long.gmi", "=> " ++ target ++ "\n", std.time.ns_per_s);
+
+    {
+        var builder = try Builder.init(testing.allocator, source, output, .{ .jobs = 1 });
+        defer builder.deinit();
+        try expectStats(.{ .read = 1, .changed = 1, .rendered = 1, .written = 1 }, try builder.updateAll());
+    }
+
+    var builder = try Builder.init(testing.allocator, source, output, .{ .jobs = 1 });
+    defer builder.deinit();
+    const links = builder.manifest.entries.get("long.gmi").?.links;
+    try testing.expectEqual(@as(usize, 1), links.len);
+    try testing.expectEqualStrings(target, links[0]);
+    try expectStats(.{}, try builder.updateAll());
+}
+
+test "builder renders pages again after a failed update" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    try tmp.dir.makeDir("source");
+    try tmp.dir.makeDir("output");
+    var source = try tmp.dir.openDir("source", .{ .iterate = true });
+    defer source.close();
+    var output = try tmp.dir.openDir("output", .{});
+    defer output.close();
+
+    const second = std.time.ns_per_s;
+    try writeTestSource(source, "a.gmi", "# A\n", 1 * second);
+    try writeTestSource(source, "b.gmi", "# B\n", 1 * second);
+
+    var builder = try Builder.init(testing.allocator, source, output, .{ .jobs = 2 });
+    defer builder.deinit();
+    try expectStats(.{ .read = 2, .changed = 2, .rendered = 2, .written = 2 }, try builder.updateAll());
+
+    // The new link renders a.html for its backlink, which can't be written over a directory.
+    try writeTestSource(source, "b.gmi", "# B\n=> a.gmi\n", 2 * second);
+    try output.deleteFile("a.html");
+    try output.makeDir("a.html");
+    try testing.expectError(error.IsDir, builder.updateAll());
+
+    // Neither the edited page nor the page with the new backlink is skipped as up to date.
+    try output.deleteDir("a.html");
+    try expectStats(.{ .read = 2, .changed = 2, .rendered = 2, .written = 2 }, try builder.updateAll());
+    try expectOutputContains(output, "a.html", "/b.gmi", true);
+}
+
+test "corrupt manifest counts are rejected without allocating them" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    var arena = std.heap.ArenaAllocator.init(testing.allocator);
+    defer arena.deinit();
+
+    // One entry claiming four billion links, then a manifest claiming four billion entries.
+    const entry = [_]u8{1} ++ "a" ++ [_]u8{0} ** (8 + 16 + 8 + 8 + 8) ++ [_]u8{0xff} ** 4;
+    const header = manifest_magic ++ [_]u8{ manifest_version, 0, 0, 0, @intFromEnum(Format.html) };
+    for ([_][]const u8{
+        header ++ [_]u8{ 1, 0, 0, 0 } ++ entry,
+        header ++ [_]u8{0xff} ** 4 ++ entry,
+    }) |data| {
+        try tmp.dir.writeFile(manifest_name, data);
+        const manifest = try Manifest.load(arena.allocator(), tmp.dir, .html);
+        try testing.expectEqual(@as(usize, 0), manifest.entries.count());
+    }
+}
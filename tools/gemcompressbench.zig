@@ -0,0 +1,79 @@
+//! Compares rendering a document to gzipped HTML in two passes, rendering into
+//! a buffer and compressing the buffer, against rendering straight into the
+//! compressor with `renderer.compressed`, for every compression level.
+//!
+//! Usage: gemcompressbench [file] [iterations]
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+const Level = gemtext.renderer.compressed.Level;
+
+const levels = [_]Level{ .level_4, .level_5, .level_6, .level_7, .level_8, .level_9 };
+
+fn twoPass(fragments: []const gemtext.Fragment, level: Level, buffer: *std.ArrayList(u8), writer: anytype) !void {
+    buffer.clearRetainingCapacity();
+    try gemtext.renderer.html(fragments, buffer.writer());
+
+    var source = std.io.fixedBufferStream(buffer.items);
+    try std.compress.gzip.compress(source.reader(), writer, .{ .level = level });
+}
+
+fn onePass(allocator: std.mem.Allocator, fragments: []const gemtext.Fragment, level: Level, writer: anytype) !void {
+    try gemtext.renderer.compressed.render(allocator, .html, .gzip, level, fragments, writer);
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    const path = if (args.len > 1) args[1] else "src/test-data/specification.gmi";
+    const iterations = if (args.len > 2) try std.fmt.parseInt(usize, args[2], 10) else 500;
+
+    const text = try std.fs.cwd().readFileAlloc(allocator, path, 64 * 1024 * 1024);
+    defer allocator.free(text);
+
+    var document = try gemtext.Document.parseString(allocator, text);
+    defer document.deinit();
+    const fragments = document.fragments.items;
+
+    var buffer = std.ArrayList(u8).init(allocator);
+    defer buffer.deinit();
+    try gemtext.renderer.html(fragments, buffer.writer());
+    const html_size = buffer.items.len;
+
+    const mib = @as(f64, @floatFromInt(html_size * iterations)) / (1024.0 * 1024.0);
+
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("output: {} bytes of HTML, {} iterations\n", .{ html_size, iterations });
+    try stdout.print("level  ratio  two passes (MiB/s)  one pass (MiB/s)\n", .{});
+
+    for (levels) |level| {
+        var counting = std.io.countingWriter(std.io.null_writer);
+        try onePass(allocator, fragments, level, counting.writer());
+        const ratio = @as(f64, @floatFromInt(counting.bytes_written)) / @as(f64, @floatFromInt(html_size));
+
+        var timer = try std.time.Timer.start();
+        for (0..iterations) |_| {
+            try twoPass(fragments, level, &buffer, std.io.null_writer);
+        }
+        const two_pass_time = @as(f64, @floatFromInt(timer.lap())) / std.time.ns_per_s;
+
+        for (0..iterations) |_| {
+            try onePass(allocator, fragments, level, std.io.null_writer);
+        }
+        const one_pass_time = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_s;
+
+        try stdout.print("{d:>5}  {d:>5.3}  {d:>18.1}  {d:>16.1}\n", .{
+            @intFromEnum(level),
+            ratio,
+            mib / two_pass_time,
+            mib / one_pass_time,
+        });
+    }
+}
@@ -0,0 +1,241 @@
+//! This tool generates Atom feeds for gemlogs, following the gemini subscription
+//! convention: every link on the index page whose title starts with a date
+//! (`=> post.gmi 2024-01-31 Title`) is an entry of the feed.
+//!
+//!     gemfeed [--jobs N] [--base-url URL] [--output NAME] INDEX...
+//!
+//! For each index page, the feed is written next to it as NAME (default: `atom.xml`).
+//! The feed title is the first heading of the index page; the entry titles are
+//! the first headings of the linked posts, if they are local files, or the link
+//! titles otherwise. Relative links are made absolute with `--base-url` and the
+//! path of the index page.
+//!
+//! Neither index pages nor posts are parsed into fragments: links and headings are
+//! found with the line scanning kernels, and the XML is escaped with the vectorized
+//! HTML escaping kernel. Index pages are processed in parallel on a `ThreadPool`.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+const corpus = @import("corpus.zig");
+
+const max_file_size = 16 * 1024 * 1024;
+
+const Options = struct {
+    base_url: []const u8 = "",
+    output_name: []const u8 = "atom.xml",
+};
+
+const Entry = struct {
+    date: []const u8,
+    title: []const u8,
+    url: []const u8,
+};
+
+/// Returns the text of the first heading of `text`, or `null` if there is none.
+fn firstHeading(text: []const u8) ?[]const u8 {
+    var preformatted = false;
+    var offset: usize = 0;
+    while (offset < text.len) {
+        const rest = text[offset..];
+        const end = gemtext.kernels.indexOfNewline(rest);
+        offset += @min(end + 1, rest.len);
+
+        const line = std.mem.trimRight(u8, rest[0..end], "\r");
+        const prefix: usize = switch (gemtext.kernels.classifyLine(line)) {
+            .preformatted_toggle => {
+                preformatted = !preformatted;
+                continue;
+            },
+            .heading_1 => 1,
+            .heading_2 => 2,
+            .heading_3 => 3,
+            else => continue,
+        };
+        if (!preformatted)
+            return std.mem.trim(u8, line[prefix..], " \t");
+    }
+    return null;
+}
+
+/// Splits a `YYYY-MM-DD title` link title into its date and the rest.
+fn splitDate(title: []const u8) ?struct { date: []const u8, rest: []const u8 } {
+    if (title.len < 10)
+        return null;
+    for (title[0..10], 0..) |c, i| {
+        const valid = if (i == 4 or i == 7) c == '-' else std.ascii.isDigit(c);
+        if (!valid)
+            return null;
+    }
+    if (title.len > 10 and title[10] != ' ' and title[10] != '\t')
+        return null;
+    return .{
+        .date = title[0..10],
+        .rest = std.mem.trim(u8, title[10..], " \t-:"),
+    };
+}
+
+/// Escapes the XML special characters of `text`. They are the same as in HTML.
+const fmtXml = gemtext.renderer.fmtHtml;
+
+/// Returns the URL of the local file at `path`, relative to the root that `base_url` points to.
+/// The query and fragment of `href`, the link to the file, are kept.
+fn localUrl(arena: std.mem.Allocator, base_url: []const u8, path: []const u8, href: []const u8) ![]const u8 {
+    var url = std.ArrayList(u8).init(arena);
+    try url.appendSlice(base_url);
+    for (path) |c| {
+        const unreserved = std.ascii.isAlphanumeric(c) or std.mem.indexOfScalar(u8, "-._~/!$&'()*+,;=:@", c) != null;
+        if (unreserved) {
+            try url.append(c);
+        } else {
+            try url.writer().print("%{X:0>2}", .{c});
+        }
+    }
+    const suffix = std.mem.indexOfAny(u8, href, "?#") orelse href.len;
+    try url.appendSlice(href[suffix..]);
+    return url.items;
+}
+
+fn dateLessThan(_: void, a: Entry, b: Entry) bool {
+    return std.mem.order(u8, a.date, b.date) == .gt;
+}
+
+/// Writes the feed of the gemlog with the index page at `index_path`.
+fn generateFeed(arena: std.mem.Allocator, options: Options, index_path: []const u8) !usize {
+    const index = try std.fs.cwd().readFileAlloc(arena, index_path, max_file_size);
+    const directory = std.fs.path.dirname(index_path) orelse ".";
+
+    const base_url = try std.fmt.allocPrint(arena, "{s}{s}", .{
+        options.base_url,
+        if (std.mem.eql(u8, directory, ".")) "" else try std.fmt.allocPrint(arena, "{s}/", .{directory}),
+    });
+
+    var entries = std.ArrayList(Entry).init(arena);
+
+    var links = gemtext.LinkScanner.init(index);
+    while (links.next()) |link| {
+        const split = splitDate(link.title orelse continue) orelse continue;
+
+        var entry = Entry{
+            .date = split.date,
+            .title = split.rest,
+            .url = link.href,
+        };
+
+        if (try gemtext.resolveLinkTarget(arena, directory, link.href)) |post_path| {
+            // The resolved path has no `.` or `..` left and absolute links start at the root.
+            entry.url = try localUrl(arena, options.base_url, post_path, link.href);
+
+            // Prefer the heading of the post, as index titles are often shortened.
+            if (std.fs.cwd().readFileAlloc(arena, post_path, max_file_size)) |post| {
+                if (firstHeading(post)) |heading|
+                    entry.title = heading;
+            } else |_| {}
+        }
+        if (entry.title.len == 0)
+            entry.title = entry.date;
+
+        try entries.append(entry);
+    }
+
+    std.mem.sort(Entry, entries.items, {}, dateLessThan);
+
+    const feed_path = try std.fs.path.join(arena, &.{ directory, options.output_name });
+    var file = try std.fs.cwd().atomicFile(feed_path, .{});
+    defer file.deinit();
+
+    var buffered = std.io.bufferedWriter(file.file.writer());
+    const writer = buffered.writer();
+
+    const feed_title = firstHeading(index) orelse std.fs.path.basename(index_path);
+    const feed_url = try std.fmt.allocPrint(arena, "{s}{s}", .{ base_url, options.output_name });
+    const index_url = try std.fmt.allocPrint(arena, "{s}{s}", .{ base_url, std.fs.path.basename(index_path) });
+    const updated = if (entries.items.len > 0) entries.items[0].date else "1970-01-01";
+
+    try writer.writeAll("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<feed xmlns=\"http://www.w3.org/2005/Atom\">\n");
+    try writer.print("  <title>{}</title>\n", .{fmtXml(feed_title)});
+    try writer.print("  <id>{}</id>\n", .{fmtXml(feed_url)});
+    try writer.print("  <link rel=\"self\" href=\"{}\"/>\n", .{fmtXml(feed_url)});
+    try writer.print("  <link href=\"{}\"/>\n", .{fmtXml(index_url)});
+    try writer.print("  <updated>{s}T12:00:00Z</updated>\n", .{updated});
+
+    for (entries.items) |entry| {
+        try writer.writeAll("  <entry>\n");
+        try writer.print("    <title>{}</title>\n", .{fmtXml(entry.title)});
+        try writer.print("    <link href=\"{}\"/>\n", .{fmtXml(entry.url)});
+        try writer.print("    <id>{}</id>\n", .{fmtXml(entry.url)});
+        try writer.print("    <updated>{s}T12:00:00Z</updated>\n", .{entry.date});
+        try writer.writeAll("  </entry>\n");
+    }
+    try writer.writeAll("</feed>\n");
+
+    try buffered.flush();
+    try file.finish();
+
+    return entries.items.len;
+}
+
+const Context = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    entries: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+};
+
+fn processIndex(context: *Context, index: usize, path: []const u8) !void {
+    _ = index;
+
+    var arena = std.heap.ArenaAllocator.init(context.allocator);
+    defer arena.deinit();
+
+    const count = try generateFeed(arena.allocator(), context.options, path);
+    _ = context.entries.fetchAdd(count, .monotonic);
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var options = Options{};
+    var jobs: usize = 0;
+    var indices = std.ArrayList([]const u8).init(allocator);
+    defer indices.deinit();
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--jobs") and i + 1 < args.len) {
+            i += 1;
+            jobs = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--base-url") and i + 1 < args.len) {
+            i += 1;
+            options.base_url = args[i];
+        } else if (std.mem.eql(u8, arg, "--output") and i + 1 < args.len) {
+            i += 1;
+            options.output_name = args[i];
+        } else {
+            try indices.append(arg);
+        }
+    }
+
+    if (indices.items.len == 0) {
+        std.log.err("usage: gemfeed [--jobs N] [--base-url URL] [--output NAME] INDEX...", .{});
+        return 1;
+    }
+
+    var context = Context{
+        .allocator = allocator,
+        .options = options,
+    };
+    const failed = try corpus.forEach(allocator, jobs, indices.items, &context, processIndex);
+
+    std.log.info("{} feeds with {} entries, {} failed", .{
+        indices.items.len - failed,
+        context.entries.load(.monotonic),
+        failed,
+    });
+    return if (failed > 0) 1 else 0;
+}
@@ -0,0 +1,494 @@
+//! This tool searches for inputs that make the parser or one of the renderers
+//! slow, measured in time and allocations per input byte.
+//!
+//! In search mode, it mutates a corpus of gemini text documents, keeps every
+//! input that increases the cost of any target, minimizes the worst inputs it
+//! found and stores them as regression cases together with a throughput floor:
+//!
+//!     gemfuzz [--iterations N] [--seed S] [--max-size BYTES] [--out DIR] [SEED_FILE...]
+//!
+//! In check mode, it runs all stored regression cases and fails if any of them
+//! drops below its recorded floor:
+//!
+//!     gemfuzz --check DIR
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+const Target = enum {
+    parse,
+    gemtext,
+    html,
+    markdown,
+    rtf,
+};
+
+const Metric = enum {
+    time,
+    allocations,
+};
+
+const Cost = struct {
+    /// Nanoseconds per input byte.
+    ns_per_byte: f64,
+    /// Allocations per input byte.
+    allocs_per_byte: f64,
+
+    fn get(self: Cost, metric: Metric) f64 {
+        return switch (metric) {
+            .time => self.ns_per_byte,
+            .allocations => self.allocs_per_byte,
+        };
+    }
+
+    fn mibPerSecond(self: Cost) f64 {
+        return 1e9 / self.ns_per_byte / (1024.0 * 1024.0);
+    }
+};
+
+/// Wraps an allocator and counts the number of allocations done through it.
+const CountingAllocator = struct {
+    parent: std.mem.Allocator,
+    count: usize = 0,
+
+    fn allocator(self: *CountingAllocator) std.mem.Allocator {
+        return .{
+            .ptr = self,
+            .vtable = &.{
+                .alloc = alloc,
+                .resize = resize,
+                .free = free,
+            },
+        };
+    }
+
+    fn alloc(ctx: *anyopaque, len: usize, ptr_align: u8, ret_addr: usize) ?[*]u8 {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.count += 1;
+        return self.parent.rawAlloc(len, ptr_align, ret_addr);
+    }
+
+    fn resize(ctx: *anyopaque, buf: []u8, buf_align: u8, new_len: usize, ret_addr: usize) bool {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        return self.parent.rawResize(buf, buf_align, new_len, ret_addr);
+    }
+
+    fn free(ctx: *anyopaque, buf: []u8, buf_align: u8, ret_addr: usize) void {
+        const self: *CountingAllocator = @ptrCast(@alignCast(ctx));
+        self.parent.rawFree(buf, buf_align, ret_addr);
+    }
+};
+
+/// Lines that are mixed into inputs. They cover every line type and the
+/// transitions between all block types.
+const interesting_lines = [_][]const u8{
+    "",
+    "text",
+    "> quote",
+    ">",
+    "* item",
+    "*",
+    "```",
+    "```alt",
+    "=> gemini://example.org/ title",
+    "=>",
+    "# heading",
+    "## heading",
+    "### heading",
+    "<&\"'>",
+    " \t ",
+};
+
+const interesting_bytes = "\n\r \t>*`=#<&\"'";
+
+fn parseInput(allocator: std.mem.Allocator, input: []const u8) !gemtext.Document {
+    var document = gemtext.Document.init(allocator);
+    errdefer document.deinit();
+
+    var parser = gemtext.Parser.init(allocator);
+    defer parser.deinit();
+
+    var offset: usize = 0;
+    while (offset < input.len) {
+        const res = try parser.feed(document.arena.allocator(), input[offset..]);
+        offset += res.consumed;
+        if (res.fragment) |frag|
+            try document.fragments.append(frag);
+    }
+    if (try parser.finalize(document.arena.allocator())) |frag|
+        try document.fragments.append(frag);
+
+    return document;
+}
+
+/// Runs `target` once and returns the number of allocations it made.
+/// Renderers render `fragments`, which were parsed from `input` up front, so
+/// their cost doesn't include the parser.
+fn runTarget(allocator: std.mem.Allocator, target: Target, input: []const u8, fragments: []const gemtext.Fragment) !usize {
+    var counter = CountingAllocator{ .parent = allocator };
+    const counting = counter.allocator();
+
+    const format: gemtext.renderer.Format = switch (target) {
+        .parse => {
+            var document = try parseInput(counting, input);
+            document.deinit();
+            return counter.count;
+        },
+        .gemtext => .gemtext,
+        .html => .html,
+        .markdown => .markdown,
+        .rtf => .rtf,
+    };
+    try gemtext.renderer.render(format, fragments, std.io.null_writer);
+    return counter.count;
+}
+
+/// Measures the cost of `target` for `input`. Short inputs are repeated until
+/// the measurement takes at least `min_duration` nanoseconds.
+fn measure(allocator: std.mem.Allocator, target: Target, input: []const u8, min_duration: u64) !Cost {
+    if (input.len == 0)
+        return Cost{ .ns_per_byte = 0, .allocs_per_byte = 0 };
+
+    // Renderers are measured on a document that is parsed once, outside of the timer.
+    var document: ?gemtext.Document = if (target == .parse) null else try parseInput(allocator, input);
+    defer if (document) |*doc| doc.deinit();
+    var fragments: []const gemtext.Fragment = &[_]gemtext.Fragment{};
+    if (document) |doc|
+        fragments = doc.fragments.items;
+
+    var best: u64 = std.math.maxInt(u64);
+    var allocations: usize = 0;
+    var rounds: usize = 0;
+    var total: u64 = 0;
+
+    while (rounds < 3 or total < min_duration) : (rounds += 1) {
+        var timer = try std.time.Timer.start();
+        allocations = try runTarget(allocator, target, input, fragments);
+        const elapsed = timer.read();
+        best = @min(best, elapsed);
+        total += elapsed;
+    }
+
+    const len: f64 = @floatFromInt(input.len);
+    return Cost{
+        .ns_per_byte = @as(f64, @floatFromInt(best)) / len,
+        .allocs_per_byte = @as(f64, @floatFromInt(allocations)) / len,
+    };
+}
+
+fn lineStarts(allocator: std.mem.Allocator, input: []const u8) !std.ArrayList(usize) {
+    var starts = std.ArrayList(usize).init(allocator);
+    errdefer starts.deinit();
+
+    try starts.append(0);
+    for (input, 0..) |c, i| {
+        if (c == '\n')
+            try starts.append(i + 1);
+    }
+    return starts;
+}
+
+fn mutate(random: std.rand.Random, input: *std.ArrayList(u8), max_size: usize) !void {
+    const starts = try lineStarts(input.allocator, input.items);
+    defer starts.deinit();
+
+    const lines = starts.items;
+    const at = lines[random.uintLessThan(usize, lines.len)];
+
+    switch (random.uintLessThan(u8, 5)) {
+        // insert an interesting line
+        0 => {
+            const line = interesting_lines[random.uintLessThan(usize, interesting_lines.len)];
+            try input.insertSlice(at, "\n");
+            try input.insertSlice(at, line);
+        },
+        // duplicate a run of lines
+        1 => {
+            const end = lines[@min(lines.len - 1, random.uintLessThan(usize, lines.len) + 1)];
+            if (end > at) {
+                const run = try input.allocator.dupe(u8, input.items[at..end]);
+                defer input.allocator.free(run);
+                try input.insertSlice(end, run);
+            }
+        },
+        // delete a run of lines
+        2 => {
+            const end = lines[@min(lines.len - 1, random.uintLessThan(usize, lines.len) + 1)];
+            if (end > at)
+                try input.replaceRange(at, end - at, "");
+        },
+        // replace a line prefix
+        3 => {
+            const prefixes = [_][]const u8{ ">", "* ", "```", "=> ", "#", "" };
+            const prefix = prefixes[random.uintLessThan(usize, prefixes.len)];
+            const old_len = @min(3, input.items.len - at);
+            try input.replaceRange(at, old_len, prefix);
+        },
+        // overwrite a random byte
+        4 => if (input.items.len > 0) {
+            input.items[random.uintLessThan(usize, input.items.len)] = interesting_bytes[random.uintLessThan(usize, interesting_bytes.len)];
+        },
+        else => unreachable,
+    }
+
+    if (input.items.len > max_size)
+        input.shrinkRetainingCapacity(max_size);
+}
+
+/// Removes lines from `input` as long as its cost stays above 90% of the original cost.
+fn minimize(allocator: std.mem.Allocator, target: Target, metric: Metric, input: []const u8) ![]u8 {
+    var current = try allocator.dupe(u8, input);
+    errdefer allocator.free(current);
+
+    const goal = 0.9 * (try measure(allocator, target, current, 1_000_000)).get(metric);
+
+    var chunk_lines: usize = blk: {
+        const starts = try lineStarts(allocator, current);
+        defer starts.deinit();
+        break :blk @max(1, starts.items.len / 2);
+    };
+
+    while (true) {
+        const starts = try lineStarts(allocator, current);
+        defer starts.deinit();
+
+        var removed_any = false;
+        var line: usize = 0;
+        while (line + chunk_lines < starts.items.len) : (line += chunk_lines) {
+            const begin = starts.items[line];
+            const end = starts.items[line + chunk_lines];
+
+            const candidate = try std.mem.concat(allocator, u8, &.{ current[0..begin], current[end..] });
+            if (candidate.len > 0 and (try measure(allocator, target, candidate, 1_000_000)).get(metric) >= goal) {
+                allocator.free(current);
+                current = candidate;
+                removed_any = true;
+                break;
+            }
+            allocator.free(candidate);
+        }
+
+        if (removed_any)
+            continue;
+        if (chunk_lines == 1)
+            break;
+        chunk_lines /= 2;
+    }
+
+    return current;
+}
+
+const Options = struct {
+    iterations: usize = 20_000,
+    seed: u64 = 0,
+    max_size: usize = 64 * 1024,
+    out_dir: []const u8 = "src/test-data/worst-case",
+};
+
+fn search(allocator: std.mem.Allocator, options: Options, seed_files: []const []const u8) !void {
+    var prng = std.rand.DefaultPrng.init(options.seed);
+    const random = prng.random();
+
+    var corpus = std.ArrayList([]u8).init(allocator);
+    defer {
+        for (corpus.items) |item| allocator.free(item);
+        corpus.deinit();
+    }
+
+    for (seed_files) |path| {
+        try corpus.append(try std.fs.cwd().readFileAlloc(allocator, path, options.max_size));
+    }
+    if (corpus.items.len == 0) {
+        try corpus.append(try std.mem.join(allocator, "\n", &interesting_lines));
+    }
+
+    const Worst = struct {
+        cost: f64 = 0,
+        input: ?[]u8 = null,
+    };
+    var worst = std.EnumArray(Target, std.EnumArray(Metric, Worst)).initFill(std.EnumArray(Metric, Worst).initFill(.{}));
+    defer for (std.enums.values(Target)) |target| {
+        for (std.enums.values(Metric)) |metric| {
+            if (worst.get(target).get(metric).input) |input|
+                allocator.free(input);
+        }
+    };
+
+    var candidate = std.ArrayList(u8).init(allocator);
+    defer candidate.deinit();
+
+    for (0..options.iterations) |iteration| {
+        candidate.shrinkRetainingCapacity(0);
+        try candidate.appendSlice(corpus.items[random.uintLessThan(usize, corpus.items.len)]);
+        for (0..1 + random.uintLessThan(usize, 8)) |_| {
+            try mutate(random, &candidate, options.max_size);
+        }
+        if (candidate.items.len == 0)
+            continue;
+
+        var interesting = false;
+        for (std.enums.values(Target)) |target| {
+            const cost = try measure(allocator, target, candidate.items, 0);
+            for (std.enums.values(Metric)) |metric| {
+                const entry = worst.getPtr(target).getPtr(metric);
+                if (cost.get(metric) > entry.cost) {
+                    if (entry.input) |input|
+                        allocator.free(input);
+                    entry.* = Worst{
+                        .cost = cost.get(metric),
+                        .input = try allocator.dupe(u8, candidate.items),
+                    };
+                    interesting = true;
+                }
+            }
+        }
+
+        if (interesting) {
+            const item = try allocator.dupe(u8, candidate.items);
+            if (corpus.items.len < 64) {
+                try corpus.append(item);
+            } else {
+                const index = random.uintLessThan(usize, corpus.items.len);
+                allocator.free(corpus.items[index]);
+                corpus.items[index] = item;
+            }
+        }
+
+        if (iteration % 1000 == 0)
+            std.log.info("iteration {d}, corpus size {d}", .{ iteration, corpus.items.len });
+    }
+
+    var out_dir = try std.fs.cwd().makeOpenPath(options.out_dir, .{});
+    defer out_dir.close();
+
+    var floors = try out_dir.createFile("floors.txt", .{ .truncate = false });
+    defer floors.close();
+    try floors.seekFromEnd(0);
+
+    for (std.enums.values(Target)) |target| {
+        for (std.enums.values(Metric)) |metric| {
+            const input = worst.get(target).get(metric).input orelse continue;
+
+            const minimized = try minimize(allocator, target, metric, input);
+            defer allocator.free(minimized);
+
+            const cost = try measure(allocator, target, minimized, 10_000_000);
+
+            var name_buffer: [64]u8 = undefined;
+            const name = try std.fmt.bufPrint(&name_buffer, "{s}-{s}-{x:0>16}.gmi", .{
+                @tagName(target),
+                @tagName(metric),
+                std.hash.Wyhash.hash(0, minimized),
+            });
+            try out_dir.writeFile(name, minimized);
+
+            // leave plenty of headroom for slower machines, the floors only catch regressions in complexity.
+            try floors.writer().print("{s} {s} {d:.1} {d:.3}\n", .{
+                name,
+                @tagName(target),
+                cost.mibPerSecond() / 4.0,
+                4.0 * cost.allocs_per_byte * 1024.0,
+            });
+
+            std.log.info("{s}: {d:.2} ns/byte, {d:.3} allocations/byte, {d} bytes", .{
+                name,
+                cost.ns_per_byte,
+                cost.allocs_per_byte,
+                minimized.len,
+            });
+        }
+    }
+}
+
+/// Runs every case in `DIR/floors.txt`. Each line has the form
+/// `<file> <target> <min MiB/s> <max allocations per KiB>`, lines starting with `#` are comments.
+fn check(allocator: std.mem.Allocator, dir_path: []const u8) !bool {
+    var dir = try std.fs.cwd().openDir(dir_path, .{});
+    defer dir.close();
+
+    const floors = try dir.readFileAlloc(allocator, "floors.txt", 1 << 20);
+    defer allocator.free(floors);
+
+    var ok = true;
+    var lines = std.mem.tokenizeAny(u8, floors, "\r\n");
+    while (lines.next()) |line| {
+        if (line[0] == '#')
+            continue;
+
+        var fields = std.mem.tokenizeAny(u8, line, " \t");
+        const file_name = fields.next() orelse return error.InvalidFloors;
+        const target = std.meta.stringToEnum(Target, fields.next() orelse return error.InvalidFloors) orelse return error.InvalidFloors;
+        const min_throughput = try std.fmt.parseFloat(f64, fields.next() orelse return error.InvalidFloors);
+        const max_allocs_per_kib = try std.fmt.parseFloat(f64, fields.next() orelse return error.InvalidFloors);
+
+        const input = try dir.readFileAlloc(allocator, file_name, 1 << 26);
+        defer allocator.free(input);
+
+        const cost = try measure(allocator, target, input, 50_000_000);
+        const allocs_per_kib = cost.allocs_per_byte * 1024.0;
+
+        const passed = cost.mibPerSecond() >= min_throughput and allocs_per_kib <= max_allocs_per_kib;
+        if (!passed)
+            ok = false;
+
+        std.debug.print("{s} {s} {s}: {d:.1} MiB/s (floor {d:.1}), {d:.3} allocations/KiB (limit {d:.3})\n", .{
+            if (passed) "PASS" else "FAIL",
+            file_name,
+            @tagName(target),
+            cost.mibPerSecond(),
+            min_throughput,
+            allocs_per_kib,
+            max_allocs_per_kib,
+        });
+    }
+    return ok;
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var options = Options{};
+    var seed_files = std.ArrayList([]const u8).init(allocator);
+    defer seed_files.deinit();
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--check")) {
+            if (i + 1 >= args.len)
+                return error.MissingArgument;
+            return if (try check(allocator, args[i + 1])) 0 else 1;
+        } else if (std.mem.eql(u8, arg, "--iterations")) {
+            if (i + 1 >= args.len)
+                return error.MissingArgument;
+            i += 1;
+            options.iterations = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--seed")) {
+            if (i + 1 >= args.len)
+                return error.MissingArgument;
+            i += 1;
+            options.seed = try std.fmt.parseInt(u64, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--max-size")) {
+            if (i + 1 >= args.len)
+                return error.MissingArgument;
+            i += 1;
+            options.max_size = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--out")) {
+            if (i + 1 >= args.len)
+                return error.MissingArgument;
+            i += 1;
+            options.out_dir = args[i];
+        } else {
+            try seed_files.append(arg);
+        }
+    }
+
+    try search(allocator, options, seed_files.items);
+    return 0;
+}
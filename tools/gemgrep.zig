@@ -0,0 +1,306 @@
+//! This tool searches gemini text files for a string, but only inside the
+//! selected parts of the documents:
+//!
+//!     gemgrep [--jobs N] [--type TYPE]... [--field FIELD] [-i] PATTERN PATH...
+//!
+//! TYPE is one of `heading`, `link`, `list`, `quote`, `paragraph` or
+//! `preformatted` and may be given several times; all types are searched by
+//! default. FIELD selects `href` or `title` of links, or the `text` of all
+//! other lines; both fields of links and the text of other lines are searched
+//! by default. `-i` ignores ASCII case.
+//!
+//! Every PATH is either a file or a directory, which is searched for `.gmi`
+//! files. Files are searched in parallel on a `ThreadPool`; a file that doesn't
+//! contain the pattern anywhere is skipped with a vectorized search before its
+//! lines are classified. Matches are reported as `file:line: line`.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+const corpus = @import("corpus.zig");
+
+const max_file_size = 64 * 1024 * 1024;
+
+const legal_whitespace = "\t ";
+
+const Field = enum { any, href, title, text };
+
+/// A string to search for, with a vectorized search for its first and last byte.
+const Pattern = struct {
+    text: []const u8,
+    ignore_case: bool,
+
+    const vector_len = std.simd.suggestVectorLength(u8) orelse 16;
+    const Vector = @Vector(vector_len, u8);
+
+    fn eql(self: Pattern, candidate: []const u8) bool {
+        return if (self.ignore_case)
+            std.ascii.eqlIgnoreCase(candidate, self.text)
+        else
+            std.mem.eql(u8, candidate, self.text);
+    }
+
+    fn isMatch(self: Pattern, byte: u8, expected: u8) bool {
+        return if (self.ignore_case)
+            std.ascii.toLower(byte) == std.ascii.toLower(expected)
+        else
+            byte == expected;
+    }
+
+    const Mask = std.meta.Int(.unsigned, vector_len);
+
+    fn splat(byte: u8) Vector {
+        return @splat(byte);
+    }
+
+    fn bitMask(matches: @Vector(vector_len, bool)) Mask {
+        return @bitCast(matches);
+    }
+
+    /// Returns whether `haystack` contains the pattern.
+    fn isFoundIn(self: Pattern, haystack: []const u8) bool {
+        const needle = self.text;
+        if (needle.len == 0)
+            return true;
+        if (haystack.len < needle.len)
+            return false;
+
+        const first = needle[0];
+        const last = needle[needle.len - 1];
+        const first_lower = splat(std.ascii.toLower(first));
+        const first_upper = splat(if (self.ignore_case) std.ascii.toUpper(first) else first);
+        const last_lower = splat(std.ascii.toLower(last));
+        const last_upper = splat(if (self.ignore_case) std.ascii.toUpper(last) else last);
+
+        // Only positions where both the first and the last byte match are compared.
+        const end = haystack.len - needle.len + 1;
+        var offset: usize = 0;
+        while (offset + vector_len <= end) : (offset += vector_len) {
+            const heads: Vector = haystack[offset..][0..vector_len].*;
+            const tails: Vector = haystack[offset + needle.len - 1 ..][0..vector_len].*;
+            const heads_match = bitMask(heads == first_lower) | bitMask(heads == first_upper);
+            const tails_match = bitMask(tails == last_lower) | bitMask(tails == last_upper);
+
+            var mask = heads_match & tails_match;
+            while (mask != 0) : (mask &= mask - 1) {
+                const index = offset + @ctz(mask);
+                if (self.eql(haystack[index..][0..needle.len]))
+                    return true;
+            }
+        }
+
+        while (offset < end) : (offset += 1) {
+            if (self.isMatch(haystack[offset], first) and self.eql(haystack[offset..][0..needle.len]))
+                return true;
+        }
+        return false;
+    }
+};
+
+const Options = struct {
+    pattern: Pattern,
+    types: std.EnumSet(gemtext.FragmentType),
+    field: Field,
+};
+
+/// The matches of a file, formatted as `file:line: line` in line order.
+const Result = struct {
+    output: []u8 = &.{},
+    count: usize = 0,
+};
+
+const Context = struct {
+    allocator: std.mem.Allocator,
+    options: Options,
+    results: []Result,
+};
+
+fn searchFile(context: *Context, index: usize, path: []const u8) !void {
+    const options = context.options;
+
+    const text = try std.fs.cwd().readFileAlloc(context.allocator, path, max_file_size);
+    defer context.allocator.free(text);
+
+    if (!options.pattern.isFoundIn(text))
+        return;
+
+    var output = std.ArrayList(u8).init(context.allocator);
+    defer output.deinit();
+    var count: usize = 0;
+
+    var preformatted = false;
+    var line_number: usize = 0;
+    var rest: []const u8 = text;
+    while (rest.len > 0) {
+        const end = gemtext.kernels.indexOfNewline(rest);
+        var line = rest[0..end];
+        rest = rest[@min(end + 1, rest.len)..];
+        line_number += 1;
+
+        if (line.len > 0 and line[line.len - 1] == '\r')
+            line = line[0 .. line.len - 1];
+
+        const kind = gemtext.kernels.classifyLine(line);
+        if (kind == .preformatted_toggle) {
+            preformatted = !preformatted;
+            continue;
+        }
+
+        const found = if (preformatted)
+            options.types.contains(.preformatted) and options.field != .href and options.field != .title and
+                options.pattern.isFoundIn(line)
+        else
+            isLineMatch(options, kind, line);
+
+        if (found) {
+            try output.writer().print("{s}:{}: {s}\n", .{ path, line_number, line });
+            count += 1;
+        }
+    }
+
+    context.results[index] = Result{
+        .output = try output.toOwnedSlice(),
+        .count = count,
+    };
+}
+
+/// Returns whether the selected field of a line outside of preformatted blocks matches.
+fn isLineMatch(options: Options, kind: gemtext.kernels.LineKind, line: []const u8) bool {
+    const fragment_type: gemtext.FragmentType = switch (kind) {
+        .heading_1, .heading_2, .heading_3 => .heading,
+        .link => .link,
+        .list => .list,
+        .quote => .quote,
+        .text => .paragraph,
+        .preformatted_toggle => unreachable,
+    };
+    const content = switch (kind) {
+        .heading_1, .heading_2, .heading_3 => std.mem.trimLeft(u8, line, "#"),
+        .link, .list => line[2..],
+        .quote => line[1..],
+        else => line,
+    };
+    if (!options.types.contains(fragment_type))
+        return false;
+
+    const trimmed = std.mem.trim(u8, content, legal_whitespace);
+    if (trimmed.len == 0)
+        return false;
+
+    if (fragment_type != .link) {
+        return switch (options.field) {
+            .any, .text => options.pattern.isFoundIn(trimmed),
+            .href, .title => false,
+        };
+    }
+
+    const split = std.mem.indexOfAny(u8, trimmed, legal_whitespace) orelse trimmed.len;
+    const href = trimmed[0..split];
+    const title = std.mem.trim(u8, trimmed[split..], legal_whitespace);
+    return switch (options.field) {
+        .any => options.pattern.isFoundIn(href) or options.pattern.isFoundIn(title),
+        .href => options.pattern.isFoundIn(href),
+        .title => options.pattern.isFoundIn(title),
+        .text => false,
+    };
+}
+
+fn usage() u8 {
+    std.log.err("usage: gemgrep [--jobs N] [--type TYPE]... [--field href|title|text] [-i] PATTERN PATH...", .{});
+    return 2;
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    var arena_instance = std.heap.ArenaAllocator.init(allocator);
+    defer arena_instance.deinit();
+    const arena = arena_instance.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var jobs: usize = 0;
+    var types = std.EnumSet(gemtext.FragmentType).initEmpty();
+    var field: Field = .any;
+    var ignore_case = false;
+    var pattern: ?[]const u8 = null;
+    var paths = std.ArrayList([]const u8).init(arena);
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--jobs") and i + 1 < args.len) {
+            i += 1;
+            jobs = try std.fmt.parseInt(usize, args[i], 10);
+            continue;
+        }
+        if (std.mem.eql(u8, arg, "--type") and i + 1 < args.len) {
+            i += 1;
+            const fragment_type = std.meta.stringToEnum(gemtext.FragmentType, args[i]) orelse return usage();
+            if (fragment_type == .empty)
+                return usage();
+            types.insert(fragment_type);
+            continue;
+        }
+        if (std.mem.eql(u8, arg, "--field") and i + 1 < args.len) {
+            i += 1;
+            field = std.meta.stringToEnum(Field, args[i]) orelse return usage();
+            continue;
+        }
+        if (std.mem.eql(u8, arg, "-i")) {
+            ignore_case = true;
+            continue;
+        }
+        if (pattern == null) {
+            pattern = arg;
+            continue;
+        }
+
+        try paths.append(arg);
+    }
+
+    if (pattern == null)
+        return usage();
+    const files = try corpus.collectFiles(allocator, arena, paths.items);
+    if (files.len == 0)
+        return usage();
+    if (types.count() == 0) {
+        types = std.EnumSet(gemtext.FragmentType).initFull();
+        types.remove(.empty);
+    }
+
+    var context = Context{
+        .allocator = allocator,
+        .options = Options{
+            .pattern = Pattern{ .text = pattern.?, .ignore_case = ignore_case },
+            .types = types,
+            .field = field,
+        },
+        .results = try arena.alloc(Result, files.len),
+    };
+    @memset(context.results, .{});
+    defer {
+        for (context.results) |result| {
+            allocator.free(result.output);
+        }
+    }
+    const failed = try corpus.forEach(allocator, jobs, files, &context, searchFile);
+
+    // Matches are printed in the order of the files on the command line.
+    var stdout = std.io.bufferedWriter(std.io.getStdOut().writer());
+    const writer = stdout.writer();
+
+    var match_count: usize = 0;
+    for (context.results) |result| {
+        try writer.writeAll(result.output);
+        match_count += result.count;
+    }
+    try stdout.flush();
+
+    if (failed > 0)
+        return 2;
+    return if (match_count > 0) 0 else 1;
+}
@@ -0,0 +1,240 @@
+//! This tool verifies that every relative link in a capsule points to an existing
+//! file or directory:
+//!
+//!     gemlinkcheck [--jobs N] ROOT
+//!
+//! All `.gmi` files below ROOT are scanned in parallel on a `ThreadPool` with
+//! `LinkScanner`, which finds links without parsing the documents. Link targets
+//! are resolved against the linking file (or ROOT for absolute paths),
+//! deduplicated, and checked against one cached listing per directory, so each
+//! directory is read once no matter how many links point into it. Targets outside
+//! of ROOT are broken without looking at them.
+//!
+//! Broken links are reported as `file:line: href` and make the tool exit with 1,
+//! as do files that can't be read, which are reported and skipped.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+const corpus = @import("corpus.zig");
+
+const max_file_size = 64 * 1024 * 1024;
+
+/// A link from a source file to a unique target.
+const Reference = struct {
+    file: u32,
+    line: u32,
+    target: u32,
+    href: []const u8,
+};
+
+/// The local links of one file, with their resolved targets.
+const Scan = struct {
+    arena: std.heap.ArenaAllocator,
+    links: []const Link = &.{},
+    /// All links, including the ones with a scheme.
+    link_count: usize = 0,
+
+    const Link = struct {
+        line: u32,
+        href: []const u8,
+        target: []const u8,
+    };
+};
+
+const Context = struct {
+    root: std.fs.Dir,
+    scans: []Scan,
+};
+
+fn scanFile(context: *Context, index: usize, path: []const u8) !void {
+    const scan = &context.scans[index];
+    const arena = scan.arena.allocator();
+
+    const text = try context.root.readFileAlloc(arena, path, max_file_size);
+    const directory = std.fs.path.dirnamePosix(path) orelse "";
+
+    var links = std.ArrayList(Scan.Link).init(arena);
+    var scanner = gemtext.LinkScanner.init(text);
+    while (scanner.next()) |link| {
+        scan.link_count += 1;
+
+        const target = try gemtext.resolveLinkTarget(arena, directory, link.href) orelse continue;
+        try links.append(Scan.Link{
+            .line = @intCast(link.line),
+            .href = link.href,
+            .target = target,
+        });
+    }
+    scan.links = links.items;
+}
+
+/// The entries of a directory below the root, or `null` if the directory doesn't exist.
+const Listing = ?std.StringHashMapUnmanaged(void);
+
+const ListContext = struct {
+    root: std.fs.Dir,
+    listings: []Listing,
+    arenas: []std.heap.ArenaAllocator,
+};
+
+fn listTask(context: *ListContext, index: usize, path: []const u8) !void {
+    context.listings[index] = listDirectory(context.arenas[index].allocator(), context.root, path) catch null;
+}
+
+/// Returns whether `target` resolved to a path outside of the root.
+fn isOutsideRoot(target: []const u8) bool {
+    return std.mem.eql(u8, target, "..") or std.mem.startsWith(u8, target, "../");
+}
+
+fn listDirectory(arena: std.mem.Allocator, root: std.fs.Dir, path: []const u8) !Listing {
+    var dir = root.openDir(if (path.len == 0) "." else path, .{ .iterate = true }) catch |err| switch (err) {
+        error.FileNotFound, error.NotDir => return null,
+        else => return err,
+    };
+    defer dir.close();
+
+    var entries = std.StringHashMapUnmanaged(void){};
+    var iterator = dir.iterate();
+    while (try iterator.next()) |entry| {
+        try entries.put(arena, try arena.dupe(u8, entry.name), {});
+    }
+    return entries;
+}
+
+fn lessThan(files: []const []const u8, a: Reference, b: Reference) bool {
+    if (a.file != b.file)
+        return std.mem.lessThan(u8, files[a.file], files[b.file]);
+    return a.line < b.line;
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    var arena_instance = std.heap.ArenaAllocator.init(allocator);
+    defer arena_instance.deinit();
+    const arena = arena_instance.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var jobs: usize = 0;
+    var root_path: ?[]const u8 = null;
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        if (std.mem.eql(u8, args[i], "--jobs") and i + 1 < args.len) {
+            i += 1;
+            jobs = try std.fmt.parseInt(usize, args[i], 10);
+        } else {
+            root_path = args[i];
+        }
+    }
+
+    var root = try std.fs.cwd().openDir(root_path orelse ".", .{ .iterate = true });
+    defer root.close();
+
+    // Collect all documents.
+    var files = std.ArrayList([]const u8).init(arena);
+    {
+        var walker = try root.walk(allocator);
+        defer walker.deinit();
+        while (try walker.next()) |entry| {
+            if (entry.kind == .file and std.mem.endsWith(u8, entry.basename, ".gmi"))
+                try files.append(try arena.dupe(u8, entry.path));
+        }
+    }
+
+    // Scan all documents for links.
+    var context = Context{
+        .root = root,
+        .scans = try arena.alloc(Scan, files.items.len),
+    };
+    for (context.scans) |*scan| {
+        scan.* = Scan{ .arena = std.heap.ArenaAllocator.init(allocator) };
+    }
+    defer {
+        for (context.scans) |*scan| {
+            scan.arena.deinit();
+        }
+    }
+    const failed = try corpus.forEach(allocator, jobs, files.items, &context, scanFile);
+
+    // Deduplicate the targets and group the ones inside the root by directory.
+    var targets = std.StringArrayHashMap(void).init(arena);
+    var directories = std.StringArrayHashMap(void).init(arena);
+    var link_count: usize = 0;
+    var references = std.ArrayList(Reference).init(arena);
+    for (context.scans, 0..) |scan, file| {
+        link_count += scan.link_count;
+        for (scan.links) |link| {
+            const entry = try targets.getOrPut(link.target);
+            if (!entry.found_existing and !isOutsideRoot(link.target) and !std.mem.eql(u8, link.target, "."))
+                _ = try directories.getOrPut(std.fs.path.dirnamePosix(link.target) orelse "");
+            try references.append(Reference{
+                .file = @intCast(file),
+                .line = link.line,
+                .target = @intCast(entry.index),
+                .href = link.href,
+            });
+        }
+    }
+
+    // List every directory that is linked into once.
+    var list_context = ListContext{
+        .root = root,
+        .listings = try arena.alloc(Listing, directories.count()),
+        .arenas = try arena.alloc(std.heap.ArenaAllocator, directories.count()),
+    };
+    for (list_context.arenas) |*list_arena| {
+        list_arena.* = std.heap.ArenaAllocator.init(allocator);
+    }
+    defer {
+        for (list_context.arenas) |*list_arena| {
+            list_arena.deinit();
+        }
+    }
+    _ = try corpus.forEach(allocator, jobs, directories.keys(), &list_context, listTask);
+
+    // Check every unique target against the listing of its directory.
+    const exists = try arena.alloc(bool, targets.count());
+    for (targets.keys(), exists) |target, *target_exists| {
+        if (std.mem.eql(u8, target, ".")) {
+            target_exists.* = true;
+            continue;
+        }
+        if (isOutsideRoot(target)) {
+            target_exists.* = false; // outside of the root
+            continue;
+        }
+        const directory = directories.getIndex(std.fs.path.dirnamePosix(target) orelse "").?;
+        target_exists.* = if (list_context.listings[directory]) |listing|
+            listing.contains(std.fs.path.basenamePosix(target))
+        else
+            false;
+    }
+
+    // Report broken links in file and line order.
+    std.mem.sort(Reference, references.items, @as([]const []const u8, files.items), lessThan);
+
+    var stdout = std.io.bufferedWriter(std.io.getStdOut().writer());
+    var broken: usize = 0;
+    for (references.items) |reference| {
+        if (exists[reference.target])
+            continue;
+        broken += 1;
+        try stdout.writer().print("{s}:{}: {s}\n", .{ files.items[reference.file], reference.line, reference.href });
+    }
+    try stdout.flush();
+
+    std.log.info("{} files, {} links, {} local targets, {} broken links", .{
+        files.items.len,
+        link_count,
+        targets.count(),
+        broken,
+    });
+
+    return if (broken > 0 or failed > 0) 1 else 0;
+}
@@ -0,0 +1,84 @@
+//! Compares parsing and rendering a document per request with the default
+//! allocator of the library against a `std::pmr::monotonic_buffer_resource`
+//! request arena.
+//!
+//! Usage: gempmrbench [file] [iterations]
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include "gemtext.hpp"
+
+static std::string readFile(char const *path)
+{
+  std::FILE *file = std::fopen(path, "rb");
+  if (file == nullptr)
+    throw std::runtime_error(std::string("could not open ") + path);
+
+  std::string text;
+  char buffer[16384];
+  std::size_t length;
+  while ((length = std::fread(buffer, 1, sizeof buffer, file)) > 0)
+    text.append(buffer, length);
+  std::fclose(file);
+  return text;
+}
+
+/// Simulates one request: parse the document and render it to HTML.
+static std::size_t handleRequest(std::string_view text, std::pmr::memory_resource *resource)
+{
+  std::size_t rendered = 0;
+  auto document = gemtext::Document::parse(text, resource);
+  document.render(GEMTEXT_RENDER_HTML, [&](std::string_view bytes)
+                  { rendered += bytes.size(); });
+  return rendered;
+}
+
+template <class Fn>
+static double measure(std::size_t iterations, Fn &&fn)
+{
+  auto const start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; i++)
+    fn();
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+  try
+  {
+    std::string const text = readFile(argc > 1 ? argv[1] : "src/test-data/specification.gmi");
+    std::size_t const iterations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000;
+
+    std::size_t sink = 0;
+
+    double const default_time = measure(iterations, [&]
+                                        { sink += handleRequest(text, nullptr); });
+
+    // The arena is reused for every request, like a per-connection buffer in a server.
+    std::pmr::monotonic_buffer_resource arena(4 * text.size() + 65536);
+    double const arena_time = measure(iterations, [&]
+                                      {
+                                        sink += handleRequest(text, &arena);
+                                        arena.release(); });
+
+    double const mib = static_cast<double>(text.size() * iterations) / (1024.0 * 1024.0);
+    std::printf("document: %zu bytes, %zu iterations\n", text.size(), iterations);
+    std::printf("c_allocator:                %8.3f s  %8.1f MiB/s\n", default_time, mib / default_time);
+    std::printf("monotonic_buffer_resource:  %8.3f s  %8.1f MiB/s\n", arena_time, mib / arena_time);
+    std::printf("speedup:                    %8.2fx\n", default_time / arena_time);
+
+    return sink == 0 ? 1 : 0;
+  }
+  catch (std::exception const &err)
+  {
+    std::fprintf(stderr, "%s\n", err.what());
+    return 1;
+  }
+}
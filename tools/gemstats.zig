@@ -0,0 +1,94 @@
+//! This tool sums up the statistics of a corpus of gemini text files:
+//!
+//!     gemstats [--jobs N] PATH...
+//!
+//! Every PATH is either a file or a directory, which is searched for `.gmi` files.
+//! The files are counted in parallel on a `ThreadPool` with `Statistics.collect`,
+//! which scans each file once without parsing it, and the statistics of all files
+//! are added up at the end.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+const corpus = @import("corpus.zig");
+
+const max_file_size = 64 * 1024 * 1024;
+
+const Context = struct {
+    allocator: std.mem.Allocator,
+    /// The statistics of each file.
+    statistics: []gemtext.Statistics,
+};
+
+fn countFile(context: *Context, index: usize, path: []const u8) !void {
+    const text = try std.fs.cwd().readFileAlloc(context.allocator, path, max_file_size);
+    defer context.allocator.free(text);
+
+    context.statistics[index] = gemtext.Statistics.collect(text);
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    const allocator = gpa.allocator();
+
+    var arena_instance = std.heap.ArenaAllocator.init(allocator);
+    defer arena_instance.deinit();
+    const arena = arena_instance.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var jobs: usize = 0;
+    var paths = std.ArrayList([]const u8).init(arena);
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        if (std.mem.eql(u8, args[i], "--jobs") and i + 1 < args.len) {
+            i += 1;
+            jobs = try std.fmt.parseInt(usize, args[i], 10);
+        } else {
+            try paths.append(args[i]);
+        }
+    }
+
+    const files = try corpus.collectFiles(allocator, arena, paths.items);
+    if (files.len == 0) {
+        std.log.err("usage: gemstats [--jobs N] PATH...", .{});
+        return 1;
+    }
+
+    var context = Context{
+        .allocator = allocator,
+        .statistics = try arena.alloc(gemtext.Statistics, files.len),
+    };
+    @memset(context.statistics, .{});
+    const failed = try corpus.forEach(allocator, jobs, files, &context, countFile);
+
+    var total = gemtext.Statistics{};
+    for (context.statistics) |statistics| {
+        total.add(statistics);
+    }
+    const file_count = files.len - failed;
+
+    var stdout = std.io.bufferedWriter(std.io.getStdOut().writer());
+    const writer = stdout.writer();
+
+    try writer.print("files               {}\n", .{file_count});
+    try writer.print("bytes               {}\n", .{total.bytes});
+    try writer.print("lines               {}\n", .{total.lines});
+    try writer.print("words               {}\n", .{total.words});
+    try writer.print("longest line        {}\n", .{total.longest_line});
+    try writer.print("preformatted lines  {}\n", .{total.preformatted_lines});
+    try writer.print("preformatted bytes  {}\n", .{total.preformatted_bytes});
+    inline for (comptime std.enums.values(gemtext.FragmentType)) |tag| {
+        try writer.print("fragments.{s: <9} {}\n", .{ @tagName(tag), total.fragments.get(tag) });
+    }
+    try writer.print("links               {}\n", .{total.linkCount()});
+    inline for (comptime std.enums.values(gemtext.LinkScheme)) |tag| {
+        try writer.print("links.{s: <13} {}\n", .{ @tagName(tag), total.links.get(tag) });
+    }
+    try stdout.flush();
+
+    return if (failed > 0) 1 else 0;
+}
@@ -0,0 +1,84 @@
+//! Compares rendering a document to HTML through a per-chunk `std::ostream::write`
+//! callback, the `std::ostream` and `std::streambuf` sinks of the C++ bindings,
+//! and raw `fwrite` into a `FILE`.
+//!
+//! Usage: gemstreambench [file] [iterations]
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <sstream>
+#include <string>
+#include "gemtext.hpp"
+
+template <class Fn>
+static double measure(std::size_t iterations, Fn &&fn)
+{
+  auto const start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < iterations; i++)
+    fn();
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+  try
+  {
+    std::FILE *input = std::fopen(argc > 1 ? argv[1] : "src/test-data/specification.gmi", "rb");
+    if (input == nullptr)
+    {
+      std::fprintf(stderr, "could not open input file\n");
+      return 1;
+    }
+    auto const document = gemtext::Document::parse(input);
+    std::fclose(input);
+
+    std::size_t const iterations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000;
+
+    std::ostringstream stream;
+    double const callback_time = measure(iterations, [&]
+                                         {
+                                           stream.str({});
+                                           document.render(GEMTEXT_RENDER_HTML, [&](std::string_view bytes)
+                                                           { stream.write(bytes.data(), static_cast<std::streamsize>(bytes.size())); }); });
+    std::size_t const output_size = stream.str().size();
+
+    double const ostream_time = measure(iterations, [&]
+                                        {
+                                          stream.str({});
+                                          document.render(GEMTEXT_RENDER_HTML, stream); });
+
+    std::stringbuf buffer;
+    double const streambuf_time = measure(iterations, [&]
+                                          {
+                                            buffer.str({});
+                                            document.render(GEMTEXT_RENDER_HTML, buffer); });
+
+    std::FILE *null_file = std::fopen("/dev/null", "wb");
+    if (null_file == nullptr)
+    {
+      std::fprintf(stderr, "could not open /dev/null\n");
+      return 1;
+    }
+    double const fwrite_time = measure(iterations, [&]
+                                       { document.render(GEMTEXT_RENDER_HTML, [&](std::string_view bytes)
+                                                         { std::fwrite(bytes.data(), 1, bytes.size(), null_file); }); });
+    std::fclose(null_file);
+
+    double const mib = static_cast<double>(output_size * iterations) / (1024.0 * 1024.0);
+    std::printf("output: %zu bytes, %zu iterations\n", output_size, iterations);
+    std::printf("ostream::write callback:  %8.1f MiB/s\n", mib / callback_time);
+    std::printf("std::ostream sink:        %8.1f MiB/s\n", mib / ostream_time);
+    std::printf("std::streambuf sink:      %8.1f MiB/s\n", mib / streambuf_time);
+    std::printf("fwrite:                   %8.1f MiB/s\n", mib / fwrite_time);
+    return 0;
+  }
+  catch (std::exception const &err)
+  {
+    std::fprintf(stderr, "%s\n", err.what());
+    return 1;
+  }
+}
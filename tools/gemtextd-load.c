@@ -0,0 +1,240 @@
+//! Load generator for gemtextd. Opens a number of connections and sends the
+//! same conversion request over each of them as fast as possible:
+//!
+//!     gemtextd-load [--socket PATH] [--connections N] [--requests N] [--renderer html|markdown|rtf|gemtext] [--path] FILE
+//!
+//! With `--path`, FILE is sent as a path relative to the daemon root and served
+//! from its render cache, otherwise the contents of FILE are sent.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <gemtextd.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct worker
+{
+  pthread_t thread;
+  char const *socket_path;
+  enum gemtextd_source source;
+  enum gemtext_renderer renderer;
+  char const *payload;
+  size_t length;
+  size_t requests;
+
+  size_t failures;
+  /// The latencies of the successful requests, the first `completed` entries are valid.
+  size_t completed;
+  double *latencies;
+};
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *runWorker(void *arg)
+{
+  struct worker *worker = arg;
+
+  struct gemtextd_client client;
+  if (gemtextdConnect(&client, worker->socket_path) != 0)
+  {
+    worker->failures = worker->requests;
+    return NULL;
+  }
+
+  for (size_t i = 0; i < worker->requests; i++)
+  {
+    char const *body;
+    size_t body_length;
+
+    double const start = now();
+    int status = gemtextdRender(&client, worker->source, worker->renderer, 0, worker->payload, worker->length, &body, &body_length);
+    double const latency = now() - start;
+
+    if (status == 0)
+      worker->latencies[worker->completed++] = latency;
+    else
+    {
+      worker->failures++;
+      if (status == GEMTEXTD_ERR_IO)
+      {
+        worker->failures += worker->requests - i - 1;
+        break;
+      }
+    }
+  }
+
+  gemtextdDisconnect(&client);
+  return NULL;
+}
+
+static int compareDouble(void const *a, void const *b)
+{
+  double const x = *(double const *)a;
+  double const y = *(double const *)b;
+  return (x > y) - (x < y);
+}
+
+/// Returns the contents of the regular file at `path`, or NULL with `errno` set.
+static char *readFile(char const *path, size_t *length)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return NULL;
+
+  // ftell fails on pipes and other files without a size.
+  long size = -1;
+  if (fseek(f, 0, SEEK_END) == 0)
+    size = ftell(f);
+  if (size < 0 || fseek(f, 0, SEEK_SET) != 0)
+  {
+    fclose(f);
+    return NULL;
+  }
+
+  char *data = malloc(size > 0 ? (size_t)size : 1);
+  if (data != NULL)
+  {
+    *length = fread(data, 1, (size_t)size, f);
+    if (ferror(f))
+    {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(f);
+  return data;
+}
+
+int main(int argc, char **argv)
+{
+  char const *socket_path = GEMTEXTD_DEFAULT_SOCKET;
+  size_t connections = 8;
+  size_t requests = 10000;
+  enum gemtext_renderer renderer = GEMTEXT_RENDER_HTML;
+  enum gemtextd_source source = GEMTEXTD_SOURCE_BYTES;
+  char const *file = NULL;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--path") == 0)
+      source = GEMTEXTD_SOURCE_PATH;
+    else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+      socket_path = argv[++i];
+    else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+      connections = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+      requests = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+    {
+      char const *name = argv[++i];
+      if (strcmp(name, "gemtext") == 0)
+        renderer = GEMTEXT_RENDER_GEMTEXT;
+      else if (strcmp(name, "html") == 0)
+        renderer = GEMTEXT_RENDER_HTML;
+      else if (strcmp(name, "markdown") == 0)
+        renderer = GEMTEXT_RENDER_MARKDOWN;
+      else if (strcmp(name, "rtf") == 0)
+        renderer = GEMTEXT_RENDER_RTF;
+      else
+      {
+        fprintf(stderr, "unknown renderer: %s\n", name);
+        return 1;
+      }
+    }
+    else if (file == NULL && argv[i][0] != '-')
+      file = argv[i];
+    else
+    {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (file == NULL || connections == 0 || requests == 0)
+  {
+    fprintf(stderr, "usage: %s [--socket PATH] [--connections N] [--requests N] [--renderer NAME] [--path] FILE\n", argv[0]);
+    return 1;
+  }
+
+  char *contents = NULL;
+  char const *payload = file;
+  size_t length = strlen(file);
+  if (source == GEMTEXTD_SOURCE_BYTES)
+  {
+    contents = readFile(file, &length);
+    if (contents == NULL)
+    {
+      perror(file);
+      return 1;
+    }
+    payload = contents;
+  }
+
+  struct worker *workers = calloc(connections, sizeof *workers);
+  double *latencies = malloc(connections * requests * sizeof *latencies);
+  if (workers == NULL || latencies == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  double const start = now();
+  size_t started = 0;
+  for (size_t i = 0; i < connections; i++)
+  {
+    workers[i] = (struct worker){
+        .socket_path = socket_path,
+        .source = source,
+        .renderer = renderer,
+        .payload = payload,
+        .length = length,
+        .requests = requests,
+        .latencies = latencies + i * requests,
+    };
+    int const err = pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+    if (err != 0)
+    {
+      fprintf(stderr, "starting connection %zu failed: %s\n", i, strerror(err));
+      break;
+    }
+    started++;
+  }
+
+  // Only successful requests are counted; their latencies are moved to the front.
+  // The requests of connections that couldn't be started count as failed.
+  size_t failures = (connections - started) * requests;
+  size_t completed = 0;
+  for (size_t i = 0; i < started; i++)
+  {
+    pthread_join(workers[i].thread, NULL);
+    failures += workers[i].failures;
+    memmove(latencies + completed, workers[i].latencies, workers[i].completed * sizeof *latencies);
+    completed += workers[i].completed;
+  }
+  double const elapsed = now() - start;
+
+  size_t const total = connections * requests;
+  qsort(latencies, completed, sizeof *latencies, compareDouble);
+
+  printf("%zu requests over %zu connections in %.3f s, %zu failed\n", total, connections, elapsed, failures);
+  printf("throughput: %.0f req/s, %.1f MiB/s in\n", (double)completed / elapsed, (double)(completed * length) / elapsed / (1024.0 * 1024.0));
+  if (completed > 0)
+    printf("latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           1e6 * latencies[completed / 2],
+           1e6 * latencies[completed * 99 / 100],
+           1e6 * latencies[completed - 1]);
+
+  free(latencies);
+  free(workers);
+  free(contents);
+  return failures > 0 ? 1 : 0;
+}
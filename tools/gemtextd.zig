@@ -0,0 +1,466 @@
+//! A local conversion daemon. Services send gemini text or paths over a Unix
+//! domain socket and get the rendered document back, without paying process
+//! startup for every document.
+//!
+//!     gemtextd [--socket PATH] [--root DIR] [--workers N] [--cache-size BYTES] [--max-request BYTES] [--timeout MS]
+//!
+//! The main thread waits for requests on all connections with epoll and hands
+//! each request to a fixed pool of workers, so idle persistent connections don't
+//! occupy a worker. Each worker owns a parser and a scratch arena that are reused
+//! for every request. Rendered files are
+//! kept in a render cache shared by all workers and keyed by path, mtime and size.
+//!
+//! Once a request has started to arrive, a worker reads it to the end. Reads and
+//! writes time out after `--timeout` milliseconds (10s by default, 0 never times
+//! out), so a client that stalls in the middle of a request loses its connection
+//! instead of pinning a worker.
+//!
+//! Requests with the metrics source return the daemon metrics in the Prometheus
+//! text format, so a scraper can be pointed at the socket through a small proxy.
+//!
+//! The wire protocol is described in include/gemtextd.h.
+
+const std = @import("std");
+const gemtext = @import("gemtext");
+
+const posix = std.posix;
+const linux = std.os.linux;
+
+// KEEP THESE IN SYNC WITH include/gemtextd.h AND include/gemtext.h!
+const protocol_version = 1;
+
+const Source = enum(u8) {
+    bytes = 0,
+    path = 1,
+    metrics = 2,
+};
+
+const flag_no_cache: u8 = 1 << 0;
+
+const Status = enum(i8) {
+    success = 0,
+    out_of_memory = -1,
+    line_too_long = -5,
+    block_too_large = -6,
+    too_many_fragments = -7,
+    document_too_large = -8,
+    protocol = -64,
+    not_found = -65,
+    too_large = -66,
+};
+
+const RequestHeader = extern struct {
+    version: u8,
+    source: u8,
+    renderer: u8,
+    flags: u8,
+    length: u32,
+};
+
+const ResponseHeader = extern struct {
+    version: u8,
+    status: i8,
+    reserved: u16,
+    length: u32,
+};
+
+const Options = struct {
+    socket_path: []const u8 = "/tmp/gemtextd.sock",
+    root: []const u8 = ".",
+    workers: usize = 0,
+    cache_size: usize = 64 * 1024 * 1024,
+    max_request: usize = 16 * 1024 * 1024,
+    timeout_ms: u32 = 10_000,
+};
+
+/// Connections with a pending request, waiting for a worker.
+const ConnectionQueue = struct {
+    mutex: std.Thread.Mutex = .{},
+    available: std.Thread.Condition = .{},
+    connections: std.fifo.LinearFifo(std.net.Stream, .Dynamic),
+
+    fn push(self: *ConnectionQueue, stream: std.net.Stream) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        try self.connections.writeItem(stream);
+        self.available.signal();
+    }
+
+    fn pop(self: *ConnectionQueue) std.net.Stream {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (true) {
+            if (self.connections.readItem()) |stream|
+                return stream;
+            self.available.wait(&self.mutex);
+        }
+    }
+};
+
+const Shared = struct {
+    options: Options,
+    root: std.fs.Dir,
+    cache: gemtext.RenderCache,
+    queue: ConnectionQueue,
+    metrics: *gemtext.Metrics,
+    epoll: posix.fd_t,
+
+    /// Reports the next request on `stream` to the event loop, exactly once.
+    fn watch(self: *Shared, stream: std.net.Stream, op: u32) !void {
+        var event = linux.epoll_event{
+            .events = linux.EPOLL.IN | linux.EPOLL.RDHUP | linux.EPOLL.ONESHOT,
+            .data = .{ .fd = stream.handle },
+        };
+        try posix.epoll_ctl(self.epoll, op, stream.handle, &event);
+    }
+};
+
+/// The state of a worker thread, reused for all requests it handles.
+const Worker = struct {
+    shared: *Shared,
+    parser: gemtext.Parser,
+    /// Holds the request payload and the parsed fragments. Reset after each request.
+    arena: std.heap.ArenaAllocator,
+    /// Output of requests that bypass the render cache.
+    output: std.ArrayList(u8),
+
+    fn init(allocator: std.mem.Allocator, shared: *Shared) Worker {
+        return Worker{
+            .shared = shared,
+            .parser = gemtext.Parser.init(allocator),
+            .arena = std.heap.ArenaAllocator.init(allocator),
+            .output = std.ArrayList(u8).init(allocator),
+        };
+    }
+
+    fn run(self: *Worker) void {
+        while (true) {
+            const stream = self.shared.queue.pop();
+
+            self.serve(stream) catch |err| {
+                switch (err) {
+                    error.EndOfStream, error.ConnectionResetByPeer, error.BrokenPipe, error.RequestRejected => {},
+                    error.WouldBlock => std.log.warn("connection timed out", .{}),
+                    else => std.log.warn("connection failed: {s}", .{@errorName(err)}),
+                }
+                stream.close();
+                continue;
+            };
+
+            // Hand the connection back to the event loop until its next request arrives.
+            self.shared.watch(stream, linux.EPOLL.CTL_MOD) catch |err| {
+                std.log.warn("epoll_ctl failed: {s}", .{@errorName(err)});
+                stream.close();
+            };
+        }
+    }
+
+    /// Handles the next request on `stream`. Fails if the connection must be closed.
+    fn serve(self: *Worker, stream: std.net.Stream) !void {
+        defer _ = self.arena.reset(.retain_capacity);
+
+        const reader = stream.reader();
+
+        var header: RequestHeader = undefined;
+        try reader.readNoEof(std.mem.asBytes(&header));
+        const length = std.mem.littleToNative(u32, header.length);
+
+        if (header.version != protocol_version)
+            return reject(stream, .protocol, "unsupported protocol version");
+        if (length > self.shared.options.max_request)
+            return reject(stream, .too_large, "request too large");
+
+        const payload = try self.arena.allocator().alloc(u8, length);
+        try reader.readNoEof(payload);
+
+        const source = std.meta.intToEnum(Source, header.source) catch
+            return reject(stream, .protocol, "invalid source");
+        if (source == .metrics)
+            return self.writeMetrics(stream);
+
+        const format = formatFromRenderer(header.renderer) orelse
+            return reject(stream, .protocol, "invalid renderer");
+
+        switch (source) {
+            .bytes => try self.renderBytes(stream, format, payload),
+            .path => try self.renderPath(stream, format, payload, header.flags & flag_no_cache != 0),
+            .metrics => unreachable,
+        }
+    }
+
+    fn renderBytes(self: *Worker, stream: std.net.Stream, format: gemtext.renderer.Format, text: []const u8) !void {
+        self.output.clearRetainingCapacity();
+        self.render(format, text, self.output.writer()) catch |err| return respondFailure(stream, err);
+        try respond(stream, .success, self.output.items);
+    }
+
+    fn renderPath(self: *Worker, stream: std.net.Stream, format: gemtext.renderer.Format, path: []const u8, no_cache: bool) !void {
+        if (!isSafePath(path))
+            return respondError(stream, .not_found, "invalid path");
+
+        const file = self.shared.root.openFile(path, .{}) catch
+            return respondError(stream, .not_found, "file not found");
+        defer file.close();
+
+        const stat = try file.stat();
+
+        var file_source = FileSource{ .worker = self, .file = file, .size = stat.size };
+
+        if (no_cache) {
+            self.output.clearRetainingCapacity();
+            file_source.render(format, self.output.writer()) catch |err| return respondFailure(stream, err);
+            return respond(stream, .success, self.output.items);
+        }
+
+        var hasher = std.hash.Wyhash.init(0);
+        hasher.update(std.mem.asBytes(&stat.mtime));
+        hasher.update(std.mem.asBytes(&stat.size));
+
+        const key = gemtext.RenderCache.Key{
+            .source = path,
+            .version = hasher.final(),
+            .format = format,
+        };
+        const page = self.shared.cache.get(key, &file_source) catch |err| return respondFailure(stream, err);
+        defer page.release();
+
+        try respond(stream, .success, page.bytes);
+    }
+
+    fn writeMetrics(self: *Worker, stream: std.net.Stream) !void {
+        self.output.clearRetainingCapacity();
+        try self.shared.metrics.write(self.output.writer());
+        try respond(stream, .success, self.output.items);
+    }
+
+    /// Parses `text` with the pooled parser and renders it into `writer`.
+    fn render(self: *Worker, format: gemtext.renderer.Format, text: []const u8, writer: anytype) !void {
+        const arena = self.arena.allocator();
+        const metrics = self.shared.metrics;
+
+        var timer = try std.time.Timer.start();
+
+        self.parser.reset();
+        var fragments = std.ArrayList(gemtext.Fragment).init(arena);
+
+        var offset: usize = 0;
+        while (offset < text.len) {
+            const result = try self.parser.feed(arena, text[offset..]);
+            offset += result.consumed;
+            if (result.fragment) |fragment|
+                try fragments.append(fragment);
+        }
+        if (try self.parser.finalize(arena)) |fragment|
+            try fragments.append(fragment);
+
+        metrics.countParsed(text.len);
+        for (fragments.items) |fragment| {
+            metrics.countFragment(std.meta.activeTag(fragment));
+        }
+        metrics.observeParse(timer.lap());
+
+        var counting = std.io.countingWriter(writer);
+        try gemtext.renderer.render(format, fragments.items, counting.writer());
+        metrics.observeRender(format, counting.bytes_written, timer.read());
+    }
+};
+
+/// Renders a file on a render cache miss.
+const FileSource = struct {
+    worker: *Worker,
+    file: std.fs.File,
+    size: u64,
+
+    pub fn render(self: *FileSource, format: gemtext.renderer.Format, writer: anytype) !void {
+        const max_request = self.worker.shared.options.max_request;
+        if (self.size > max_request)
+            return error.FileTooBig;
+
+        const text = try self.file.readToEndAlloc(self.worker.arena.allocator(), max_request);
+        try self.worker.render(format, text, writer);
+    }
+};
+
+fn formatFromRenderer(renderer: u8) ?gemtext.renderer.Format {
+    return switch (renderer) {
+        0 => .gemtext,
+        1 => .html,
+        2 => .markdown,
+        3 => .rtf,
+        else => null,
+    };
+}
+
+/// Only relative paths that can't escape the root directory are served.
+fn isSafePath(path: []const u8) bool {
+    if (path.len == 0 or std.fs.path.isAbsolute(path))
+        return false;
+    if (std.mem.indexOfScalar(u8, path, 0) != null)
+        return false;
+    var components = std.mem.tokenizeScalar(u8, path, '/');
+    while (components.next()) |component| {
+        if (std.mem.eql(u8, component, ".."))
+            return false;
+    }
+    return true;
+}
+
+fn respond(stream: std.net.Stream, status: Status, body: []const u8) !void {
+    const header = ResponseHeader{
+        .version = protocol_version,
+        .status = @intFromEnum(status),
+        .reserved = 0,
+        .length = std.mem.nativeToLittle(u32, @intCast(body.len)),
+    };
+    var iovecs = [_]std.posix.iovec_const{
+        .{ .iov_base = std.mem.asBytes(&header), .iov_len = @sizeOf(ResponseHeader) },
+        .{ .iov_base = body.ptr, .iov_len = body.len },
+    };
+    try stream.writevAll(&iovecs);
+}
+
+fn respondError(stream: std.net.Stream, status: Status, message: []const u8) !void {
+    try respond(stream, status, message);
+}
+
+/// Answers a request that can't be processed and closes the connection afterwards,
+/// because the rest of the stream can't be trusted to start at a request header.
+fn reject(stream: std.net.Stream, status: Status, message: []const u8) !void {
+    try respond(stream, status, message);
+    return error.RequestRejected;
+}
+
+fn respondFailure(stream: std.net.Stream, err: anyerror) !void {
+    const status: Status = switch (err) {
+        error.OutOfMemory => .out_of_memory,
+        error.LineTooLong => .line_too_long,
+        error.BlockTooLarge => .block_too_large,
+        error.TooManyFragments => .too_many_fragments,
+        error.DocumentTooLarge => .document_too_large,
+        error.FileTooBig => .too_large,
+        else => return err,
+    };
+    try respond(stream, status, @errorName(err));
+}
+
+/// Makes blocking reads and writes on `stream` fail with `error.WouldBlock` after `timeout_ms`.
+fn setTimeouts(stream: std.net.Stream, timeout_ms: u32) !void {
+    const timeout = posix.timeval{
+        .tv_sec = @intCast(timeout_ms / std.time.ms_per_s),
+        .tv_usec = @intCast(timeout_ms % std.time.ms_per_s * std.time.us_per_ms),
+    };
+    try posix.setsockopt(stream.handle, posix.SOL.SOCKET, posix.SO.RCVTIMEO, std.mem.asBytes(&timeout));
+    try posix.setsockopt(stream.handle, posix.SOL.SOCKET, posix.SO.SNDTIMEO, std.mem.asBytes(&timeout));
+}
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+
+    var metrics = gemtext.Metrics{};
+    var counting_allocator = gemtext.Metrics.CountingAllocator{ .child = gpa.allocator(), .metrics = &metrics };
+    const allocator = counting_allocator.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var options = Options{};
+
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 >= args.len)
+            return error.MissingArgument;
+        if (std.mem.eql(u8, arg, "--socket")) {
+            i += 1;
+            options.socket_path = args[i];
+        } else if (std.mem.eql(u8, arg, "--root")) {
+            i += 1;
+            options.root = args[i];
+        } else if (std.mem.eql(u8, arg, "--workers")) {
+            i += 1;
+            options.workers = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--cache-size")) {
+            i += 1;
+            options.cache_size = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--max-request")) {
+            i += 1;
+            options.max_request = try std.fmt.parseInt(usize, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--timeout")) {
+            i += 1;
+            options.timeout_ms = try std.fmt.parseInt(u32, args[i], 10);
+        } else {
+            std.log.err("unknown argument: {s}", .{arg});
+            return 1;
+        }
+    }
+
+    if (options.workers == 0)
+        options.workers = std.Thread.getCpuCount() catch 4;
+
+    var shared = Shared{
+        .options = options,
+        .root = try std.fs.cwd().openDir(options.root, .{}),
+        .cache = try gemtext.RenderCache.init(allocator, .{ .byte_budget = options.cache_size, .metrics = &metrics }),
+        .queue = .{ .connections = std.fifo.LinearFifo(std.net.Stream, .Dynamic).init(allocator) },
+        .metrics = &metrics,
+        .epoll = try posix.epoll_create1(linux.EPOLL.CLOEXEC),
+    };
+    defer shared.root.close();
+    defer shared.cache.deinit();
+    defer shared.queue.connections.deinit();
+    defer posix.close(shared.epoll);
+
+    // A stale socket of an earlier run would make bind() fail.
+    std.fs.cwd().deleteFile(options.socket_path) catch |err| switch (err) {
+        error.FileNotFound => {},
+        else => return err,
+    };
+
+    const address = try std.net.Address.initUnix(options.socket_path);
+    var server = try address.listen(.{ .kernel_backlog = 256 });
+    defer server.deinit();
+
+    const workers = try allocator.alloc(Worker, options.workers);
+    defer allocator.free(workers);
+
+    for (workers) |*worker| {
+        worker.* = Worker.init(allocator, &shared);
+        const thread = try std.Thread.spawn(.{}, Worker.run, .{worker});
+        thread.detach();
+    }
+
+    std.log.info("listening on {s} with {} workers", .{ options.socket_path, options.workers });
+
+    const listener = server.stream.handle;
+    var listener_event = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .fd = listener } };
+    try posix.epoll_ctl(shared.epoll, linux.EPOLL.CTL_ADD, listener, &listener_event);
+
+    // Connections are watched one-shot: a connection is reported once per request,
+    // and the worker that handled the request re-arms it afterwards.
+    var events: [256]linux.epoll_event = undefined;
+    while (true) {
+        const count = posix.epoll_wait(shared.epoll, &events, -1);
+        for (events[0..count]) |event| {
+            if (event.data.fd == listener) {
+                const connection = server.accept() catch |err| {
+                    std.log.warn("accept failed: {s}", .{@errorName(err)});
+                    continue;
+                };
+                setTimeouts(connection.stream, options.timeout_ms) catch |err| {
+                    std.log.warn("setsockopt failed: {s}", .{@errorName(err)});
+                    connection.stream.close();
+                    continue;
+                };
+                shared.watch(connection.stream, linux.EPOLL.CTL_ADD) catch |err| {
+                    std.log.warn("epoll_ctl failed: {s}", .{@errorName(err)});
+                    connection.stream.close();
+                };
+            } else {
+                try shared.queue.push(std.net.Stream{ .handle = event.data.fd });
+            }
+        }
+    }
+}